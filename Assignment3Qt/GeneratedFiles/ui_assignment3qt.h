@@ -13,6 +13,8 @@
 #include <QtWidgets/QAction>
 #include <QtWidgets/QApplication>
 #include <QtWidgets/QButtonGroup>
+#include <QtWidgets/QCheckBox>
+#include <QtWidgets/QComboBox>
 #include <QtWidgets/QFormLayout>
 #include <QtWidgets/QHeaderView>
 #include <QtWidgets/QLabel>
@@ -47,7 +49,28 @@ public:
     QLabel *label_SD;
     QPushButton *pushButton_Browse;
     QLineEdit *sceneDataPath;
+    QLabel *label_PN;
+    QLineEdit *processNum;
+    QLabel *label_IC;
+    QLineEdit *irradianceTolerance;
+    QLabel *label_LC;
+    QLineEdit *lightCutError;
+    QCheckBox *interactive;
+    QCheckBox *denoise;
+    QLabel *label_CostMetric;
+    QComboBox *costMetric;
+    QCheckBox *trace;
+    QLabel *label_TimeBudget;
+    QLineEdit *timeBudget;
+    QCheckBox *checkpoint;
+    QCheckBox *incremental;
+    QCheckBox *relight;
+    QLabel *label_DiffuseStrength;
+    QLineEdit *diffuseStrength;
+    QLabel *label_SpecularStrength;
+    QLineEdit *specularStrength;
     QLabel *label_TValue;
+    QLabel *label_Memory;
     QPushButton *pushButton_Render;
     QSpacerItem *verticalSpacer_3;
     QLabel *label_Image;
@@ -157,20 +180,126 @@ public:
 
         formLayout->setWidget(12, QFormLayout::SpanningRole, sceneDataPath);
 
+        label_PN = new QLabel(layoutWidget);
+        label_PN->setObjectName(QStringLiteral("label_PN"));
+
+        formLayout->setWidget(13, QFormLayout::LabelRole, label_PN);
+
+        processNum = new QLineEdit(layoutWidget);
+        processNum->setObjectName(QStringLiteral("processNum"));
+
+        formLayout->setWidget(13, QFormLayout::FieldRole, processNum);
+
+        label_IC = new QLabel(layoutWidget);
+        label_IC->setObjectName(QStringLiteral("label_IC"));
+
+        formLayout->setWidget(14, QFormLayout::LabelRole, label_IC);
+
+        irradianceTolerance = new QLineEdit(layoutWidget);
+        irradianceTolerance->setObjectName(QStringLiteral("irradianceTolerance"));
+
+        formLayout->setWidget(14, QFormLayout::FieldRole, irradianceTolerance);
+
+        label_LC = new QLabel(layoutWidget);
+        label_LC->setObjectName(QStringLiteral("label_LC"));
+
+        formLayout->setWidget(15, QFormLayout::LabelRole, label_LC);
+
+        lightCutError = new QLineEdit(layoutWidget);
+        lightCutError->setObjectName(QStringLiteral("lightCutError"));
+
+        formLayout->setWidget(15, QFormLayout::FieldRole, lightCutError);
+
+        interactive = new QCheckBox(layoutWidget);
+        interactive->setObjectName(QStringLiteral("interactive"));
+
+        formLayout->setWidget(16, QFormLayout::SpanningRole, interactive);
+
+        denoise = new QCheckBox(layoutWidget);
+        denoise->setObjectName(QStringLiteral("denoise"));
+
+        formLayout->setWidget(17, QFormLayout::SpanningRole, denoise);
+
+        label_CostMetric = new QLabel(layoutWidget);
+        label_CostMetric->setObjectName(QStringLiteral("label_CostMetric"));
+
+        formLayout->setWidget(18, QFormLayout::LabelRole, label_CostMetric);
+
+        costMetric = new QComboBox(layoutWidget);
+        costMetric->setObjectName(QStringLiteral("costMetric"));
+
+        formLayout->setWidget(18, QFormLayout::FieldRole, costMetric);
+
+        trace = new QCheckBox(layoutWidget);
+        trace->setObjectName(QStringLiteral("trace"));
+
+        formLayout->setWidget(19, QFormLayout::SpanningRole, trace);
+
+        label_TimeBudget = new QLabel(layoutWidget);
+        label_TimeBudget->setObjectName(QStringLiteral("label_TimeBudget"));
+
+        formLayout->setWidget(20, QFormLayout::LabelRole, label_TimeBudget);
+
+        timeBudget = new QLineEdit(layoutWidget);
+        timeBudget->setObjectName(QStringLiteral("timeBudget"));
+
+        formLayout->setWidget(20, QFormLayout::FieldRole, timeBudget);
+
+        checkpoint = new QCheckBox(layoutWidget);
+        checkpoint->setObjectName(QStringLiteral("checkpoint"));
+
+        formLayout->setWidget(21, QFormLayout::SpanningRole, checkpoint);
+
+        incremental = new QCheckBox(layoutWidget);
+        incremental->setObjectName(QStringLiteral("incremental"));
+
+        formLayout->setWidget(22, QFormLayout::SpanningRole, incremental);
+
+        relight = new QCheckBox(layoutWidget);
+        relight->setObjectName(QStringLiteral("relight"));
+
+        formLayout->setWidget(23, QFormLayout::SpanningRole, relight);
+
+        label_DiffuseStrength = new QLabel(layoutWidget);
+        label_DiffuseStrength->setObjectName(QStringLiteral("label_DiffuseStrength"));
+
+        formLayout->setWidget(24, QFormLayout::LabelRole, label_DiffuseStrength);
+
+        diffuseStrength = new QLineEdit(layoutWidget);
+        diffuseStrength->setObjectName(QStringLiteral("diffuseStrength"));
+
+        formLayout->setWidget(24, QFormLayout::FieldRole, diffuseStrength);
+
+        label_SpecularStrength = new QLabel(layoutWidget);
+        label_SpecularStrength->setObjectName(QStringLiteral("label_SpecularStrength"));
+
+        formLayout->setWidget(25, QFormLayout::LabelRole, label_SpecularStrength);
+
+        specularStrength = new QLineEdit(layoutWidget);
+        specularStrength->setObjectName(QStringLiteral("specularStrength"));
+
+        formLayout->setWidget(25, QFormLayout::FieldRole, specularStrength);
+
         label_TValue = new QLabel(layoutWidget);
         label_TValue->setObjectName(QStringLiteral("label_TValue"));
         label_TValue->setAlignment(Qt::AlignCenter);
 
-        formLayout->setWidget(15, QFormLayout::SpanningRole, label_TValue);
+        formLayout->setWidget(32, QFormLayout::SpanningRole, label_TValue);
+
+        label_Memory = new QLabel(layoutWidget);
+        label_Memory->setObjectName(QStringLiteral("label_Memory"));
+        label_Memory->setAlignment(Qt::AlignCenter);
+
+        formLayout->setWidget(33, QFormLayout::SpanningRole, label_Memory);
 
         pushButton_Render = new QPushButton(layoutWidget);
         pushButton_Render->setObjectName(QStringLiteral("pushButton_Render"));
 
-        formLayout->setWidget(14, QFormLayout::SpanningRole, pushButton_Render);
+        formLayout->setWidget(31, QFormLayout::SpanningRole, pushButton_Render);
 
         verticalSpacer_3 = new QSpacerItem(20, 540, QSizePolicy::Minimum, QSizePolicy::Expanding);
 
-        formLayout->setItem(13, QFormLayout::SpanningRole, verticalSpacer_3);
+        formLayout->setItem(30, QFormLayout::SpanningRole, verticalSpacer_3);
 
         label_Image = new QLabel(centralWidget);
         label_Image->setObjectName(QStringLiteral("label_Image"));
@@ -192,7 +321,20 @@ public:
         QWidget::setTabOrder(CameraPos, CameraLookAt);
         QWidget::setTabOrder(CameraLookAt, pushButton_Browse);
         QWidget::setTabOrder(pushButton_Browse, sceneDataPath);
-        QWidget::setTabOrder(sceneDataPath, pushButton_Render);
+        QWidget::setTabOrder(sceneDataPath, processNum);
+        QWidget::setTabOrder(processNum, irradianceTolerance);
+        QWidget::setTabOrder(irradianceTolerance, lightCutError);
+        QWidget::setTabOrder(lightCutError, interactive);
+        QWidget::setTabOrder(interactive, denoise);
+        QWidget::setTabOrder(denoise, costMetric);
+        QWidget::setTabOrder(costMetric, trace);
+        QWidget::setTabOrder(trace, timeBudget);
+        QWidget::setTabOrder(timeBudget, checkpoint);
+        QWidget::setTabOrder(checkpoint, incremental);
+        QWidget::setTabOrder(incremental, relight);
+        QWidget::setTabOrder(relight, diffuseStrength);
+        QWidget::setTabOrder(diffuseStrength, specularStrength);
+        QWidget::setTabOrder(specularStrength, pushButton_Render);
 
         retranslateUi(Assignment3QtClass);
 
@@ -217,7 +359,36 @@ public:
         label_SD->setText(QApplication::translate("Assignment3QtClass", "sceneData", 0));
         pushButton_Browse->setText(QApplication::translate("Assignment3QtClass", "Browse...", 0));
         sceneDataPath->setText(QApplication::translate("Assignment3QtClass", "../sceneData.txt", 0));
+        label_PN->setText(QApplication::translate("Assignment3QtClass", "Processes", 0));
+        processNum->setText(QApplication::translate("Assignment3QtClass", "0", 0));
+        label_IC->setText(QApplication::translate("Assignment3QtClass", "Irradiance cache", 0));
+        irradianceTolerance->setText(QApplication::translate("Assignment3QtClass", "0", 0));
+        label_LC->setText(QApplication::translate("Assignment3QtClass", "Light cut error", 0));
+        lightCutError->setText(QApplication::translate("Assignment3QtClass", "0", 0));
+        interactive->setText(QApplication::translate("Assignment3QtClass", "Interactive", 0));
+        denoise->setText(QApplication::translate("Assignment3QtClass", "Denoise", 0));
+        label_CostMetric->setText(QApplication::translate("Assignment3QtClass", "Cost Map:", 0));
+        costMetric->clear();
+        trace->setText(QApplication::translate("Assignment3QtClass", "Save Trace", 0));
+        label_TimeBudget->setText(QApplication::translate("Assignment3QtClass", "Time Budget (s):", 0));
+        timeBudget->setText(QApplication::translate("Assignment3QtClass", "0", 0));
+        checkpoint->setText(QApplication::translate("Assignment3QtClass", "Checkpoint", 0));
+        incremental->setText(QApplication::translate("Assignment3QtClass", "Incremental", 0));
+        relight->setText(QApplication::translate("Assignment3QtClass", "Relight", 0));
+        label_DiffuseStrength->setText(QApplication::translate("Assignment3QtClass", "Diffuse Strength", 0));
+        diffuseStrength->setText(QApplication::translate("Assignment3QtClass", "0.8", 0));
+        label_SpecularStrength->setText(QApplication::translate("Assignment3QtClass", "Specular Strength", 0));
+        specularStrength->setText(QApplication::translate("Assignment3QtClass", "0.2", 0));
+        costMetric->insertItems(0, QStringList()
+         << QApplication::translate("Assignment3QtClass", "None", 0)
+         << QApplication::translate("Assignment3QtClass", "Time (us)", 0)
+         << QApplication::translate("Assignment3QtClass", "BVH Nodes", 0)
+         << QApplication::translate("Assignment3QtClass", "Primitive Tests", 0)
+         << QApplication::translate("Assignment3QtClass", "Shadow Rays", 0)
+         << QApplication::translate("Assignment3QtClass", "All Rays", 0)
+        );
         label_TValue->setText(QApplication::translate("Assignment3QtClass", "Time: 0s", 0));
+        label_Memory->setText(QApplication::translate("Assignment3QtClass", "Memory: 0MB", 0));
         pushButton_Render->setText(QApplication::translate("Assignment3QtClass", "Render", 0));
         label_Image->setText(QApplication::translate("Assignment3QtClass", "Result Image", 0));
     } // retranslateUi
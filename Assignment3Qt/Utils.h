@@ -3,7 +3,10 @@
 #include <vector>
 #include <cmath>
 #include "rayTracingCamera.h"
+#include "sampler.h"
 #include <ctime>
+#include <thread>
+#include <atomic>
 
 #ifndef MYINFINITE
 #define MYINFINITE 999999
@@ -45,6 +48,36 @@ void inline MySwap(T &t1, T &t2)
 	t2 = tmp;
 };
 
+// run func(i) for every i in [0, taskNum) on threadNum threads, a thread grabs the next task as soon as it finishes one
+template <typename Func>
+void ParallelFor(int taskNum, Func func, int threadNum = MYTHREADNUM)
+{
+	std::atomic<int> nextTask(0);
+	std::vector<std::thread> worker(threadNum);
+	for (int t = 0; t < threadNum; t++)
+	{
+		worker[t] = std::thread([&]()
+		{
+			for (int i = nextTask++; i < taskNum; i = nextTask++)
+				func(i);
+		});
+	}
+	for (int t = 0; t < threadNum; t++)
+		worker[t].join();
+}
+
+// 64 bit fnv-1a of size bytes, continuing hash to cover several ranges
+inline unsigned long long HashBytes(const void *data, size_t size, unsigned long long hash = 14695981039346656037ULL)
+{
+	const unsigned char *p = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= p[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
 static void MergeBoundingBox(glm::vec3 &A, glm::vec3 &B, glm::vec3 A1, glm::vec3 B1, glm::vec3 A2, glm::vec3 B2)
 {
 	A[0] = glm::min(A1[0], A2[0]);
@@ -58,64 +91,23 @@ static void MergeBoundingBox(glm::vec3 &A, glm::vec3 &B, glm::vec3 A1, glm::vec3
 
 static bool RayHitAABB(RayClass *ray, glm::vec3 A, glm::vec3 B)
 {
-	float dx = abs(ray->direction.x);
-	float dy = abs(ray->direction.y);
-	float dz = abs(ray->direction.z);
-
-	glm::vec3 A_RS = A - ray->sPoint;
-	glm::vec3 B_RS = B - ray->sPoint;
-
-	if (dx < MYEPSILON && (A_RS.x > MYEPSILON || B_RS.x < -MYEPSILON))
-		return false;
-	if (dy < MYEPSILON && (A_RS.y > MYEPSILON || B_RS.y < -MYEPSILON))
-		return false;
-	if (dz < MYEPSILON && (A_RS.z > MYEPSILON || B_RS.z < -MYEPSILON))
-		return false;
-
-	float maxTMin = -MYINFINITE, minTMax = MYINFINITE, maxTMax = -MYINFINITE;
-
-	if (dx > MYEPSILON)
-	{
-		float t1 = A_RS.x / ray->direction.x;
-		float t2 = B_RS.x / ray->direction.x;
-		if (t1 > t2)
-			MySwap(t1, t2);
-
-		if (maxTMin < t1) maxTMin = t1;
-		if (minTMax > t2) minTMax = t2;
-		if (maxTMax < t2) maxTMax = t2;
-	}
-	if (dy > MYEPSILON)
-	{
-		float t1 = A_RS.y / ray->direction.y;
-		float t2 = B_RS.y / ray->direction.y;
-		if (t1 > t2)
-			MySwap(t1, t2);
-
-		if (maxTMin < t1) maxTMin = t1;
-		if (minTMax > t2) minTMax = t2;
-		if (maxTMax < t2) maxTMax = t2;
-	}
-	if (dz > MYEPSILON)
-	{
-		float t1 = A_RS.z / ray->direction.z;
-		float t2 = B_RS.z / ray->direction.z;
-		if (t1 > t2)
-			MySwap(t1, t2);
-
-		if (maxTMin < t1) maxTMin = t1;
-		if (minTMax > t2) minTMax = t2;
-		if (maxTMax < t2) maxTMax = t2;
-	}
-
-	if (maxTMin < minTMax + MYEPSILON && maxTMax > MYEPSILON)
-		return true;
-	else
-		return false;
+	// entering and leaving distance of each slab, the sign picks which plane is hit first
+	glm::vec3 bounds[2] = { A, B };
+	float tMinX = (bounds[ray->sign[0]].x - ray->sPoint.x) * ray->invDirection.x;
+	float tMaxX = (bounds[1 - ray->sign[0]].x - ray->sPoint.x) * ray->invDirection.x;
+	float tMinY = (bounds[ray->sign[1]].y - ray->sPoint.y) * ray->invDirection.y;
+	float tMaxY = (bounds[1 - ray->sign[1]].y - ray->sPoint.y) * ray->invDirection.y;
+	float tMinZ = (bounds[ray->sign[2]].z - ray->sPoint.z) * ray->invDirection.z;
+	float tMaxZ = (bounds[1 - ray->sign[2]].z - ray->sPoint.z) * ray->invDirection.z;
+
+	float maxTMin = glm::max(glm::max(tMinX, tMinY), tMinZ);
+	float minTMax = glm::min(glm::min(tMaxX, tMaxY), tMaxZ);
+
+	return maxTMin < minTMax + MYEPSILON && minTMax > MYEPSILON;
 }
 
 // this function is inefficient and not precise
-static void BestCandidateAlgorithm(std::vector<glm::vec2> &point, int num, float w, float h)
+static void BestCandidateAlgorithm(std::vector<glm::vec2> &point, int num, float w, float h, unsigned int seed = 0)
 {
 	// candidate num is 2 here
 	int candidateNum = 2;
@@ -124,15 +116,15 @@ static void BestCandidateAlgorithm(std::vector<glm::vec2> &point, int num, float
 	if (num == 0)
 		return;
 
-	srand(time(0));
-	point.push_back(glm::vec2(rand() * w / RAND_MAX - w / 2, rand() * h / RAND_MAX - h / 2));
+	PCG32 random(seed);
+	point.push_back(glm::vec2(random.NextFloat() * w - w / 2, random.NextFloat() * h - h / 2));
 	for (int i = 1; i < num; i++)
 	{
 		float maxDis = 0;
 		glm::vec2 curCandidate;
 		for (int j = 0; j < candidateNum; j++)
 		{
-			glm::vec2 tmpCandidate(rand() * w / RAND_MAX - w / 2, rand() * h / RAND_MAX - h / 2);
+			glm::vec2 tmpCandidate(random.NextFloat() * w - w / 2, random.NextFloat() * h - h / 2);
 			for (std::vector<glm::vec2>::iterator k = point.begin(); k != point.end(); k++)
 			{
 				float tmpDis = length(*k - tmpCandidate);
@@ -8,20 +8,60 @@
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QFile>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QMouseEvent>
+#include <QWheelEvent>
+#include <QKeyEvent>
 
 // GLM Mathematics (glm matrices are column-major ordering)
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "tileCoordinator.h"
+#include "traceLog.h"
+#include "deadlineRender.h"
 #include "Utils.h"
 
 using namespace std;
 
+namespace
+{
+	// a preview frame should be back within this time
+	const float FRAME_BUDGET = 0.05f;
+	// the camera has to rest this long before the view is refined
+	const int REFINE_DELAY_MS = 150;
+	// downscale of the first preview, before any ray cost is measured
+	const int FIRST_DOWNSCALE = 8;
+
+	const float ORBIT_SPEED = 0.01f;	// radians per mouse pixel
+	const float PAN_SPEED = 0.002f;		// of the view distance per mouse pixel
+	const float DOLLY_STEP = 0.9f;		// view distance scale of one wheel notch or key press
+
+	// written in the working directory by renders with "Save Trace" checked
+	const char *TRACE_PATH = "render_trace.json";
+
+	// renders with "Checkpoint" checked save <scene name>.checkpoint in the working directory this often
+	const float CHECKPOINT_SECONDS = 30;
+}
+
 Assignment3Qt::Assignment3Qt(QWidget *parent)
 	: QMainWindow(parent)
+	, interactiveScene(NULL)
+	, interactiveTracer(NULL)
+	, shownDownscale(0)
+	, shownAntiAliasing(0)
+	, rayCost(0)
+	, interactiveRendering(false)
+	, cameraMoved(false)
 {
 	ui.setupUi(this);
+
+	this->refineTimer = new QTimer(this);
+	this->refineTimer->setSingleShot(true);
+	QObject::connect(this->refineTimer, &QTimer::timeout, [this]() { RefineInteractive(); });
+	ui.label_Image->installEventFilter(this);
 	
 	//QObject::connect(ui.pushButton_Render, SIGNAL(clicked()),
 	//	this, SLOT(on_pushButton_Render_clicked()));
@@ -31,6 +71,11 @@ Assignment3Qt::Assignment3Qt(QWidget *parent)
 	on_pushButton_Render_clicked();
 }
 
+Assignment3Qt::~Assignment3Qt()
+{
+	StopInteractive();
+}
+
 // choose the scene data path
 void Assignment3Qt::on_pushButton_Browse_clicked()
 {
@@ -51,29 +96,6 @@ void Assignment3Qt::on_pushButton_Browse_clicked()
 // begin to render
 void Assignment3Qt::on_pushButton_Render_clicked()
 {
-	// ALL COLORS ARE stored in RGB CHANNELS
-
-	// create light
-	vector<LightBase*> light;
-	//light.push_back((LightBase*)new PointLight(glm::vec3(1.3, 0, 1), glm::vec3(1, 1, 1) * 0.7f));
-	//light.push_back((LightBase*)new PointLight(glm::vec3(-1.1, 1, 0.5), glm::vec3(0.4, 0.6, 0.5) * 1.0f));
-	light.push_back((LightBase*)new CubeMap("../cubeMap.hdr", 30.1f));
-
-	// create scene from file
-	vector<GeometryObject*> scene;
-	QString sceneDataPath = ui.sceneDataPath->text();
-	QFile sceneDataFile(sceneDataPath);
-	if (!sceneDataFile.open(QIODevice::ReadOnly | QIODevice::Text))
-		return;
-	QTextStream in(&sceneDataFile);
-	while (!in.atEnd())
-	{
-		QString line = in.readLine();
-		line = line.remove(' ');
-		processSceneData(scene, line);
-	}
-	sceneDataFile.close();
-	
 	// read camera param
 	QStringList cameraPosList = ui.CameraPos->text().split(',');
 	glm::vec3 cameraPos = glm::vec3(cameraPosList[0].toFloat(), cameraPosList[1].toFloat(), cameraPosList[2].toFloat());
@@ -84,147 +106,300 @@ void Assignment3Qt::on_pushButton_Render_clicked()
 	qtIP.resolutionH = ui.resolutionH->text().toInt();
 	qtIP.antiAliasingLevel = ui.antiAliasing->text().toInt();
 	qtIP.imageScaleRatio = ui.imageScaleRatio->text().toInt();
-	// create camera
-	RayTracingCameraClass* camera = new RayTracingCameraClass(cameraPos, cameraLookat, glm::vec3(0, 1, 0), qtIP.antiAliasingLevel);
-	camera->setW(qtIP.resolutionW); // pixel width resolution
-	camera->setH(qtIP.resolutionH); // pixel height resolution
-	camera->setFL(8);  // help to set image center?
-	camera->setIW(8);
-	camera->setIH(6);
-	camera->setP(camera->getPos() + camera->getFront() * camera->getFL());
-
-	// render image
+	qtIP.irradianceTolerance = ui.irradianceTolerance->text().toFloat();
+	qtIP.lightCutError = ui.lightCutError->text().toFloat();
+	qtIP.denoise = ui.denoise->isChecked();
+	qtIP.costMetric = (CostMetric)ui.costMetric->currentIndex();
+	int processNum = ui.processNum->text().toInt();
+	// covers loading too, a cost map or worker processes ignore it
+	float timeBudget = ui.timeBudget->text().toFloat();
+	// an empty or broken weight would silently darken the image, it stops the render instead
+	bool diffuseValid = false, specularValid = false;
+	qtIP.diffuseStrength = ui.diffuseStrength->text().toFloat(&diffuseValid);
+	qtIP.specularStrength = ui.specularStrength->text().toFloat(&specularValid);
+	if (!diffuseValid || !specularValid || qtIP.diffuseStrength < 0 || qtIP.specularStrength < 0)
+	{
+		QMessageBox::warning(this, "Render", "the diffuse and specular strength have to be numbers >= 0");
+		return;
+	}
+
+	if (ui.interactive->isChecked())
+	{
+		// the interactive view is refined to the same image, a click while it renders only moves the camera
+		if (interactiveRendering || StartInteractive(qtIP, cameraPos, cameraLookat))
+			MoveCamera(cameraPos, cameraLookat);
+		return;
+	}
+
 	this->ui.pushButton_Render->setEnabled(false);
 	this->ui.pushButton_Render->repaint();
-	this->RenderImage(qtIP, scene, camera, light);
-	this->ui.pushButton_Render->setEnabled(true);
-
-	// delete camera
-	safe_delete(camera);
-	// delete scene
-	for (vector<GeometryObject*>::iterator i = scene.begin(); i != scene.end(); i++)
-		safe_delete(*i);
-	// delete light
-	for (vector<LightBase*>::iterator i = light.begin(); i != light.end(); i++)
-		safe_delete(*i);
-}
 
-void Assignment3Qt::RenderPixels(RayTracingCameraClass* camera, int row, int start, int end, vector<glm::vec3> &pixelList,
-	vector<GeometryObject*> &scene, vector<LightBase*> &light)
-{
-	vector<RayClass*> rayList;
-	RayHitObjectRecord curRayRecord;
-	int arrayIdx = row * camera->getW() + start;
-	
-	for (int col = start; col < end; col++)
+	// wall time from loading the scene to the displayed image
+	QElapsedTimer renderTimer;
+	renderTimer.start();
+	bool trace = ui.trace->isChecked();
+	if (trace)
+		TraceLog::Start();
+	float meanSpp = 0;
+	int tracedTiles = -1;
+	bool relit = false;
+
+	if (processNum > 0)
+	{
+		// the workers load the scene themselves
+		this->RenderImageByWorkers(qtIP, ui.sceneDataPath->text(), cameraPos, cameraLookat, processNum);
+		timeBudget = 0;
+	}
+	else
 	{
-		camera->GenerateRay(row, col, rayList);
-		// for each ray inside a pixel
-		pixelList[arrayIdx] = glm::vec3();
-		for (vector<RayClass*>::iterator i = rayList.begin(); i != rayList.end(); i++)
+		// create scene from file
+		SceneData *sceneData = new SceneData();
+		// the object identities are only needed to compare this load with the previous one
+		bool withObjectInfo = (ui.incremental->isChecked() || ui.relight->isChecked()) && qtIP.costMetric == COST_NONE;
+		if (sceneData->Load(ui.sceneDataPath->text(), withObjectInfo))
 		{
-			// find the hit object and hit type
-			int hitType = RayHitTest(*i, scene, light, curRayRecord);
-			if (hitType == 1)
-				pixelList[arrayIdx] += calColorOnHitPoint(curRayRecord, scene, light, 1);
-			else if (hitType == 2)
-				pixelList[arrayIdx] += curRayRecord.pointColor;
-
-			safe_delete(*i);
-		}
-		rayList.clear();
+			// create camera, the deadline render takes one sample per ray
+			if (qtIP.costMetric != COST_NONE)
+				timeBudget = 0;
+			QTInputParam cameraIP = qtIP;
+			if (timeBudget > 0)
+				cameraIP.antiAliasingLevel = 1;
+			RayTracingCameraClass* camera = CreateRenderCamera(cameraPos, cameraLookat, cameraIP);
+			RayTracer* rayTracer = new RayTracer(sceneData);
+			rayTracer->SetIrradianceCache(qtIP.irradianceTolerance);
+			rayTracer->SetShadingWeights(qtIP.diffuseStrength, qtIP.specularStrength);
+			rayTracer->SetLightCut(qtIP.lightCutError);
+			rayTracer->SetCostMetric(qtIP.costMetric);
+
+			// the checkpoint holds radiance only, a cost map or the denoiser's features can't be resumed from it
+			RenderCheckpoint *checkpoint = NULL;
+			if (ui.checkpoint->isChecked() && qtIP.costMetric == COST_NONE && !(qtIP.denoise && timeBudget <= 0))
+			{
+				QString checkpointPath = QFileInfo(ui.sceneDataPath->text()).completeBaseName() + ".checkpoint";
+				unsigned long long key = RenderCheckpoint::SettingsKey(ui.sceneDataPath->text(), cameraPos, cameraLookat, cameraIP, rayTracer->SampleSeed(), timeBudget > 0);
+				checkpoint = new RenderCheckpoint(checkpointPath, key, camera->getW(), camera->getH(), CHECKPOINT_SECONDS);
+				checkpoint->Resume();
+			}
 
-		pixelList[arrayIdx] /= camera->getRayNumEachPixel();
+			MemoryReport report;
+			sceneData->ReportMemory(report);
+			ShowMemory(report);
+
+			// render image
+			if (timeBudget > 0)
+				meanSpp = this->RenderImageByDeadline(qtIP, rayTracer, camera, timeBudget - renderTimer.nsecsElapsed() / 1e9f, &report, checkpoint);
+			else if (ui.incremental->isChecked() && qtIP.costMetric == COST_NONE)
+				tracedTiles = this->RenderImageIncremental(qtIP, sceneData, rayTracer, cameraPos, cameraLookat, &report);
+			else if (ui.relight->isChecked() && qtIP.costMetric == COST_NONE)
+				relit = this->RenderImageRelight(qtIP, sceneData, rayTracer, cameraPos, cameraLookat, &report);
+			else
+				this->RenderImage(qtIP, rayTracer, camera, &report, checkpoint);
+
+			safe_delete(checkpoint);
+			safe_delete(rayTracer);
+			safe_delete(camera);
+		}
+		safe_delete(sceneData);
+	}
 
-		arrayIdx++;
+	QString timeText = QString().sprintf("Time: %.2fs", renderTimer.nsecsElapsed() / 1e9);
+	if (meanSpp > 0)
+		timeText += QString().sprintf(", %.1f spp", meanSpp);
+	if (tracedTiles >= 0)
+		timeText += QString().sprintf(", %d / %d tiles", tracedTiles, incrementalRenderer.TileNum());
+	if (relit)
+		timeText += ", relit";
+	ui.label_TValue->setText(timeText);
+	if (trace)
+	{
+		TraceLog::Stop();
+		if (!TraceLog::Save(TRACE_PATH))
+			QMessageBox::warning(this, "Render", QString("can't write ") + TRACE_PATH);
 	}
+
+	this->ui.pushButton_Render->setEnabled(true);
 }
 
-void Assignment3Qt::RenderImage(const QTInputParam &qtIP, vector<GeometryObject*> &scene, RayTracingCameraClass* camera, vector<LightBase*> &light)
+void Assignment3Qt::RenderImage(const QTInputParam &qtIP, RayTracer* rayTracer, RayTracingCameraClass* camera, MemoryReport *report, RenderCheckpoint *checkpoint)
 {
-	const clock_t begin_time = clock();
-
 	// create a new image
 	QImage *qImage = new QImage(camera->getW() * qtIP.imageScaleRatio, camera->getH() * qtIP.imageScaleRatio, QImage::Format_RGB888);
 	
 	// save all rendered pixels, we need to scale them later for visualization
 	int pixelNum = camera->getH() * camera->getW();
-	vector<float> pixelListR;
-	vector<float> pixelListG;
-	vector<float> pixelListB;
 	vector<glm::vec3> pixelList;
-	pixelListR.resize(pixelNum);
-	pixelListG.resize(pixelNum);
-	pixelListB.resize(pixelNum);
 	pixelList.resize(pixelNum);
+	// a cost map has nothing to denoise
+	bool denoise = qtIP.denoise && qtIP.costMetric == COST_NONE;
+	vector<PixelFeature> featureList;
+	if (denoise)
+		featureList.resize(pixelNum);
 
 	//#pragma omp parallel for
 	float localMax = 0.01f;
 	for (int row = 0; row < camera->getH(); row++)
 	{
+		// rows of an interrupted render are taken from its checkpoint
+		if (checkpoint && checkpoint->RowDone(row))
+		{
+			checkpoint->GetRow(row, &pixelList[row * camera->getW()]);
+			PreviewPixels(qImage, qtIP, pixelList, 0, row, camera->getW(), 1, localMax);
+			continue;
+		}
+
 		// use multi threads, when each task is not heavy, multi thread will even slow down the process
 		std::thread processPixel[MYTHREADNUM];
 
 		int start = 0, end = camera->getW() / MYTHREADNUM;
 		for (int i = 0; i < MYTHREADNUM; i++)
 		{
-			processPixel[i] = std::thread(&Assignment3Qt::RenderPixels, this, camera, row, start, end, std::ref(pixelList), scene, light);
+			if (i == MYTHREADNUM - 1)
+				end = camera->getW();
+			PixelFeature *features = denoise ? &featureList[row * camera->getW() + start] : NULL;
+			glm::vec3 *pixels = &pixelList[row * camera->getW() + start];
+			processPixel[i] = std::thread([=]()
+			{
+				// thread slot i is the same trace lane on every row
+				TraceScope trace("tile", "render", i + 1);
+				rayTracer->RenderPixels(camera, row, start, end, pixels, features);
+			});
 			start = end;
 			end += camera->getW() / MYTHREADNUM;
-			if (i == MYTHREADNUM - 1)
-				end = camera->getW() - 1;
 		}
 
 		// Join the threads
 		for (int i = 0; i < MYTHREADNUM; i++)
 			processPixel[i].join();
 
-		int arrayIdx = row * camera->getW();
-		for(int col = 0; col < camera->getW(); col++)
+		if (checkpoint)
 		{
-			pixelListR[arrayIdx] = pixelList[arrayIdx][0];
-			pixelListG[arrayIdx] = pixelList[arrayIdx][1];
-			pixelListB[arrayIdx] = pixelList[arrayIdx][2];
-			localMax = glm::max(localMax, pixelListR[arrayIdx]);
-			localMax = glm::max(localMax, pixelListG[arrayIdx]);
-			localMax = glm::max(localMax, pixelListB[arrayIdx]);
+			checkpoint->SetRow(row, &pixelList[row * camera->getW()], camera->getRayNumEachPixel());
+			if (checkpoint->Due())
+			{
+				TraceScope trace("checkpoint");
+				checkpoint->Save();
+			}
+		}
 
-			float localScale = 255.0f / localMax;
-			int R = min((int)(pixelList[arrayIdx][0] * localScale), 255);
-			int G = min((int)(pixelList[arrayIdx][1] * localScale), 255);
-			int B = min((int)(pixelList[arrayIdx][2] * localScale), 255);
-			for (int rowI = 0; rowI < qtIP.imageScaleRatio; rowI++)
-				for (int colI = 0; colI < qtIP.imageScaleRatio; colI++)
-					qImage->setPixel(col * qtIP.imageScaleRatio + colI, row * qtIP.imageScaleRatio + rowI, qRgb(R, G, B));
+		PreviewPixels(qImage, qtIP, pixelList, 0, row, camera->getW(), 1, localMax);
+	}
+	if (checkpoint)
+		checkpoint->Remove();
 
-			arrayIdx++;
-		}
+	if (qtIP.costMetric != COST_NONE)
+		ShowCostMap(qtIP, pixelList);
+	else
+	{
+		if (denoise)
+			Denoiser::Denoise(camera->getW(), camera->getH(), &pixelList[0], &featureList[0]);
+		ShowImage(qImage, qtIP, pixelList);
+	}
 
-		ui.label_Image->setPixmap(QPixmap::fromImage(*qImage));
-		this->ui.label_Image->repaint();
-		QCoreApplication::processEvents();
+	if (report)
+	{
+		report->Add("framebuffers", VectorBytes(pixelList) + VectorBytes(featureList) + qImage->width() * qImage->height() * 3, denoise ? 3 : 2);
+		rayTracer->ReportMemory(*report);
+		ShowMemory(*report);
+	}
+	safe_delete(qImage);
+}
+
+float Assignment3Qt::RenderImageByDeadline(const QTInputParam &qtIP, RayTracer* rayTracer, RayTracingCameraClass* camera, float budgetSeconds, MemoryReport *report, RenderCheckpoint *checkpoint)
+{
+	QImage *qImage = new QImage(camera->getW() * qtIP.imageScaleRatio, camera->getH() * qtIP.imageScaleRatio, QImage::Format_RGB888);
+	vector<glm::vec3> pixelList;
+
+	float localMax = 0.01f;
+	DeadlineRenderer renderer(rayTracer, camera);
+	renderer.SetCheckpoint(checkpoint);
+	renderer.Render(budgetSeconds, pixelList, [&]() { PreviewPixels(qImage, qtIP, pixelList, 0, 0, camera->getW(), camera->getH(), localMax); });
+	ShowImage(qImage, qtIP, pixelList);
+
+	if (report)
+	{
+		report->Add("framebuffers", VectorBytes(pixelList) + qImage->width() * qImage->height() * 3, 2);
+		renderer.ReportMemory(*report);
+		rayTracer->ReportMemory(*report);
+		ShowMemory(*report);
+	}
+	safe_delete(qImage);
+	return renderer.MeanSamplesPerPixel();
+}
+
+int Assignment3Qt::RenderImageIncremental(const QTInputParam &qtIP, SceneData *sceneData, RayTracer* rayTracer, glm::vec3 cameraPos, glm::vec3 cameraLookat, MemoryReport *report)
+{
+	QImage *qImage = new QImage(qtIP.resolutionW * qtIP.imageScaleRatio, qtIP.resolutionH * qtIP.imageScaleRatio, QImage::Format_RGB888);
+	vector<glm::vec3> pixelList;
+
+	// the kept image has no denoiser features
+	int tracedTiles = incrementalRenderer.Render(sceneData, rayTracer, cameraPos, cameraLookat, qtIP, pixelList);
+	ShowImage(qImage, qtIP, pixelList);
+
+	if (report)
+	{
+		report->Add("framebuffers", VectorBytes(pixelList) + qImage->width() * qImage->height() * 3, 2);
+		incrementalRenderer.ReportMemory(*report);
+		rayTracer->ReportMemory(*report);
+		ShowMemory(*report);
 	}
+	safe_delete(qImage);
+	return tracedTiles;
+}
 
-	// calculate the scale ratio
-	int nthIdx = pixelNum * NTHIDX - 1;
-	nth_element(pixelListR.begin(), pixelListR.begin() + nthIdx, pixelListR.end());
-	nth_element(pixelListG.begin(), pixelListG.begin() + nthIdx, pixelListG.end());
-	nth_element(pixelListB.begin(), pixelListB.begin() + nthIdx, pixelListB.end());
+bool Assignment3Qt::RenderImageRelight(const QTInputParam &qtIP, SceneData *sceneData, RayTracer* rayTracer, glm::vec3 cameraPos, glm::vec3 cameraLookat, MemoryReport *report)
+{
+	QImage *qImage = new QImage(qtIP.resolutionW * qtIP.imageScaleRatio, qtIP.resolutionH * qtIP.imageScaleRatio, QImage::Format_RGB888);
+	vector<glm::vec3> pixelList;
 
-	float maxRadiance = glm::max(0.01f, pixelListR[nthIdx]);
-	maxRadiance = glm::max(maxRadiance, pixelListG[nthIdx]);
-	maxRadiance = glm::max(maxRadiance, pixelListB[nthIdx]);
-	float scale = 255.0f / maxRadiance;
+	bool relit = relightRenderer.Render(sceneData, rayTracer, cameraPos, cameraLookat, qtIP, pixelList);
+	ShowImage(qImage, qtIP, pixelList);
 
-	int arrayIdx = 0;
-	for (int row = 0; row < camera->getH(); row++)
+	if (report)
+	{
+		report->Add("framebuffers", VectorBytes(pixelList) + qImage->width() * qImage->height() * 3, 2);
+		relightRenderer.ReportMemory(*report);
+		rayTracer->ReportMemory(*report);
+		ShowMemory(*report);
+	}
+	safe_delete(qImage);
+	return relit;
+}
+
+void Assignment3Qt::RenderImageByWorkers(const QTInputParam &qtIP, QString sceneDataPath, glm::vec3 cameraPos, glm::vec3 cameraLookat, int processNum)
+{
+	QImage *qImage = new QImage(qtIP.resolutionW * qtIP.imageScaleRatio, qtIP.resolutionH * qtIP.imageScaleRatio, QImage::Format_RGB888);
+	vector<glm::vec3> pixelList;
+
+	float localMax = 0.01f;
+	TileCoordinator coordinator(processNum);
+	bool success = coordinator.Render(sceneDataPath, cameraPos, cameraLookat, qtIP, pixelList,
+		[&](int x, int y, int w, int h) { PreviewPixels(qImage, qtIP, pixelList, x, y, w, h, localMax); });
+
+	if (success && qtIP.costMetric != COST_NONE)
+		ShowCostMap(qtIP, pixelList);
+	else if (success)
+		ShowImage(qImage, qtIP, pixelList);
+	else
+		QMessageBox::warning(this, "Render", "the worker processes could not render the scene");
+	safe_delete(qImage);
+}
+
+void Assignment3Qt::PreviewPixels(QImage *qImage, const QTInputParam &qtIP, vector<glm::vec3> &pixelList, int x, int y, int w, int h, float &localMax)
+{
+	TraceScope trace("preview");
+	for (int row = y; row < y + h; row++)
 	{
-		for (int col = 0; col < camera->getW(); col++)
+		int arrayIdx = row * qtIP.resolutionW + x;
+		for (int col = x; col < x + w; col++)
 		{
-			pixelList[arrayIdx] *= scale;
-			int R = min((int)pixelList[arrayIdx][0], 255);
-			int G = min((int)pixelList[arrayIdx][1], 255);
-			int B = min((int)pixelList[arrayIdx][2], 255);
+			localMax = glm::max(localMax, pixelList[arrayIdx][0]);
+			localMax = glm::max(localMax, pixelList[arrayIdx][1]);
+			localMax = glm::max(localMax, pixelList[arrayIdx][2]);
+
+			float localScale = 255.0f / localMax;
+			int R = min((int)(pixelList[arrayIdx][0] * localScale), 255);
+			int G = min((int)(pixelList[arrayIdx][1] * localScale), 255);
+			int B = min((int)(pixelList[arrayIdx][2] * localScale), 255);
 			for (int rowI = 0; rowI < qtIP.imageScaleRatio; rowI++)
 				for (int colI = 0; colI < qtIP.imageScaleRatio; colI++)
 					qImage->setPixel(col * qtIP.imageScaleRatio + colI, row * qtIP.imageScaleRatio + rowI, qRgb(R, G, B));
@@ -233,153 +408,314 @@ void Assignment3Qt::RenderImage(const QTInputParam &qtIP, vector<GeometryObject*
 		}
 	}
 
-	float timeEllapse = float(clock() - begin_time) / CLOCKS_PER_SEC;
-
-	// display the image
 	ui.label_Image->setPixmap(QPixmap::fromImage(*qImage));
-	ui.label_TValue->setText(QString().sprintf("Time: %.2fs", timeEllapse));
-	safe_delete(qImage);
+	this->ui.label_Image->repaint();
+	QCoreApplication::processEvents();
 }
 
-int Assignment3Qt::RayHitTest(RayClass* ray, vector<GeometryObject*> &scene, vector<LightBase*> &light, RayHitObjectRecord &record, float lightDis)
+void Assignment3Qt::ShowImage(QImage *qImage, const QTInputParam &qtIP, vector<glm::vec3> &pixelList)
 {
-	record.depth = -1;
-	int hitType = 0;
-	RayHitObjectRecord tmpRecord;
+	float scale = CalExposureScale(&pixelList[0], qtIP.resolutionW * qtIP.resolutionH);
 
-	for (vector<GeometryObject*>::iterator j = scene.begin(); j != scene.end(); j++)
 	{
-		(*j)->RayIntersection(ray, tmpRecord);
-		if (tmpRecord.depth - lightDis > -MYEPSILON) // the object is further than the light source
-			continue;
-		if (tmpRecord.depth > MYEPSILON && (record.depth > tmpRecord.depth || record.depth < MYEPSILON))
-		{
-			record = tmpRecord;
-			hitType = 1;
-		}
-		if (lightDis != MYINFINITE && hitType != 0)
-			return hitType;
-	}
-	if (lightDis == MYINFINITE)
-	{
-		for (vector<LightBase*>::iterator j = light.begin(); j != light.end(); j++)
+		TraceScope trace("tonemap");
+		int arrayIdx = 0;
+		for (int row = 0; row < qtIP.resolutionH; row++)
 		{
-			(*j)->RayIntersection(ray, tmpRecord);
-			if (tmpRecord.depth > MYEPSILON && (record.depth > tmpRecord.depth || record.depth < MYEPSILON))
+			for (int col = 0; col < qtIP.resolutionW; col++)
 			{
-				record = tmpRecord;
-				hitType = 2;
+				pixelList[arrayIdx] *= scale;
+				int R = min((int)pixelList[arrayIdx][0], 255);
+				int G = min((int)pixelList[arrayIdx][1], 255);
+				int B = min((int)pixelList[arrayIdx][2], 255);
+				for (int rowI = 0; rowI < qtIP.imageScaleRatio; rowI++)
+					for (int colI = 0; colI < qtIP.imageScaleRatio; colI++)
+						qImage->setPixel(col * qtIP.imageScaleRatio + colI, row * qtIP.imageScaleRatio + rowI, qRgb(R, G, B));
+
+				arrayIdx++;
 			}
 		}
 	}
 
-	return hitType;
+	// display the image
+	TraceScope trace("display");
+	ui.label_Image->setPixmap(QPixmap::fromImage(*qImage));
 }
 
-float diffuseStrength = 0.8f;
-float specularStrength = 1.0f - diffuseStrength;
-float levelDegenerateRatio = 0.5f;
-glm::vec3 Assignment3Qt::calColorOnHitPoint(RayHitObjectRecord &record, vector<GeometryObject*> &scene, vector<LightBase*> &light, int level)
+void Assignment3Qt::ShowCostMap(const QTInputParam &qtIP, vector<glm::vec3> &pixelList)
 {
-	// level starts from 1
-	if (level > 3)
-		return glm::vec3(0, 0, 0);
+	QImage image;
+	float maxCost = CostMap::ToImage(qtIP.resolutionW, qtIP.resolutionH, &pixelList[0], image, qtIP.imageScaleRatio);
+	ui.label_Image->setPixmap(QPixmap::fromImage(image));
 
-	glm::vec3 diffuse(0.0f);
-	glm::vec3 specular(0.0f);
-	
-	glm::vec3 reflectionColor = glm::vec3(0, 0, 0);
-	RayClass* reflectionRay = new RayClass(record.hitPoint, record.rDirection);
-	RayHitObjectRecord reflectionHitRecord;
-	int hitType = RayHitTest(reflectionRay, scene, light, reflectionHitRecord);
-	if (hitType == 1)
-	{
-		glm::vec3 recursiveHitPointColor = calColorOnHitPoint(reflectionHitRecord, scene, light, level + 1);
-		reflectionColor = levelDegenerateRatio * max(dot(record.hitNormal, record.rDirection), 0.0f) * recursiveHitPointColor;
-	}
-	else if (hitType == 2)
+	QString basePath = QString("cost_") + CostMetricName(qtIP.costMetric);
+	if (CostMap::Save(basePath, qtIP.resolutionW, qtIP.resolutionH, &pixelList[0]))
+		ui.label_Image->setToolTip(QString().sprintf("red: %g, saved to %s.png / .pfm", maxCost, basePath.toLocal8Bit().constData()));
+	else
+		QMessageBox::warning(this, "Render", "can't write " + basePath + ".png / .pfm");
+}
+
+void Assignment3Qt::ShowMemory(const MemoryReport &report)
+{
+	ui.label_Memory->setText(QString().sprintf("Memory: %.1fMB", report.TotalBytes() / 1048576.0));
+	ui.label_Memory->setToolTip(QString::fromStdString(report.ToString()));
+}
+
+void Assignment3Qt::on_interactive_toggled(bool checked)
+{
+	// a running frame releases the scene itself once it returns
+	if (!checked && !interactiveRendering)
+		StopInteractive();
+}
+
+bool Assignment3Qt::StartInteractive(const QTInputParam &qtIP, glm::vec3 cameraPos, glm::vec3 cameraLookat)
+{
+	// the scene is only loaded again when its path changes
+	if (!interactiveScene || interactiveScenePath != ui.sceneDataPath->text())
 	{
-		specular += specularStrength * reflectionHitRecord.pointColor;
+		StopInteractive();
+		interactiveScene = new SceneData();
+		if (!interactiveScene->Load(ui.sceneDataPath->text()))
+		{
+			safe_delete(interactiveScene);
+			return false;
+		}
+		interactiveScenePath = ui.sceneDataPath->text();
+		interactiveTracer = new RayTracer(interactiveScene);
+		rayCost = 0;
+
+		MemoryReport report;
+		interactiveScene->ReportMemory(report);
+		ShowMemory(report);
 	}
-	safe_delete(reflectionRay);
-
-	RayHitObjectRecord lightHitRecord;
-	// for each light source
-	std::vector<glm::vec3> lightColorList;
-	std::vector<float> lightDisList;
-	std::vector<glm::vec3> lightDirList;
-	for (vector<LightBase*>::iterator i = light.begin(); i != light.end(); i++)
+
+	interactiveTracer->SetIrradianceCache(qtIP.irradianceTolerance);
+	interactiveTracer->SetShadingWeights(qtIP.diffuseStrength, qtIP.specularStrength);
+	interactiveTracer->SetLightCut(qtIP.lightCutError);
+	interactiveIP = qtIP;
+	interactivePos = cameraPos;
+	interactiveLookat = cameraLookat;
+	shownDownscale = shownAntiAliasing = 0;
+
+	ui.label_Image->setFocusPolicy(Qt::StrongFocus);
+	return true;
+}
+
+void Assignment3Qt::StopInteractive()
+{
+	refineTimer->stop();
+	safe_delete(interactiveTracer);
+	safe_delete(interactiveScene);
+	interactiveScenePath = QString();
+	shownDownscale = shownAntiAliasing = 0;
+}
+
+void Assignment3Qt::MoveCamera(glm::vec3 cameraPos, glm::vec3 cameraLookat)
+{
+	interactivePos = cameraPos;
+	interactiveLookat = cameraLookat;
+	ui.CameraPos->setText(QString().sprintf("%g,%g,%g", cameraPos.x, cameraPos.y, cameraPos.z));
+	ui.CameraLookAt->setText(QString().sprintf("%g,%g,%g", cameraLookat.x, cameraLookat.y, cameraLookat.z));
+
+	cameraMoved = true;
+	refineTimer->stop();
+	// inside a running frame the flag is enough, it previews the new camera next
+	if (!interactiveRendering)
+		RenderInteractivePreview();
+}
+
+void Assignment3Qt::RenderInteractivePreview()
+{
+	interactiveRendering = true;
+	while (cameraMoved && ui.interactive->isChecked())
 	{
-		lightColorList.clear();
-		lightDisList.clear();
-		lightDirList.clear();
-		(*i)->GetLight(record.hitPoint, lightColorList, lightDisList, lightDirList);
+		cameraMoved = false;
 
-		for (unsigned int j = 0; j < lightDirList.size(); j++)
+		// the largest resolution whose rays fit the frame budget at the measured cost
+		int downscale = FIRST_DOWNSCALE;
+		if (rayCost > 0)
 		{
-			RayClass* lightRay = new RayClass(record.hitPoint, lightDirList[j]);
-			if (!RayHitTest(lightRay, scene, light, lightHitRecord, lightDisList[j]))
-			{
-				float diff = max(dot(record.hitNormal, lightDirList[j]), 0.0f);
-				diffuse += diffuseStrength * diff * lightColorList[j];
-			}
-
-			safe_delete(lightRay);
+			float rayNum = FRAME_BUDGET / rayCost;
+			downscale = (int)ceil(sqrt(interactiveIP.resolutionW * interactiveIP.resolutionH / rayNum));
+			downscale = glm::clamp(downscale, 1, glm::max(interactiveIP.resolutionW, interactiveIP.resolutionH));
 		}
+		RenderInteractive(downscale, 1, false);
+
+		// mouse events arriving meanwhile set cameraMoved again
+		QCoreApplication::processEvents();
 	}
+	interactiveRendering = false;
 
-	if (!hasHDRLighting)
-		diffuse *= 15.0f;
+	if (!ui.interactive->isChecked())
+		StopInteractive();
 	else
-		diffuse *= 1.0f;
+		refineTimer->start(REFINE_DELAY_MS);
+}
 
-	glm::vec3 returnColor = glm::vec3(0);
-	returnColor += diffuse / (float)lightDirList.size() + specular;
-	//if (1 == level)
-	//	returnColor = glm::vec3(0, 0, 0);
+void Assignment3Qt::RefineInteractive()
+{
+	if (interactiveRendering || !interactiveTracer || shownDownscale == 0)
+		return;
 
-	returnColor += reflectionColor;
+	int downscale = shownDownscale, antiAliasing = shownAntiAliasing;
+	if (downscale > 1)
+		downscale = downscale / 2;
+	else if (antiAliasing < interactiveIP.antiAliasingLevel)
+		antiAliasing = interactiveIP.antiAliasingLevel;
+	else
+		return; // fully refined
 
-	returnColor *= record.pointColor;
+	interactiveRendering = true;
+	bool finished = RenderInteractive(downscale, antiAliasing, true);
+	interactiveRendering = false;
 
-	return returnColor;
+	if (!ui.interactive->isChecked())
+		StopInteractive();
+	else if (!finished || cameraMoved)
+		RenderInteractivePreview();
+	else
+		refineTimer->start(0);
 }
 
-void Assignment3Qt::processSceneData(vector<GeometryObject*> &scene, QString line)
+bool Assignment3Qt::RenderInteractive(int downscale, int antiAliasingLevel, bool abortOnMove)
 {
-	QStringList level1 = line.split(';', QString::SkipEmptyParts);
-
-	if (level1.length() != 0)
+	QElapsedTimer timer;
+	timer.start();
+
+	QTInputParam frameIP = interactiveIP;
+	frameIP.resolutionW = glm::max(interactiveIP.resolutionW / downscale, 1);
+	frameIP.resolutionH = glm::max(interactiveIP.resolutionH / downscale, 1);
+	frameIP.antiAliasingLevel = antiAliasingLevel;
+	frameIP.imageScaleRatio = 1;
+	RayTracingCameraClass* camera = CreateRenderCamera(interactivePos, interactiveLookat, frameIP);
+
+	int w = frameIP.resolutionW, h = frameIP.resolutionH;
+	int rayNum = w * h * antiAliasingLevel * antiAliasingLevel;
+	vector<glm::vec3> pixelList(w * h);
+	// previews stay raw, they have to be back within the frame budget
+	bool denoise = frameIP.denoise && abortOnMove;
+	vector<PixelFeature> featureList(denoise ? w * h : 0);
+
+	// a refinement is rendered in chunks of about one frame budget, so a camera move is noticed quickly
+	int chunkRows = h;
+	if (abortOnMove && rayCost > 0)
+		chunkRows = glm::clamp((int)(FRAME_BUDGET / (rayCost * w * antiAliasingLevel * antiAliasingLevel)), 1, h);
+
+	bool finished = true;
+	for (int row = 0; row < h; row += chunkRows)
 	{
-		QStringList level2;
-		if ("Sphere" == level1[0] || "sphere" == level1[0])
+		int rows = glm::min(chunkRows, h - row);
+		ParallelFor(rows, [&](int i)
 		{
-			level2 = level1[1].split(',');
-			glm::vec3 center = glm::vec3(level2[0].toFloat(), level2[1].toFloat(), level2[2].toFloat());
-
-			float radius = level1[2].toFloat();
-
-			level2 = level1[3].split(',');
-			glm::vec3 color = glm::vec3(level2[0].toFloat(), level2[1].toFloat(), level2[2].toFloat());
+			interactiveTracer->RenderPixels(camera, row + i, 0, w, &pixelList[(row + i) * w], denoise ? &featureList[(row + i) * w] : NULL);
+		});
 
-			scene.push_back((GeometryObject*)new Sphere(center, radius, color));
-		}
-		else if ("Plane" == level1[0] || "plane" == level1[0])
+		if (abortOnMove)
 		{
-			level2 = level1[1].split(',');
-			glm::vec4 ABCD = glm::vec4(level2[0].toFloat(), level2[1].toFloat(), level2[2].toFloat(), level2[3].toFloat());
+			QCoreApplication::processEvents();
+			if (cameraMoved || !ui.interactive->isChecked())
+			{
+				finished = false;
+				break;
+			}
+		}
+	}
+	safe_delete(camera);
+
+	if (finished)
+	{
+		float cost = (float)(timer.nsecsElapsed() * 1e-9) / rayNum;
+		rayCost = rayCost > 0 ? 0.5f * (rayCost + cost) : cost;
+
+		if (denoise)
+			Denoiser::Denoise(w, h, &pixelList[0], &featureList[0]);
+
+		QImage *qImage = new QImage(w, h, QImage::Format_RGB888);
+		ShowImage(qImage, frameIP, pixelList);
+		int imageW = interactiveIP.resolutionW * interactiveIP.imageScaleRatio;
+		int imageH = interactiveIP.resolutionH * interactiveIP.imageScaleRatio;
+		ui.label_Image->setPixmap(QPixmap::fromImage(qImage->scaled(imageW, imageH, Qt::IgnoreAspectRatio, Qt::FastTransformation)));
+		safe_delete(qImage);
+
+		shownDownscale = downscale;
+		shownAntiAliasing = antiAliasingLevel;
+		ui.label_TValue->setText(QString().sprintf("Frame: %.0fms (1/%d)", timer.nsecsElapsed() * 1e-6, downscale));
+	}
 
-			level2 = level1[2].split(',');
-			glm::vec3 color = glm::vec3(level2[0].toFloat(), level2[1].toFloat(), level2[2].toFloat());
+	return finished;
+}
 
-			scene.push_back((GeometryObject*)new Plane(ABCD[0], ABCD[1], ABCD[2], ABCD[3], color));
+bool Assignment3Qt::eventFilter(QObject *obj, QEvent *event)
+{
+	if (obj != ui.label_Image || !interactiveTracer || !ui.interactive->isChecked())
+		return QMainWindow::eventFilter(obj, event);
+
+	glm::vec3 offset = interactivePos - interactiveLookat;
+	float distance = length(offset);
+	if (distance < MYEPSILON)
+		return QMainWindow::eventFilter(obj, event);
+	glm::vec3 front = -offset / distance;
+	glm::vec3 right = normalize(cross(front, glm::vec3(0, 1, 0)));
+	glm::vec3 up = cross(right, front);
+
+	// orbit around the look at point, pan both points in the view plane, dolly along the view direction
+	float yaw = 0, pitch = 0, dolly = 1;
+	glm::vec3 pan(0.0f);
+	switch (event->type())
+	{
+	case QEvent::MouseButtonPress:
+		lastMousePos = static_cast<QMouseEvent*>(event)->pos();
+		ui.label_Image->setFocus();
+		return true;
+	case QEvent::MouseMove:
+	{
+		QMouseEvent *mouseEvent = static_cast<QMouseEvent*>(event);
+		QPoint delta = mouseEvent->pos() - lastMousePos;
+		lastMousePos = mouseEvent->pos();
+		if (mouseEvent->buttons() & Qt::LeftButton)
+		{
+			yaw = -delta.x() * ORBIT_SPEED;
+			pitch = delta.y() * ORBIT_SPEED;
 		}
-		else if ("Model" == level1[0] || "model" == level1[0])
+		else if (mouseEvent->buttons() & Qt::RightButton)
+			pan = (right * (float)-delta.x() + up * (float)delta.y()) * (distance * PAN_SPEED);
+		else if (mouseEvent->buttons() & Qt::MidButton)
+			dolly = pow(DOLLY_STEP, -delta.y() * 0.1f);
+		else
+			return true;
+		break;
+	}
+	case QEvent::Wheel:
+		dolly = pow(DOLLY_STEP, static_cast<QWheelEvent*>(event)->angleDelta().y() / 120.0f);
+		break;
+	case QEvent::KeyPress:
+		switch (static_cast<QKeyEvent*>(event)->key())
 		{
-			level2 = level1[2].split(',');
-			glm::vec3 color = glm::vec3(level2[0].toFloat(), level2[1].toFloat(), level2[2].toFloat());
-
-			scene.push_back((GeometryObject*)new Model(level1[1].toStdString(), color));
+		case Qt::Key_W:		dolly = DOLLY_STEP; break;
+		case Qt::Key_S:		dolly = 1.0f / DOLLY_STEP; break;
+		case Qt::Key_A:		pan = -right * (distance * PAN_SPEED * 20); break;
+		case Qt::Key_D:		pan = right * (distance * PAN_SPEED * 20); break;
+		case Qt::Key_Q:		pan = -up * (distance * PAN_SPEED * 20); break;
+		case Qt::Key_E:		pan = up * (distance * PAN_SPEED * 20); break;
+		case Qt::Key_Left:	yaw = 20 * ORBIT_SPEED; break;
+		case Qt::Key_Right:	yaw = -20 * ORBIT_SPEED; break;
+		case Qt::Key_Up:	pitch = 20 * ORBIT_SPEED; break;
+		case Qt::Key_Down:	pitch = -20 * ORBIT_SPEED; break;
+		default:
+			return QMainWindow::eventFilter(obj, event);
 		}
+		break;
+	default:
+		return QMainWindow::eventFilter(obj, event);
 	}
-}
\ No newline at end of file
+
+	// spherical coordinates of the camera around the look at point, the pitch stays off the poles
+	float theta = atan2(offset.x, offset.z) + yaw;
+	float phi = glm::clamp(asin(glm::clamp(offset.y / distance, -1.0f, 1.0f)) + pitch, -1.5f, 1.5f);
+	distance = glm::max(distance * dolly, 0.1f);
+	offset = distance * glm::vec3(cos(phi) * sin(theta), sin(phi), cos(phi) * cos(theta));
+
+	glm::vec3 lookat = interactiveLookat + pan;
+	MoveCamera(lookat + offset, lookat);
+	return true;
+}
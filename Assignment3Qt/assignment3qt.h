@@ -2,51 +2,102 @@
 
 #include "ui_Assignment3Qt.h"
 #include <QtWidgets/QMainWindow>
+#include <QTimer>
 
 #include <vector>
 
 #include "rayTracingCamera.h"
 #include "geometryObject.h"
 #include "lightSource.h"
+#include "sceneData.h"
+#include "rayTracer.h"
+#include "checkpoint.h"
+#include "incrementalRender.h"
+#include "relight.h"
 #include "Utils.h"
 
 using namespace std;
 
-// struct for qt UI input params
-struct QTInputParam
-{
-	int resolutionW;
-	int resolutionH;
-	int antiAliasingLevel;
-	int imageScaleRatio;
-};
-
 class Assignment3Qt : public QMainWindow
 {
 	Q_OBJECT
 		
 public:
 	Assignment3Qt(QWidget *parent = 0);
-	~Assignment3Qt(){};
+	~Assignment3Qt();
 
-	void RenderImage(const QTInputParam&, vector<GeometryObject*> &scene, RayTracingCameraClass* camera, vector<LightBase*> &light);
+	// report, when given, gets the framebuffers and the tracer's memory and is shown once the image is done.
+	// checkpoint, when given, supplies the rows it already has and is removed once the image is done
+	void RenderImage(const QTInputParam&, RayTracer* rayTracer, RayTracingCameraClass* camera, MemoryReport *report = NULL, RenderCheckpoint *checkpoint = NULL);
 
-	int RayHitTest(RayClass* ray, vector<GeometryObject*> &scene, vector<LightBase*> &light, RayHitObjectRecord &record, float lightDis = MYINFINITE);
+	// progressive render that is on screen budgetSeconds after the call, see DeadlineRenderer. camera has to
+	// shoot one ray per pixel, the mean samples per pixel reached is returned
+	float RenderImageByDeadline(const QTInputParam&, RayTracer* rayTracer, RayTracingCameraClass* camera, float budgetSeconds, MemoryReport *report = NULL, RenderCheckpoint *checkpoint = NULL);
 
-	glm::vec3 calColorOnHitPoint(RayHitObjectRecord &record, vector<GeometryObject*> &scene, vector<LightBase*> &light, int level);
+	// RenderImage through incrementalRenderer, after an edit of the scene file only the tiles it could have changed
+	// are traced again. the number of tiles traced is returned
+	int RenderImageIncremental(const QTInputParam&, SceneData *sceneData, RayTracer* rayTracer, glm::vec3 cameraPos, glm::vec3 cameraLookat, MemoryReport *report = NULL);
+
+	// RenderImage through relightRenderer, while the objects and the view stay the same only the lighting is
+	// computed again. true when the kept camera ray hits were reused
+	bool RenderImageRelight(const QTInputParam&, SceneData *sceneData, RayTracer* rayTracer, glm::vec3 cameraPos, glm::vec3 cameraLookat, MemoryReport *report = NULL);
+
+	// same as RenderImage, but the tiles are traced by processNum worker processes
+	void RenderImageByWorkers(const QTInputParam&, QString sceneDataPath, glm::vec3 cameraPos, glm::vec3 cameraLookat, int processNum);
 
 private:
 	Ui::Assignment3QtClass ui;
 
-	// scene is loaded from text, so we need to deal with the line data
-	void processSceneData(vector<GeometryObject*> &scene, QString line);
-	
-	void RenderPixels(RayTracingCameraClass* camera, int row, int start, int end, vector<glm::vec3> &pixelList,
-		vector<GeometryObject*> &scene, vector<LightBase*> &light);
+	// show the rendered rectangle with a running max while the render is in progress
+	void PreviewPixels(QImage *qImage, const QTInputParam &qtIP, vector<glm::vec3> &pixelList, int x, int y, int w, int h, float &localMax);
+
+	// scale the finished image by its NTHIDX radiance and display it
+	void ShowImage(QImage *qImage, const QTInputParam &qtIP, vector<glm::vec3> &pixelList);
+
+	// false color of a cost map render, also saved as cost_<metric>.png / .pfm in the working directory
+	void ShowCostMap(const QTInputParam &qtIP, vector<glm::vec3> &pixelList);
+
+	// total under the time label, the whole table as its tool tip
+	void ShowMemory(const MemoryReport &report);
+
+	// interactive viewport: the scene and the tracer stay loaded, every camera move renders a preview at the
+	// resolution that fits the frame budget, once the camera rests the view is refined up to full resolution
+	// and anti aliasing
+	bool StartInteractive(const QTInputParam &qtIP, glm::vec3 cameraPos, glm::vec3 cameraLookat);
+	void StopInteractive();
+	void MoveCamera(glm::vec3 cameraPos, glm::vec3 cameraLookat);
+	// previews until the camera stops moving, then starts the refinement
+	void RenderInteractivePreview();
+	// one refinement step, halves the downscale or adds the anti aliasing at full resolution
+	void RefineInteractive();
+	// render and show the view at 1 / downscale resolution, false when it was given up for a camera move
+	bool RenderInteractive(int downscale, int antiAliasingLevel, bool abortOnMove);
+
+	// the image of the last incremental render and what its tiles depend on
+	IncrementalRenderer incrementalRenderer;
+	// the camera ray hits of the last relight render
+	RelightRenderer relightRenderer;
+
+	SceneData *interactiveScene;
+	RayTracer *interactiveTracer;
+	QString interactiveScenePath;
+	QTInputParam interactiveIP;
+	glm::vec3 interactivePos, interactiveLookat;
+	QTimer *refineTimer;
+	int shownDownscale, shownAntiAliasing; // of the frame on screen, 0 before the first one
+	float rayCost; // measured seconds per camera ray
+	bool interactiveRendering, cameraMoved;
+	QPoint lastMousePos;
+
+protected:
+	// mouse and keys on the image move the camera of the interactive viewport
+	virtual bool eventFilter(QObject *obj, QEvent *event) override;
 
 private slots:
 // choose the scene data path
 void on_pushButton_Browse_clicked();
 // begin to render
 void on_pushButton_Render_clicked();
+// leaving the interactive mode releases its scene
+void on_interactive_toggled(bool checked);
 };
@@ -0,0 +1,436 @@
+#include "batchRender.h"
+
+#include <QFile>
+#include <QTextStream>
+#include <QStringList>
+#include <QImage>
+#include <QElapsedTimer>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+
+#include "sceneData.h"
+#include "checkpoint.h"
+#include "tiledOutput.h"
+#include "Utils.h"
+
+using namespace std;
+
+namespace
+{
+	// the output pattern goes to sprintf with the frame index, so it may hold exactly one %d (flags and width
+	// allowed) and no other conversion than %%
+	bool IsFramePattern(const char *pattern)
+	{
+		int conversionNum = 0;
+		for (const char *p = pattern; *p; p++)
+		{
+			if (*p != '%')
+				continue;
+			if (*++p == '%')
+				continue;
+			while (*p && strchr("-+ #0", *p))
+				p++;
+			while (*p >= '0' && *p <= '9')
+				p++;
+			if (*p != 'd')
+				return false;
+			conversionNum++;
+		}
+		return conversionNum == 1;
+	}
+}
+
+#pragma region CameraPath
+bool CameraPath::Load(QString cameraPathPath)
+{
+	QFile pathFile(cameraPathPath);
+	if (!pathFile.open(QIODevice::ReadOnly | QIODevice::Text))
+		return false;
+
+	keys.clear();
+	QTextStream in(&pathFile);
+	while (!in.atEnd())
+	{
+		QString line = in.readLine();
+		line = line.remove(' ');
+		QStringList level1 = line.split(';', QString::SkipEmptyParts);
+		if (level1.length() != 4 || !("Key" == level1[0] || "key" == level1[0]))
+			continue;
+
+		QStringList posList = level1[2].split(',');
+		QStringList lookatList = level1[3].split(',');
+		if (posList.length() != 3 || lookatList.length() != 3)
+			continue;
+
+		Key key;
+		key.frame = level1[1].toInt();
+		key.pos = glm::vec3(posList[0].toFloat(), posList[1].toFloat(), posList[2].toFloat());
+		key.lookat = glm::vec3(lookatList[0].toFloat(), lookatList[1].toFloat(), lookatList[2].toFloat());
+		keys.push_back(key);
+	}
+	pathFile.close();
+
+	stable_sort(keys.begin(), keys.end(), [](const Key &a, const Key &b) { return a.frame < b.frame; });
+	return !keys.empty();
+}
+
+int CameraPath::FrameNum() const
+{
+	return keys.empty() ? 0 : keys.back().frame + 1;
+}
+
+void CameraPath::Evaluate(int frame, glm::vec3 &cameraPos, glm::vec3 &cameraLookat) const
+{
+	int keyNum = keys.size();
+	if (frame <= keys[0].frame || keyNum == 1)
+	{
+		cameraPos = keys[0].pos;
+		cameraLookat = keys[0].lookat;
+		return;
+	}
+	if (frame >= keys[keyNum - 1].frame)
+	{
+		cameraPos = keys[keyNum - 1].pos;
+		cameraLookat = keys[keyNum - 1].lookat;
+		return;
+	}
+
+	// segment [k1, k2] containing the frame, the end keys are repeated for the outer control points
+	int k1 = 0;
+	while (keys[k1 + 1].frame <= frame)
+		k1++;
+	int k2 = k1 + 1;
+	int k0 = glm::max(k1 - 1, 0), k3 = glm::min(k2 + 1, keyNum - 1);
+	float t = float(frame - keys[k1].frame) / float(keys[k2].frame - keys[k1].frame);
+
+	float t2 = t * t, t3 = t2 * t;
+	float w0 = -0.5f * t3 + t2 - 0.5f * t;
+	float w1 = 1.5f * t3 - 2.5f * t2 + 1.0f;
+	float w2 = -1.5f * t3 + 2.0f * t2 + 0.5f * t;
+	float w3 = 0.5f * t3 - 0.5f * t2;
+	cameraPos = keys[k0].pos * w0 + keys[k1].pos * w1 + keys[k2].pos * w2 + keys[k3].pos * w3;
+	cameraLookat = keys[k0].lookat * w0 + keys[k1].lookat * w1 + keys[k2].lookat * w2 + keys[k3].lookat * w3;
+}
+#pragma endregion
+
+#pragma region AnimationRenderer
+AnimationRenderer::AnimationRenderer(RayTracer *rayTracer, const QTInputParam &qtIP, int framesInFlight, int threadNum)
+	: rayTracer(rayTracer)
+	, qtIP(qtIP)
+	, framesInFlight(glm::max(framesInFlight, 1))
+	, threadNum(glm::max(threadNum, 1))
+{
+}
+
+bool AnimationRenderer::Render(const CameraPath &path, QString outputPattern)
+{
+	const int W = qtIP.resolutionW, H = qtIP.resolutionH;
+	const int frameNum = path.FrameNum();
+
+	// every frame in flight owns a slot, frame f reuses the slot of frame f - framesInFlight once that one is written
+	struct FrameSlot
+	{
+		int frame;
+		RayTracingCameraClass *camera;
+		vector<glm::vec3> pixelList;
+		vector<PixelFeature> featureList;
+	};
+	vector<FrameSlot> frameSlots(framesInFlight);
+	for (int i = 0; i < framesInFlight; i++)
+	{
+		frameSlots[i].frame = -1;
+		frameSlots[i].camera = NULL;
+		frameSlots[i].pixelList.resize(W * H);
+		if (qtIP.denoise)
+			frameSlots[i].featureList.resize(W * H);
+	}
+
+	vector<int> rowsLeft(frameNum, H);
+	vector<bool> frameWritten(frameNum, false);
+	mutex frameMutex;
+	condition_variable frameWrittenCV;
+	bool success = true;
+
+	QElapsedTimer timer;
+	timer.start();
+
+	// rows are handed out in order over the whole sequence, so all rows of frame f - framesInFlight
+	// are already being traced by the time a row of frame f waits for its slot
+	ParallelFor(frameNum * H, [&](int taskIdx)
+	{
+		int frame = taskIdx / H, row = taskIdx % H;
+		FrameSlot &slot = frameSlots[frame % framesInFlight];
+
+		{
+			unique_lock<mutex> lock(frameMutex);
+			frameWrittenCV.wait(lock, [&]() { return frame < framesInFlight || frameWritten[frame - framesInFlight]; });
+			if (slot.frame != frame)
+			{
+				glm::vec3 cameraPos, cameraLookat;
+				path.Evaluate(frame, cameraPos, cameraLookat);
+				safe_delete(slot.camera);
+				slot.camera = CreateRenderCamera(cameraPos, cameraLookat, qtIP);
+				slot.frame = frame;
+			}
+		}
+
+		rayTracer->RenderPixels(slot.camera, row, 0, W, &slot.pixelList[row * W], qtIP.denoise ? &slot.featureList[row * W] : NULL);
+
+		{
+			lock_guard<mutex> lock(frameMutex);
+			if (--rowsLeft[frame] != 0)
+				return;
+		}
+
+		// the thread finishing the last row writes the frame, the other threads keep tracing
+		if (qtIP.denoise)
+			Denoiser::Denoise(W, H, &slot.pixelList[0], &slot.featureList[0]);
+		float scale = CalExposureScale(&slot.pixelList[0], W * H);
+		QImage qImage(W, H, QImage::Format_RGB888);
+		int arrayIdx = 0;
+		for (int y = 0; y < H; y++)
+		{
+			for (int x = 0; x < W; x++)
+			{
+				glm::vec3 color = slot.pixelList[arrayIdx++] * scale;
+				qImage.setPixel(x, y, qRgb(min((int)color[0], 255), min((int)color[1], 255), min((int)color[2], 255)));
+			}
+		}
+		QString fileName = QString().sprintf(outputPattern.toLatin1().data(), frame);
+		bool saved = qImage.save(fileName);
+
+		lock_guard<mutex> lock(frameMutex);
+		if (!saved)
+		{
+			success = false;
+			printf("failed to write %s\n", fileName.toLocal8Bit().data());
+		}
+		else
+			printf("frame %d / %d: %s\n", frame + 1, frameNum, fileName.toLocal8Bit().data());
+		fflush(stdout);
+		frameWritten[frame] = true;
+		frameWrittenCV.notify_all();
+	}, threadNum);
+
+	for (int i = 0; i < framesInFlight; i++)
+		safe_delete(frameSlots[i].camera);
+
+	float timeEllapse = timer.elapsed() / 1000.0f;
+	printf("%d frames in %.2fs, %.3fs per frame\n", frameNum, timeEllapse, frameNum > 0 ? timeEllapse / frameNum : 0.0f);
+	return success;
+}
+#pragma endregion
+
+int RunAnimation(int argc, char *argv[])
+{
+	if (argc < 8 || !IsFramePattern(argv[4]))
+	{
+		if (argc >= 8)
+			printf("outputPattern needs exactly one %%d for the frame index, a literal %% is written %%%%\n");
+		printf("usage: %s --animate <sceneDataPath> <cameraPathPath> <outputPattern> <resolutionW> <resolutionH> <antiAliasing> [framesInFlight] [irradianceTolerance] [lightCutError] [denoise] [diffuseStrength] [specularStrength]\n", argv[0]);
+		return 1;
+	}
+
+	QTInputParam qtIP;
+	qtIP.resolutionW = atoi(argv[5]);
+	qtIP.resolutionH = atoi(argv[6]);
+	qtIP.antiAliasingLevel = atoi(argv[7]);
+	qtIP.imageScaleRatio = 1;
+	int framesInFlight = argc > 8 ? atoi(argv[8]) : 2;
+	qtIP.irradianceTolerance = argc > 9 ? (float)atof(argv[9]) : 0;
+	qtIP.lightCutError = argc > 10 ? (float)atof(argv[10]) : 0;
+	qtIP.denoise = argc > 11 && atoi(argv[11]) != 0;
+	qtIP.diffuseStrength = argc > 12 ? (float)atof(argv[12]) : DEFAULT_DIFFUSE_STRENGTH;
+	qtIP.specularStrength = argc > 13 ? (float)atof(argv[13]) : DEFAULT_SPECULAR_STRENGTH;
+	qtIP.costMetric = COST_NONE;
+
+	CameraPath path;
+	if (!path.Load(QString::fromLocal8Bit(argv[3])))
+	{
+		printf("can't read camera path %s\n", argv[3]);
+		return 1;
+	}
+
+	// the scene, its acceleration structures and the light samples are built once for the whole sequence
+	QElapsedTimer loadTimer;
+	loadTimer.start();
+	SceneData *sceneData = new SceneData();
+	if (!sceneData->Load(QString::fromLocal8Bit(argv[2])))
+	{
+		printf("can't read scene %s\n", argv[2]);
+		safe_delete(sceneData);
+		return 1;
+	}
+	printf("scene loaded in %.2fs\n", loadTimer.elapsed() / 1000.0f);
+	MemoryReport report;
+	sceneData->ReportMemory(report);
+	printf("%s", report.ToString().c_str());
+
+	// the irradiance cache is view independent, records of one frame are reused by all later ones
+	RayTracer *rayTracer = new RayTracer(sceneData);
+	rayTracer->SetIrradianceCache(qtIP.irradianceTolerance);
+	rayTracer->SetShadingWeights(qtIP.diffuseStrength, qtIP.specularStrength);
+	rayTracer->SetLightCut(qtIP.lightCutError);
+	AnimationRenderer renderer(rayTracer, qtIP, framesInFlight);
+	bool success = renderer.Render(path, QString::fromLocal8Bit(argv[4]));
+
+	// the cache grew during the sequence
+	MemoryReport cacheReport;
+	rayTracer->ReportMemory(cacheReport);
+	if (cacheReport.TotalBytes() > 0)
+		printf("%s", cacheReport.ToString().c_str());
+
+	safe_delete(rayTracer);
+	safe_delete(sceneData);
+	return success ? 0 : 1;
+}
+
+int RunRender(int argc, char *argv[])
+{
+	if (argc < 9)
+	{
+		printf("usage: %s --render <sceneDataPath> <outputPath> <cameraPos> <cameraLookat> <resolutionW> <resolutionH> <antiAliasing> [checkpointPath] [checkpointSeconds] [irradianceTolerance] [lightCutError] [diffuseStrength] [specularStrength]\n", argv[0]);
+		return 1;
+	}
+
+	QTInputParam qtIP;
+	QString sceneDataPath = QString::fromLocal8Bit(argv[2]);
+	glm::vec3 cameraPos = ParseVec3(argv[4]);
+	glm::vec3 cameraLookat = ParseVec3(argv[5]);
+	qtIP.resolutionW = atoi(argv[6]);
+	qtIP.resolutionH = atoi(argv[7]);
+	qtIP.antiAliasingLevel = atoi(argv[8]);
+	qtIP.imageScaleRatio = 1;
+	QString checkpointPath = argc > 9 ? QString::fromLocal8Bit(argv[9]) : QString::fromLocal8Bit(argv[3]) + ".checkpoint";
+	float checkpointSeconds = argc > 10 ? (float)atof(argv[10]) : 60;
+	qtIP.irradianceTolerance = argc > 11 ? (float)atof(argv[11]) : 0;
+	qtIP.lightCutError = argc > 12 ? (float)atof(argv[12]) : 0;
+	qtIP.diffuseStrength = argc > 13 ? (float)atof(argv[13]) : DEFAULT_DIFFUSE_STRENGTH;
+	qtIP.specularStrength = argc > 14 ? (float)atof(argv[14]) : DEFAULT_SPECULAR_STRENGTH;
+	qtIP.denoise = false;
+	qtIP.costMetric = COST_NONE;
+
+	SceneData *sceneData = new SceneData();
+	if (!sceneData->Load(sceneDataPath))
+	{
+		printf("can't read scene %s\n", argv[2]);
+		safe_delete(sceneData);
+		return 1;
+	}
+	RayTracingCameraClass *camera = CreateRenderCamera(cameraPos, cameraLookat, qtIP);
+	RayTracer *rayTracer = new RayTracer(sceneData);
+	rayTracer->SetIrradianceCache(qtIP.irradianceTolerance);
+	rayTracer->SetShadingWeights(qtIP.diffuseStrength, qtIP.specularStrength);
+	rayTracer->SetLightCut(qtIP.lightCutError);
+
+	const int W = camera->getW(), H = camera->getH();
+	unsigned long long key = RenderCheckpoint::SettingsKey(sceneDataPath, cameraPos, cameraLookat, qtIP, rayTracer->SampleSeed(), false);
+	RenderCheckpoint checkpoint(checkpointPath, key, W, H, checkpointSeconds);
+	vector<int> rows;
+	if (checkpoint.Resume())
+		printf("resumed from %s\n", checkpointPath.toLocal8Bit().data());
+	for (int row = 0; row < H; row++)
+		if (!checkpoint.RowDone(row))
+			rows.push_back(row);
+	printf("%d / %d rows to render\n", (int)rows.size(), H);
+	fflush(stdout);
+
+	// a row is traced into its own buffer and copied under the lock, the checkpoint is saved by whichever
+	// thread finishes a row after it is due
+	mutex checkpointMutex;
+	QElapsedTimer timer;
+	timer.start();
+	ParallelFor(rows.size(), [&](int taskIdx)
+	{
+		vector<glm::vec3> rowPixels(W);
+		rayTracer->RenderPixels(camera, rows[taskIdx], 0, W, &rowPixels[0]);
+
+		lock_guard<mutex> lock(checkpointMutex);
+		checkpoint.SetRow(rows[taskIdx], &rowPixels[0], camera->getRayNumEachPixel());
+		if (checkpoint.Due() && !checkpoint.Save())
+			printf("can't write checkpoint %s\n", checkpointPath.toLocal8Bit().data());
+	});
+	printf("rendered in %.2fs\n", timer.elapsed() / 1000.0f);
+
+	vector<glm::vec3> pixelList(W * H);
+	for (int row = 0; row < H; row++)
+		checkpoint.GetRow(row, &pixelList[row * W]);
+	float scale = CalExposureScale(&pixelList[0], W * H);
+	QImage qImage(W, H, QImage::Format_RGB888);
+	int arrayIdx = 0;
+	for (int y = 0; y < H; y++)
+	{
+		for (int x = 0; x < W; x++)
+		{
+			glm::vec3 color = pixelList[arrayIdx++] * scale;
+			qImage.setPixel(x, y, qRgb(min((int)color[0], 255), min((int)color[1], 255), min((int)color[2], 255)));
+		}
+	}
+
+	bool saved = qImage.save(QString::fromLocal8Bit(argv[3]));
+	if (saved)
+		checkpoint.Remove();
+	else
+		printf("failed to write %s\n", argv[3]);
+
+	safe_delete(rayTracer);
+	safe_delete(camera);
+	safe_delete(sceneData);
+	return saved ? 0 : 1;
+}
+
+int RunPoster(int argc, char *argv[])
+{
+	if (argc < 9)
+	{
+		printf("usage: %s --poster <sceneDataPath> <outputPath.tif> <cameraPos> <cameraLookat> <resolutionW> <resolutionH> <antiAliasing> [tileSize] [irradianceTolerance] [lightCutError] [diffuseStrength] [specularStrength]\n", argv[0]);
+		return 1;
+	}
+
+	QTInputParam qtIP;
+	glm::vec3 cameraPos = ParseVec3(argv[4]);
+	glm::vec3 cameraLookat = ParseVec3(argv[5]);
+	qtIP.resolutionW = atoi(argv[6]);
+	qtIP.resolutionH = atoi(argv[7]);
+	qtIP.antiAliasingLevel = atoi(argv[8]);
+	qtIP.imageScaleRatio = 1;
+	int tileSize = argc > 9 && atoi(argv[9]) > 0 ? atoi(argv[9]) : 256;
+	qtIP.irradianceTolerance = argc > 10 ? (float)atof(argv[10]) : 0;
+	qtIP.lightCutError = argc > 11 ? (float)atof(argv[11]) : 0;
+	qtIP.diffuseStrength = argc > 12 ? (float)atof(argv[12]) : DEFAULT_DIFFUSE_STRENGTH;
+	qtIP.specularStrength = argc > 13 ? (float)atof(argv[13]) : DEFAULT_SPECULAR_STRENGTH;
+	qtIP.denoise = false;
+	qtIP.costMetric = COST_NONE;
+
+	SceneData *sceneData = new SceneData();
+	if (!sceneData->Load(QString::fromLocal8Bit(argv[2])))
+	{
+		printf("can't read scene %s\n", argv[2]);
+		safe_delete(sceneData);
+		return 1;
+	}
+	RayTracer *rayTracer = new RayTracer(sceneData);
+	rayTracer->SetIrradianceCache(qtIP.irradianceTolerance);
+	rayTracer->SetShadingWeights(qtIP.diffuseStrength, qtIP.specularStrength);
+	rayTracer->SetLightCut(qtIP.lightCutError);
+
+	TiledRenderer renderer(rayTracer, qtIP, tileSize);
+	bool success = renderer.Render(cameraPos, cameraLookat, QString::fromLocal8Bit(argv[3]));
+	if (!success)
+		printf("failed to write %s\n", argv[3]);
+
+	MemoryReport report;
+	sceneData->ReportMemory(report);
+	renderer.ReportMemory(report);
+	rayTracer->ReportMemory(report);
+	printf("%s", report.ToString().c_str());
+
+	safe_delete(rayTracer);
+	safe_delete(sceneData);
+	return success ? 0 : 1;
+}
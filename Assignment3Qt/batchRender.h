@@ -0,0 +1,69 @@
+// headless renders: camera path animation, where the scene is loaded once and every frame of the path is traced
+// from it, single images that can be killed and restarted, and posters streamed to disk tile by tile
+#pragma once
+
+#include <QString>
+
+#include <vector>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "rayTracer.h"
+
+// keyframed camera, loaded from text lines in the same style as the scene file
+//   Key; frame; camera pos; camera lookat
+// poses between the keys follow a catmull-rom spline through them
+class CameraPath
+{
+public:
+	CameraPath(){};
+	~CameraPath(){};
+
+	// false if the file can't be opened or has no key
+	bool Load(QString cameraPathPath);
+
+	// number of frames, from frame 0 to the last key
+	int FrameNum() const;
+
+	void Evaluate(int frame, glm::vec3 &cameraPos, glm::vec3 &cameraLookat) const;
+
+private:
+	struct Key
+	{
+		int frame;
+		glm::vec3 pos, lookat;
+	};
+
+	std::vector<Key> keys;
+};
+
+// renders every frame of a path with one RayTracer, the rows of up to framesInFlight frames are traced
+// at the same time so no thread idles while a frame is finishing and being written
+class AnimationRenderer
+{
+public:
+	AnimationRenderer(RayTracer *rayTracer, const QTInputParam &qtIP, int framesInFlight = 2, int threadNum = MYTHREADNUM);
+	~AnimationRenderer(){};
+
+	// outputPattern is a printf pattern of the frame index, e.g. "frame_%04d.png", false if any frame failed to save
+	bool Render(const CameraPath &path, QString outputPattern);
+
+private:
+	RayTracer *rayTracer;
+	QTInputParam qtIP;
+	int framesInFlight, threadNum;
+};
+
+// outputPattern has to hold exactly one %d and no other conversion than %%, it is checked before the scene loads
+//   Assignment3Qt --animate <sceneDataPath> <cameraPathPath> <outputPattern> <resolutionW> <resolutionH> <antiAliasing> [framesInFlight] [irradianceTolerance] [lightCutError] [denoise]
+int RunAnimation(int argc, char *argv[]);
+
+// one image with a fixed sample count, the accumulation is saved to checkpointPath every checkpointSeconds and a
+// restarted run with the same scene and settings continues from it. the checkpoint is removed once the image
+// is written, so this can run on nodes that get preempted
+//   Assignment3Qt --render <sceneDataPath> <outputPath> <cameraPos> <cameraLookat> <resolutionW> <resolutionH> <antiAliasing> [checkpointPath] [checkpointSeconds] [irradianceTolerance] [lightCutError]
+int RunRender(int argc, char *argv[]);
+
+// one image of any size written as a tiled tiff, see TiledRenderer. tileSize 0 picks 256
+//   Assignment3Qt --poster <sceneDataPath> <outputPath.tif> <cameraPos> <cameraLookat> <resolutionW> <resolutionH> <antiAliasing> [tileSize] [irradianceTolerance] [lightCutError]
+int RunPoster(int argc, char *argv[]);
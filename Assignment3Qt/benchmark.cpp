@@ -0,0 +1,366 @@
+#include "benchmark.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QElapsedTimer>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "rayTracer.h"
+#include "sampler.h"
+
+using namespace std;
+
+namespace
+{
+	// the gui's default view, the generated objects stay inside what it sees
+	const glm::vec3 CAMERA_POS(0.0f, 1.0f, 10.0f);
+	const glm::vec3 CAMERA_LOOKAT(0.0f, 0.0f, 0.0f);
+
+	// box the spheres are scattered in, above the floor plane at y = -1.5
+	const glm::vec3 SPHERE_BOX_MIN(-4.0f, -1.5f, -4.0f);
+	const glm::vec3 SPHERE_BOX_MAX(4.0f, 2.5f, 2.0f);
+
+	const float PI = 3.14159265f;
+
+	// square the instance grid covers on the floor
+	const float INSTANCE_AREA = 8.0f;
+
+	bool WriteString(QFile &file, const string &s)
+	{
+		return file.write(s.c_str(), s.size()) == (qint64)s.size();
+	}
+
+	glm::vec3 RandomColor(PCG32 &random)
+	{
+		return glm::vec3(0.2f + 0.8f * random.NextFloat(), 0.2f + 0.8f * random.NextFloat(), 0.2f + 0.8f * random.NextFloat());
+	}
+}
+
+#pragma region StressSceneGenerator
+bool StressSceneGenerator::Generate(const QString &sceneDataPath, const StressSceneParam &param)
+{
+	QFileInfo info(sceneDataPath);
+	QString basePath = info.absolutePath() + "/" + info.completeBaseName();
+	QString meshPath = basePath + "_mesh.ply", mapPath = basePath + "_map.hdr";
+
+	QFile file(sceneDataPath);
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+
+	PCG32 random(param.seed);
+	char line[512];
+	sprintf(line, "# generated stress scene: %d spheres, %d triangles, %d instances, sun energy %g\n",
+		param.sphereNum, param.triangleNum, param.instanceNum, param.mapEnergy);
+	bool written = WriteString(file, line);
+	written = written && WriteString(file, "Plane; 0, 1, 0, 1.5; 0.8, 0.8, 0.8\n");
+
+	if (!WriteCubeMap(mapPath, param.mapSize, param.mapEnergy))
+		return false;
+	sprintf(line, "CubeMap; %s; 30.1\n", mapPath.toLocal8Bit().constData());
+	written = written && WriteString(file, line);
+
+	if (param.triangleNum > 0)
+	{
+		if (!WriteMesh(meshPath, param.triangleNum))
+			return false;
+
+		if (param.instanceNum <= 0)
+		{
+			sprintf(line, "Model; %s; 0.7, 0.7, 0.7\n", meshPath.toLocal8Bit().constData());
+			written = written && WriteString(file, line);
+		}
+		else
+		{
+			sprintf(line, "ModelDef; stress; %s; 0.7, 0.7, 0.7\n", meshPath.toLocal8Bit().constData());
+			written = written && WriteString(file, line);
+
+			// a square grid on the floor, each instance fills most of its cell
+			int gridSize = (int)ceil(sqrt((float)param.instanceNum));
+			float cell = INSTANCE_AREA / gridSize;
+			for (int i = 0; i < param.instanceNum; i++)
+			{
+				float x = -INSTANCE_AREA / 2 + cell * (i % gridSize + 0.5f);
+				float z = -INSTANCE_AREA / 2 - 2.0f + cell * (i / gridSize + 0.5f);
+				float scale = cell * 0.4f;
+				sprintf(line, "Instance; stress; %g, %g, %g; 0, 1, 0; %g; %g\n", x, -1.5f + scale, z, 360.0f * random.NextFloat(), scale);
+				written = written && WriteString(file, line);
+			}
+		}
+	}
+
+	if (param.sphereNum > 0)
+	{
+		// radius shrinks with the count so the box keeps about the same density
+		glm::vec3 boxSize = SPHERE_BOX_MAX - SPHERE_BOX_MIN;
+		float radius = glm::min(1.0f, 0.3f * pow(boxSize.x * boxSize.y * boxSize.z / param.sphereNum, 1.0f / 3.0f));
+
+		vector<float> block(param.sphereNum * 7);
+		for (int i = 0; i < param.sphereNum; i++)
+		{
+			float *row = &block[i * 7];
+			row[0] = SPHERE_BOX_MIN.x + boxSize.x * random.NextFloat();
+			row[1] = SPHERE_BOX_MIN.y + boxSize.y * random.NextFloat();
+			row[2] = SPHERE_BOX_MIN.z + boxSize.z * random.NextFloat();
+			row[3] = radius * (0.5f + random.NextFloat());
+			glm::vec3 color = RandomColor(random);
+			row[4] = color.x;
+			row[5] = color.y;
+			row[6] = color.z;
+		}
+		sprintf(line, "SphereBlock; %d\n", param.sphereNum);
+		written = written && WriteString(file, line);
+		written = written && file.write((const char *)&block[0], block.size() * sizeof(float)) == (qint64)(block.size() * sizeof(float));
+	}
+
+	return written;
+}
+
+bool StressSceneGenerator::WriteMesh(const QString &path, int triangleNum)
+{
+	// rings * segments quads of two triangles each, with twice as many segments as rings
+	int rings = glm::max((int)sqrt(triangleNum / 4.0f), 2);
+	int segments = rings * 2;
+	int vertexNum = (rings + 1) * (segments + 1);
+	int faceNum = rings * segments * 2;
+
+	QFile file(path);
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+
+	char header[256];
+	sprintf(header, "ply\nformat binary_little_endian 1.0\nelement vertex %d\nproperty float x\nproperty float y\nproperty float z\n"
+		"property float nx\nproperty float ny\nproperty float nz\nelement face %d\nproperty list uchar int vertex_indices\nend_header\n",
+		vertexNum, faceNum);
+	bool written = WriteString(file, header);
+
+	vector<float> vertices;
+	vertices.reserve(vertexNum * 6);
+	for (int r = 0; r <= rings; r++)
+	{
+		float theta = PI * r / rings;
+		for (int s = 0; s <= segments; s++)
+		{
+			float phi = 2 * PI * s / segments;
+			glm::vec3 normal(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi));
+			// the bumps keep the kd tree from seeing a perfectly regular surface
+			float radius = 1.0f + 0.05f * sin(8 * theta) * sin(8 * phi);
+			glm::vec3 position = normal * radius;
+			vertices.push_back(position.x);
+			vertices.push_back(position.y);
+			vertices.push_back(position.z);
+			vertices.push_back(normal.x);
+			vertices.push_back(normal.y);
+			vertices.push_back(normal.z);
+		}
+	}
+	written = written && file.write((const char *)&vertices[0], vertices.size() * sizeof(float)) == (qint64)(vertices.size() * sizeof(float));
+
+	// one face record is a count byte followed by 3 ints
+	const int FACE_BYTES = 1 + 3 * sizeof(int);
+	vector<char> faces(faceNum * FACE_BYTES);
+	char *p = &faces[0];
+	for (int r = 0; r < rings; r++)
+	{
+		for (int s = 0; s < segments; s++)
+		{
+			int a = r * (segments + 1) + s, b = a + 1, c = a + segments + 1, d = c + 1;
+			int triangles[2][3] = { { a, c, b }, { b, c, d } };
+			for (int t = 0; t < 2; t++)
+			{
+				*p = 3;
+				memcpy(p + 1, triangles[t], 3 * sizeof(int));
+				p += FACE_BYTES;
+			}
+		}
+	}
+	written = written && file.write(&faces[0], faces.size()) == (qint64)faces.size();
+	return written;
+}
+
+bool StressSceneGenerator::WriteCubeMap(const QString &path, int size, float sunEnergy)
+{
+	// horizontal cross of 4 * 3 faces, see CubeMap::CubeMap for which face sits where
+	int w = size * 4, h = size * 3;
+	vector<glm::vec3> pixels(w * h, glm::vec3(0));
+	const glm::vec3 horizon(1.0f, 0.95f, 0.9f), zenith(0.3f, 0.5f, 1.0f), ground(0.1f, 0.09f, 0.08f);
+	for (int row = 0; row < h; row++)
+	{
+		for (int col = 0; col < w; col++)
+		{
+			int faceRow = row / size, faceCol = col / size;
+			float v = (row % size + 0.5f) / size, u = (col % size + 0.5f) / size;
+			glm::vec3 &pixel = pixels[row * w + col];
+			if (faceRow == 0 && faceCol == 1)
+			{
+				// top face, the sun is a small disc off its center
+				float d = glm::length(glm::vec2(u - 0.65f, v - 0.4f));
+				pixel = d < 0.05f ? glm::vec3(sunEnergy) : zenith;
+			}
+			else if (faceRow == 1)
+				pixel = glm::mix(zenith, horizon, v); // side faces, brighter towards the horizon
+			else if (faceRow == 2 && faceCol == 1)
+				pixel = ground;
+		}
+	}
+	return WriteHDR(path, w, h, pixels);
+}
+
+bool StressSceneGenerator::WriteHDR(const QString &path, int w, int h, const vector<glm::vec3> &pixels)
+{
+	QFile file(path);
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+
+	char header[128];
+	sprintf(header, "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y %d +X %d\n", h, w);
+	bool written = WriteString(file, header);
+
+	// shared exponent of the largest channel, Ward's real pixels
+	vector<unsigned char> rgbe(w * h * 4);
+	for (int i = 0; i < w * h; i++)
+	{
+		const glm::vec3 &c = pixels[i];
+		float maxChannel = glm::max(glm::max(c.x, c.y), c.z);
+		unsigned char *p = &rgbe[i * 4];
+		if (maxChannel < 1e-32f)
+		{
+			p[0] = p[1] = p[2] = p[3] = 0;
+			continue;
+		}
+		int exponent;
+		float scale = frexp(maxChannel, &exponent) * 256.0f / maxChannel;
+		p[0] = (unsigned char)(c.x * scale);
+		p[1] = (unsigned char)(c.y * scale);
+		p[2] = (unsigned char)(c.z * scale);
+		p[3] = (unsigned char)(exponent + 128);
+	}
+	written = written && file.write((const char *)&rgbe[0], rgbe.size()) == (qint64)rgbe.size();
+	return written;
+}
+#pragma endregion
+
+int RunGenerate(int argc, char *argv[])
+{
+	if (argc < 6)
+	{
+		printf("usage: %s --generate <sceneDataPath> <sphereNum> <triangleNum> <instanceNum> [mapEnergy] [mapSize] [seed]\n", argv[0]);
+		return 1;
+	}
+
+	StressSceneParam param;
+	param.sphereNum = glm::max(atoi(argv[3]), 0);
+	param.triangleNum = glm::max(atoi(argv[4]), 0);
+	param.instanceNum = glm::max(atoi(argv[5]), 0);
+	param.mapEnergy = argc > 6 ? (float)atof(argv[6]) : 50.0f;
+	param.mapSize = argc > 7 ? glm::max(atoi(argv[7]), 4) : 64;
+	param.seed = argc > 8 ? (unsigned int)strtoul(argv[8], NULL, 10) : 0;
+
+	if (!StressSceneGenerator::Generate(QString::fromLocal8Bit(argv[2]), param))
+	{
+		printf("can't write scene %s\n", argv[2]);
+		return 1;
+	}
+	printf("wrote %s\n", argv[2]);
+	return 0;
+}
+
+int RunBenchmark(int argc, char *argv[])
+{
+	if (argc < 6)
+	{
+		printf("usage: %s --benchmark <sceneDataPath> <resolutionW> <resolutionH> <antiAliasing> [maxThreads] [repeat] [lightCutError] [diffuseStrength] [specularStrength]\n", argv[0]);
+		return 1;
+	}
+
+	QTInputParam qtIP;
+	qtIP.resolutionW = atoi(argv[3]);
+	qtIP.resolutionH = atoi(argv[4]);
+	qtIP.antiAliasingLevel = atoi(argv[5]);
+	qtIP.imageScaleRatio = 1;
+	int maxThreads = argc > 6 ? atoi(argv[6]) : (int)std::thread::hardware_concurrency();
+	maxThreads = glm::max(maxThreads, 1);
+	int repeat = argc > 7 ? glm::max(atoi(argv[7]), 1) : 3;
+	// the irradiance cache would let later runs reuse the records of earlier ones, it stays off
+	qtIP.irradianceTolerance = 0;
+	qtIP.lightCutError = argc > 8 ? (float)atof(argv[8]) : 0;
+	qtIP.denoise = false;
+	qtIP.costMetric = COST_NONE;
+	qtIP.diffuseStrength = argc > 9 ? (float)atof(argv[9]) : DEFAULT_DIFFUSE_STRENGTH;
+	qtIP.specularStrength = argc > 10 ? (float)atof(argv[10]) : DEFAULT_SPECULAR_STRENGTH;
+
+	QElapsedTimer timer;
+	timer.start();
+	SceneData *sceneData = new SceneData();
+	if (!sceneData->Load(QString::fromLocal8Bit(argv[2])))
+	{
+		printf("can't read scene %s\n", argv[2]);
+		safe_delete(sceneData);
+		return 1;
+	}
+	MemoryReport report;
+	sceneData->ReportMemory(report);
+	printf("scene loaded in %.2fs, %.1fMB\n", timer.nsecsElapsed() / 1e9, report.TotalBytes() / 1048576.0);
+
+	RayTracingCameraClass *camera = CreateRenderCamera(CAMERA_POS, CAMERA_LOOKAT, qtIP);
+	const int W = camera->getW(), H = camera->getH();
+	vector<glm::vec3> pixelList(W * H);
+
+	// camera, reflection and shadow rays, counted once by rendering a cost map of all rays
+	double rayNum = 0;
+	{
+		RayTracer rayTracer(sceneData);
+		rayTracer.SetShadingWeights(qtIP.diffuseStrength, qtIP.specularStrength);
+		rayTracer.SetLightCut(qtIP.lightCutError);
+		rayTracer.SetCostMetric(COST_RAYS);
+		ParallelFor(H, [&](int row)
+		{
+			rayTracer.RenderPixels(camera, row, 0, W, &pixelList[row * W]);
+		}, maxThreads);
+		for (int i = 0; i < W * H; i++)
+			rayNum += pixelList[i].x;
+	}
+
+	// 1, 2, 4 .. and maxThreads itself when it is no power of 2
+	vector<int> threadNums;
+	for (int t = 1; t < maxThreads; t *= 2)
+		threadNums.push_back(t);
+	threadNums.push_back(maxThreads);
+
+	printf("%8s %10s %14s %9s %11s\n", "threads", "seconds", "Mrays/s", "speedup", "efficiency");
+	double singleSeconds = 0;
+	for (unsigned int i = 0; i < threadNums.size(); i++)
+	{
+		int threadNum = threadNums[i];
+		double best = 0;
+		for (int r = 0; r < repeat; r++)
+		{
+			RayTracer rayTracer(sceneData);
+			rayTracer.SetShadingWeights(qtIP.diffuseStrength, qtIP.specularStrength);
+			rayTracer.SetLightCut(qtIP.lightCutError);
+			timer.restart();
+			ParallelFor(H, [&](int row)
+			{
+				rayTracer.RenderPixels(camera, row, 0, W, &pixelList[row * W]);
+			}, threadNum);
+			double seconds = timer.nsecsElapsed() / 1e9;
+			if (r == 0 || seconds < best)
+				best = seconds;
+		}
+		if (threadNum == 1)
+			singleSeconds = best;
+
+		double speedup = singleSeconds / best;
+		printf("%8d %10.3f %14.3f %9.2f %10.1f%%\n", threadNum, best, rayNum / best / 1e6, speedup, 100.0 * speedup / threadNum);
+		fflush(stdout);
+	}
+	printf("%.0f camera rays, %.0f traced rays per run\n", (double)W * H * camera->getRayNumEachPixel(), rayNum);
+
+	safe_delete(camera);
+	safe_delete(sceneData);
+	return 0;
+}
@@ -0,0 +1,49 @@
+// synthetic stress scenes and a thread scaling benchmark, both headless, so acceleration structures and
+// threading can be measured at sizes the shipped scenes never reach
+#pragma once
+
+#include <QString>
+
+#include <vector>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Utils.h"
+
+struct StressSceneParam
+{
+	int sphereNum; // batched spheres scattered in front of the default camera
+	int triangleNum; // triangles of the generated mesh, 0 for none
+	int instanceNum; // instances of the mesh on a grid, 0 puts the mesh itself in the middle
+	float mapEnergy; // radiance of the sun on the generated cube map, the sky is 1
+	int mapSize; // texels per cube map face edge
+	unsigned int seed;
+};
+
+// writes <name>.txt with a SphereBlock of the spheres, next to it <name>_mesh.ply (binary) and
+// <name>_map.hdr (a cube map cross in RGBE). the scene refers to them by absolute path so it can be
+// loaded from any working directory
+class StressSceneGenerator
+{
+public:
+	static bool Generate(const QString &sceneDataPath, const StressSceneParam &param);
+
+private:
+	// bumpy uv sphere of radius ~1 with about triangleNum triangles
+	static bool WriteMesh(const QString &path, int triangleNum);
+
+	// sky gradient on the side faces, dark ground, a sun of the given energy on the top face
+	static bool WriteCubeMap(const QString &path, int size, float sunEnergy);
+
+	// flat RGBE scanlines, what stb_image reads for any width
+	static bool WriteHDR(const QString &path, int w, int h, const std::vector<glm::vec3> &pixels);
+};
+
+//   Assignment3Qt --generate <sceneDataPath> <sphereNum> <triangleNum> <instanceNum> [mapEnergy] [mapSize] [seed]
+int RunGenerate(int argc, char *argv[]);
+
+// renders the scene from the gui's default camera with 1, 2, 4 .. maxThreads threads and prints traced
+// rays (camera, reflection and shadow) per second, speedup and parallel efficiency of each thread count,
+// the best of repeat runs
+//   Assignment3Qt --benchmark <sceneDataPath> <resolutionW> <resolutionH> <antiAliasing> [maxThreads] [repeat] [lightCutError] [diffuseStrength] [specularStrength]
+int RunBenchmark(int argc, char *argv[]);
@@ -0,0 +1,133 @@
+#include "checkpoint.h"
+
+#include <QFile>
+#include <QSaveFile>
+
+#include <cstring>
+
+#include "meshLoader.h"
+
+namespace
+{
+	const char MAGIC[8] = { 'A', '3', 'Q', 'C', 'K', 'P', 'T', 0 };
+	const int VERSION = 1;
+
+	struct Header
+	{
+		char magic[8];
+		int version;
+		int w, h;
+		int pixelBytes; // sizeof(AccumPixel) of the writer
+		unsigned long long key;
+	};
+}
+
+RenderCheckpoint::RenderCheckpoint(const QString &path, unsigned long long key, int w, int h, float intervalSeconds)
+	: path(path)
+	, key(key)
+	, w(w)
+	, h(h)
+	, intervalSeconds(intervalSeconds)
+{
+	AccumPixel empty = { glm::vec3(0.0f), 0, 0, 0 };
+	this->pixels.assign(w * h, empty);
+	this->sinceSave.start();
+}
+
+unsigned long long RenderCheckpoint::SettingsKey(const QString &sceneDataPath, glm::vec3 cameraPos, glm::vec3 cameraLookat,
+	const QTInputParam &qtIP, unsigned int sampleSeed, bool progressive)
+{
+	unsigned long long hash = HashBytes(NULL, 0);
+	MappedFile sceneDataFile;
+	if (sceneDataFile.Open(sceneDataPath.toLocal8Bit().data()))
+		hash = HashBytes(sceneDataFile.data, sceneDataFile.size, hash);
+
+	float view[6] = { cameraPos.x, cameraPos.y, cameraPos.z, cameraLookat.x, cameraLookat.y, cameraLookat.z };
+	hash = HashBytes(view, sizeof(view), hash);
+	int settings[5] = { qtIP.resolutionW, qtIP.resolutionH, qtIP.antiAliasingLevel, (int)sampleSeed, progressive ? 1 : 0 };
+	hash = HashBytes(settings, sizeof(settings), hash);
+	float shading[4] = { qtIP.irradianceTolerance, qtIP.lightCutError, qtIP.diffuseStrength, qtIP.specularStrength };
+	return HashBytes(shading, sizeof(shading), hash);
+}
+
+bool RenderCheckpoint::Resume()
+{
+	QFile file(this->path);
+	if (!file.open(QIODevice::ReadOnly))
+		return false;
+
+	Header header;
+	qint64 pixelBytes = (qint64)this->pixels.size() * sizeof(AccumPixel);
+	if (file.read((char *)&header, sizeof(header)) != sizeof(header) || memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+		header.version != VERSION || header.key != this->key || header.w != this->w || header.h != this->h ||
+		header.pixelBytes != sizeof(AccumPixel) || file.size() != (qint64)sizeof(header) + pixelBytes)
+		return false;
+
+	std::vector<AccumPixel> loaded(this->pixels.size());
+	if (file.read((char *)&loaded[0], pixelBytes) != pixelBytes)
+		return false;
+	this->pixels.swap(loaded);
+	return true;
+}
+
+bool RenderCheckpoint::Due() const
+{
+	return this->sinceSave.nsecsElapsed() / 1e9 >= this->intervalSeconds;
+}
+
+bool RenderCheckpoint::Save()
+{
+	this->sinceSave.restart();
+
+	QSaveFile file(this->path);
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+
+	Header header;
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.w = this->w;
+	header.h = this->h;
+	header.pixelBytes = sizeof(AccumPixel);
+	header.key = this->key;
+	qint64 pixelBytes = (qint64)this->pixels.size() * sizeof(AccumPixel);
+	if (file.write((const char *)&header, sizeof(header)) != sizeof(header) ||
+		file.write((const char *)&this->pixels[0], pixelBytes) != pixelBytes)
+		return false;
+	return file.commit();
+}
+
+void RenderCheckpoint::Remove()
+{
+	QFile::remove(this->path);
+}
+
+bool RenderCheckpoint::RowDone(int row) const
+{
+	for (int col = 0; col < this->w; col++)
+		if (this->pixels[row * this->w + col].sampleNum == 0)
+			return false;
+	return true;
+}
+
+void RenderCheckpoint::SetRow(int row, const glm::vec3 *radiance, int sampleNum)
+{
+	for (int col = 0; col < this->w; col++)
+	{
+		AccumPixel &pixel = this->pixels[row * this->w + col];
+		float lum = Luminance(radiance[col]);
+		pixel.sum = radiance[col] * (float)sampleNum;
+		pixel.lumSum = lum * sampleNum;
+		pixel.lumSqSum = lum * lum * sampleNum;
+		pixel.sampleNum = sampleNum;
+	}
+}
+
+void RenderCheckpoint::GetRow(int row, glm::vec3 *radiance) const
+{
+	for (int col = 0; col < this->w; col++)
+	{
+		const AccumPixel &pixel = this->pixels[row * this->w + col];
+		radiance[col] = pixel.sampleNum > 0 ? pixel.sum / (float)pixel.sampleNum : glm::vec3(0.0f);
+	}
+}
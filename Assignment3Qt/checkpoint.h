@@ -0,0 +1,58 @@
+// periodic snapshots of a render's accumulation buffer, so a killed render continues where it stopped
+#pragma once
+
+#include <QString>
+#include <QElapsedTimer>
+
+#include <vector>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "rayTracer.h"
+
+// running sums of one pixel. the sampler has no state beyond its seed (part of the key) and the sample
+// index, which is sampleNum, so this is everything a render needs to go on
+struct AccumPixel
+{
+	glm::vec3 sum;
+	float lumSum, lumSqSum;
+	int sampleNum;
+};
+
+// the file is a small header (magic, version, key, size) and the raw AccumPixel array. it is written to a
+// temporary file that replaces the old one, so a render killed while saving still has the previous snapshot
+class RenderCheckpoint
+{
+public:
+	RenderCheckpoint(const QString &path, unsigned long long key, int w, int h, float intervalSeconds = 60);
+	~RenderCheckpoint(){};
+
+	// identifies everything that changes the image: the scene file's bytes, the view and the render settings.
+	// progressive tells a DeadlineRenderer's buffer apart from a fixed sample one. files behind the scene
+	// file, models and cube maps, are not hashed
+	static unsigned long long SettingsKey(const QString &sceneDataPath, glm::vec3 cameraPos, glm::vec3 cameraLookat,
+		const QTInputParam &qtIP, unsigned int sampleSeed, bool progressive);
+
+	// loads the file if its key and size match, otherwise pixels is left empty. true when something was resumed
+	bool Resume();
+
+	// intervalSeconds passed since the last save
+	bool Due() const;
+	bool Save();
+	// the render finished, nothing left to resume
+	void Remove();
+
+	// for renders that finish a row of pixels at a time with the same samples each
+	bool RowDone(int row) const;
+	void SetRow(int row, const glm::vec3 *radiance, int sampleNum);
+	void GetRow(int row, glm::vec3 *radiance) const;
+
+	std::vector<AccumPixel> pixels;
+
+private:
+	QString path;
+	unsigned long long key;
+	int w, h;
+	float intervalSeconds;
+	QElapsedTimer sinceSave;
+};
@@ -0,0 +1,113 @@
+#include "costMap.h"
+
+#include <QFile>
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+	// a few pathological pixels would leave everything else blue
+	const float MAX_PERCENTILE = 0.99f;
+
+	// blue, cyan, green, yellow, red
+	const glm::vec3 RAMP[5] = { glm::vec3(0, 0, 1), glm::vec3(0, 1, 1), glm::vec3(0, 1, 0), glm::vec3(1, 1, 0), glm::vec3(1, 0, 0) };
+}
+
+const char *CostMetricName(CostMetric metric)
+{
+	switch (metric)
+	{
+	case COST_TIME:
+		return "time";
+	case COST_NODES:
+		return "nodes";
+	case COST_PRIMITIVES:
+		return "primitives";
+	case COST_SHADOW_RAYS:
+		return "shadowrays";
+	case COST_RAYS:
+		return "rays";
+	default:
+		return "none";
+	}
+}
+
+float CostValue(CostMetric metric, const RayCost &cost, float timeUs)
+{
+	switch (metric)
+	{
+	case COST_TIME:
+		return timeUs;
+	case COST_NODES:
+		return (float)cost.nodeNum;
+	case COST_PRIMITIVES:
+		return (float)cost.primitiveNum;
+	case COST_SHADOW_RAYS:
+		return (float)cost.shadowRayNum;
+	case COST_RAYS:
+		return (float)(cost.rayNum + cost.shadowRayNum);
+	default:
+		return 0;
+	}
+}
+
+glm::vec3 CostMap::FalseColor(float t)
+{
+	t = glm::clamp(t, 0.0f, 1.0f) * 4;
+	int i = glm::min((int)t, 3);
+	return glm::mix(RAMP[i], RAMP[i + 1], t - i);
+}
+
+float CostMap::ToImage(int w, int h, const glm::vec3 *pixels, QImage &image, int scaleRatio)
+{
+	int pixelNum = w * h;
+	std::vector<float> costs(pixelNum);
+	for (int i = 0; i < pixelNum; i++)
+		costs[i] = pixels[i][0];
+
+	int nthIdx = glm::max((int)(pixelNum * MAX_PERCENTILE) - 1, 0);
+	std::nth_element(costs.begin(), costs.begin() + nthIdx, costs.end());
+	float maxCost = glm::max(costs[nthIdx], 1e-6f);
+
+	image = QImage(w * scaleRatio, h * scaleRatio, QImage::Format_RGB888);
+	for (int row = 0; row < h; row++)
+	{
+		for (int col = 0; col < w; col++)
+		{
+			glm::vec3 color = FalseColor(pixels[row * w + col][0] / maxCost) * 255.0f;
+			QRgb rgb = qRgb((int)color.x, (int)color.y, (int)color.z);
+			for (int rowI = 0; rowI < scaleRatio; rowI++)
+				for (int colI = 0; colI < scaleRatio; colI++)
+					image.setPixel(col * scaleRatio + colI, row * scaleRatio + rowI, rgb);
+		}
+	}
+	return maxCost;
+}
+
+bool CostMap::Save(const QString &basePath, int w, int h, const glm::vec3 *pixels)
+{
+	QImage image;
+	ToImage(w, h, pixels, image);
+	bool saved = image.save(basePath + ".png");
+	return SavePFM(basePath + ".pfm", w, h, pixels) && saved;
+}
+
+bool CostMap::SavePFM(const QString &path, int w, int h, const glm::vec3 *pixels)
+{
+	QFile file(path);
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+
+	// a negative scale marks little endian data, rows go from the bottom up
+	QByteArray header = QString("Pf\n%1 %2\n-1.0\n").arg(w).arg(h).toLatin1();
+	bool written = file.write(header) == header.size();
+	std::vector<float> row(w);
+	for (int y = h - 1; y >= 0; y--)
+	{
+		for (int x = 0; x < w; x++)
+			row[x] = pixels[y * w + x][0];
+		written = written && file.write((const char *)&row[0], w * sizeof(float)) == (qint64)(w * sizeof(float));
+	}
+	return written;
+}
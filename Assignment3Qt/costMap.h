@@ -0,0 +1,43 @@
+// diagnostic renders that show what a pixel costs instead of its shading, to find the objects, lights and
+// tree regions that make a scene slow
+#pragma once
+
+#include <QString>
+#include <QImage>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "rayTracingCamera.h"
+
+// what a cost map shows, in the order of the ui's combo box
+enum CostMetric
+{
+	COST_NONE,
+	COST_TIME, // wall time of the pixel in microseconds
+	COST_NODES, // RayCost::nodeNum
+	COST_PRIMITIVES, // RayCost::primitiveNum
+	COST_SHADOW_RAYS, // RayCost::shadowRayNum
+	COST_RAYS // all traced rays, RayCost::rayNum + RayCost::shadowRayNum
+};
+
+// short name for file names
+const char *CostMetricName(CostMetric metric);
+
+// the value stored for a pixel, timeUs is the time spent on it
+float CostValue(CostMetric metric, const RayCost &cost, float timeUs);
+
+class CostMap
+{
+public:
+	// false color of a w * h cost map, blue for no cost to red for the 99th percentile and above. each pixel
+	// becomes a scaleRatio square of image, the cost shown as red is returned
+	static float ToImage(int w, int h, const glm::vec3 *pixels, QImage &image, int scaleRatio = 1);
+
+	// the false color as basePath.png and the raw costs as a single channel basePath.pfm
+	static bool Save(const QString &basePath, int w, int h, const glm::vec3 *pixels);
+
+private:
+	static glm::vec3 FalseColor(float t);
+
+	static bool SavePFM(const QString &path, int w, int h, const glm::vec3 *pixels);
+};
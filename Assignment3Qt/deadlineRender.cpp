@@ -0,0 +1,180 @@
+#include "deadlineRender.h"
+
+#include <QElapsedTimer>
+
+#include <algorithm>
+
+#include "traceLog.h"
+
+using namespace std;
+
+namespace
+{
+	// uniform passes before samples go where the error is, the variance of fewer samples means little
+	const int UNIFORM_SPP = 4;
+	// kept for exposure, tonemapping and display after the last round
+	const float FINISH_RESERVE = 0.05f;
+	// a round plans for this much of the time left, the measured cost per sample is only an average
+	const float ROUND_SAFETY = 0.8f;
+	// pixels handed to a thread at a time
+	const int CHUNK_SIZE = 64;
+}
+
+DeadlineRenderer::DeadlineRenderer(RayTracer *rayTracer, RayTracingCameraClass *camera, int threadNum)
+	: rayTracer(rayTracer)
+	, camera(camera)
+	, threadNum(glm::max(threadNum, 1))
+	, w(camera->getW())
+	, h(camera->getH())
+	, checkpoint(NULL)
+	, sampleNum(0)
+	, resumedSampleNum(0)
+{
+}
+
+void DeadlineRenderer::Render(float budgetSeconds, vector<glm::vec3> &pixels, function<void()> progress)
+{
+	QElapsedTimer timer;
+	timer.start();
+	const int pixelNum = w * h;
+	AccumPixel empty = { glm::vec3(0.0f), 0, 0, 0 };
+	states.assign(pixelNum, empty);
+	if (checkpoint)
+		states = checkpoint->pixels;
+	sampleNum = 0;
+	resumedSampleNum = 0;
+	int resumedPasses = pixelNum > 0 ? MYINFINITE : 0;
+	for (int i = 0; i < pixelNum; i++)
+	{
+		resumedSampleNum += states[i].sampleNum;
+		resumedPasses = glm::min(resumedPasses, states[i].sampleNum);
+	}
+	pixels.assign(pixelNum, glm::vec3(0.0f));
+
+	// time available for tracing, and the time traced so far to measure the cost of a sample
+	const double deadline = budgetSeconds * (1.0f - FINISH_RESERVE);
+	double traceSeconds = 0;
+
+	vector<int> allPixels(pixelNum);
+	for (int i = 0; i < pixelNum; i++)
+		allPixels[i] = i;
+
+	// a resumed buffer skips the passes every pixel already has
+	for (int pass = 0; pass < UNIFORM_SPP - resumedPasses; pass++)
+	{
+		double left = deadline - timer.nsecsElapsed() / 1e9;
+		if (pass > 0 && traceSeconds / pass > left)
+			break;
+
+		TraceScope trace("uniform pass");
+		QElapsedTimer passTimer;
+		passTimer.start();
+		TraceSamples(allPixels);
+		traceSeconds += passTimer.nsecsElapsed() / 1e9;
+		SaveCheckpoint(false);
+
+		if (progress)
+		{
+			Resolve(pixels);
+			progress();
+		}
+	}
+
+	vector<int> order(allPixels);
+	vector<float> error(pixelNum);
+	for (;;)
+	{
+		double left = deadline - timer.nsecsElapsed() / 1e9;
+		// a resumed buffer may skip every uniform pass, then a first round of one row measures the cost
+		int roundSize = w;
+		if (sampleNum > 0)
+		{
+			double costPerSample = traceSeconds / sampleNum;
+			roundSize = (int)glm::min(left * ROUND_SAFETY / costPerSample, (double)pixelNum);
+		}
+		// not even a row fits, stop before the round overhead costs more than it brings
+		if (left <= 0 || roundSize < w)
+			break;
+
+		TraceScope trace("adaptive round");
+		QElapsedTimer roundTimer;
+		roundTimer.start();
+
+		float lumSum = 0;
+		for (int i = 0; i < pixelNum; i++)
+			lumSum += states[i].lumSum / glm::max(states[i].sampleNum, 1);
+		float darkFloor = 0.1f * lumSum / pixelNum + 1e-4f;
+		for (int i = 0; i < pixelNum; i++)
+			error[i] = RelativeError(states[i], darkFloor);
+
+		nth_element(order.begin(), order.begin() + roundSize - 1, order.end(), [&](int a, int b) { return error[a] > error[b]; });
+		TraceSamples(vector<int>(order.begin(), order.begin() + roundSize));
+		traceSeconds += roundTimer.nsecsElapsed() / 1e9;
+		SaveCheckpoint(false);
+
+		if (progress)
+		{
+			Resolve(pixels);
+			progress();
+		}
+	}
+
+	SaveCheckpoint(true);
+	Resolve(pixels);
+}
+
+float DeadlineRenderer::MeanSamplesPerPixel() const
+{
+	return this->states.empty() ? 0.0f : (float)(this->resumedSampleNum + this->sampleNum) / this->states.size();
+}
+
+void DeadlineRenderer::ReportMemory(MemoryReport &report) const
+{
+	report.Add("deadline accumulation", VectorBytes(this->states));
+}
+
+void DeadlineRenderer::TraceSamples(const vector<int> &pixelIdx)
+{
+	int chunkNum = ((int)pixelIdx.size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	ParallelFor(chunkNum, [&](int chunk)
+	{
+		int end = glm::min((chunk + 1) * CHUNK_SIZE, (int)pixelIdx.size());
+		for (int i = chunk * CHUNK_SIZE; i < end; i++)
+		{
+			// every pixel is in pixelIdx at most once, so its state is only touched by this thread
+			AccumPixel &state = states[pixelIdx[i]];
+			glm::vec3 color = rayTracer->TraceSample(camera, pixelIdx[i] / w, pixelIdx[i] % w, state.sampleNum);
+			float lum = Luminance(color);
+			state.sum += color;
+			state.lumSum += lum;
+			state.lumSqSum += lum * lum;
+			state.sampleNum++;
+		}
+	}, threadNum);
+	sampleNum += pixelIdx.size();
+}
+
+float DeadlineRenderer::RelativeError(const AccumPixel &state, float darkFloor) const
+{
+	// a single sample says nothing about the variance, it goes first
+	if (state.sampleNum < 2)
+		return MYINFINITE;
+	float mean = state.lumSum / state.sampleNum;
+	float variance = glm::max(state.lumSqSum / state.sampleNum - mean * mean, 0.0f);
+	return sqrt(variance / state.sampleNum) / (mean + darkFloor);
+}
+
+void DeadlineRenderer::SaveCheckpoint(bool force)
+{
+	if (!this->checkpoint || !(force || this->checkpoint->Due()))
+		return;
+	TraceScope trace("checkpoint");
+	this->checkpoint->pixels = this->states;
+	this->checkpoint->Save();
+}
+
+void DeadlineRenderer::Resolve(vector<glm::vec3> &pixels) const
+{
+	for (unsigned int i = 0; i < states.size(); i++)
+		pixels[i] = states[i].sampleNum > 0 ? states[i].sum / (float)states[i].sampleNum : glm::vec3(0.0f);
+}
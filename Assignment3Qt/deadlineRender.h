@@ -0,0 +1,56 @@
+// progressive rendering against a wall clock budget instead of a fixed sample count
+#pragma once
+
+#include <vector>
+#include <functional>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "rayTracer.h"
+#include "checkpoint.h"
+
+// traces the image in passes of one sample per pixel until every pixel has a few samples, measuring the
+// cost of a sample as it goes. the rest of the budget is spent in rounds that each give one more sample to
+// the pixels with the largest relative error, every round sized by the measured cost to what still fits.
+// the first pass always completes, a budget below its cost is overrun by the rest of that pass. a resumed
+// render that needs no uniform pass measures the cost with a first round of one row
+class DeadlineRenderer
+{
+public:
+	// camera should shoot one ray per pixel, the sample index of each pixel is advanced by the renderer
+	DeadlineRenderer(RayTracer *rayTracer, RayTracingCameraClass *camera, int threadNum = MYTHREADNUM);
+	~DeadlineRenderer(){};
+
+	// the accumulation starts from the checkpoint's pixels, which the caller may have resumed, and is saved to it
+	// whenever it is due and once at the end. the file is kept, a later run with a new budget goes on converging
+	void SetCheckpoint(RenderCheckpoint *checkpoint) { this->checkpoint = checkpoint; }
+
+	// pixels receives the mean radiance of each pixel once budgetSeconds after the call have passed.
+	// progress is called after every pass and round, pixels holds the current means by then
+	void Render(float budgetSeconds, std::vector<glm::vec3> &pixels, std::function<void()> progress = nullptr);
+
+	long long SampleNum() const { return this->sampleNum; }
+	float MeanSamplesPerPixel() const;
+	void ReportMemory(MemoryReport &report) const;
+
+private:
+	// one more sample for each pixel of pixelIdx
+	void TraceSamples(const std::vector<int> &pixelIdx);
+
+	// standard error of the mean luminance over the mean, darkFloor keeps black pixels from dominating
+	float RelativeError(const AccumPixel &state, float darkFloor) const;
+
+	void Resolve(std::vector<glm::vec3> &pixels) const;
+
+	// copies the accumulation to the checkpoint and saves it if it is due, or always when forced
+	void SaveCheckpoint(bool force);
+
+	RayTracer *rayTracer;
+	RayTracingCameraClass *camera;
+	int threadNum;
+	int w, h;
+	std::vector<AccumPixel> states;
+	RenderCheckpoint *checkpoint;
+	// samples traced by this renderer, and the ones a resumed checkpoint already had
+	long long sampleNum, resumedSampleNum;
+};
@@ -0,0 +1,158 @@
+#include "denoiser.h"
+#include "traceLog.h"
+
+#include <cmath>
+
+namespace
+{
+	// albedo below this is not divided out, dark surfaces would blow the noise up
+	const float ALBEDO_EPSILON = 0.01f;
+
+	// falloff of the edge stopping functions
+	const float SIGMA_LUMINANCE = 4.0f;
+	const float SIGMA_DEPTH = 0.05f;	// relative depth change per pixel of distance
+	const int NORMAL_POWER_LOG2 = 6;	// the normal weight is dot(n, n')^64
+
+	const float KERNEL[3] = { 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+	bool IsBackground(const PixelFeature &f)
+	{
+		return f.depth < 0;
+	}
+
+	// weight of neighbour q for center p from the geometry alone, dis is their distance in pixels
+	float GeometryWeight(const PixelFeature &p, const PixelFeature &q, float dis)
+	{
+		if (IsBackground(p) || IsBackground(q))
+			return IsBackground(p) && IsBackground(q) ? 1.0f : 0.0f;
+
+		float normalWeight = glm::max(dot(p.normal, q.normal), 0.0f);
+		for (int i = 0; i < NORMAL_POWER_LOG2; i++)
+			normalWeight *= normalWeight;
+
+		float depthWeight = exp(-fabs(p.depth - q.depth) / (SIGMA_DEPTH * p.depth * dis + MYEPSILON));
+		return normalWeight * depthWeight;
+	}
+}
+
+void Denoiser::Denoise(int w, int h, glm::vec3 *pixels, const PixelFeature *features, int iterationNum, int threadNum)
+{
+	TraceScope trace("denoise");
+	int pixelNum = w * h;
+	std::vector<glm::vec3> illum(pixelNum), illumOut(pixelNum);
+	std::vector<float> variance(pixelNum), varianceOut(pixelNum);
+
+	// demodulate the albedo, the variance follows the luminance scale
+	ParallelFor(h, [&](int y)
+	{
+		for (int i = y * w; i < (y + 1) * w; i++)
+		{
+			glm::vec3 albedo = glm::max(features[i].albedo, glm::vec3(ALBEDO_EPSILON));
+			illum[i] = pixels[i] / albedo;
+			float scale = Luminance(albedo);
+			variance[i] = features[i].variance / (scale * scale);
+		}
+	}, threadNum);
+
+	// one ray per pixel has no variance of its own, its 3 * 3 surface neighbourhood stands in
+	ParallelFor(h, [&](int y)
+	{
+		for (int x = 0; x < w; x++)
+		{
+			int idx = y * w + x;
+			if (features[idx].variance > 0)
+			{
+				varianceOut[idx] = variance[idx];
+				continue;
+			}
+
+			float weightSum = 0, lum = 0, lumSq = 0;
+			for (int dy = -1; dy <= 1; dy++)
+			{
+				for (int dx = -1; dx <= 1; dx++)
+				{
+					int qx = x + dx, qy = y + dy;
+					if (qx < 0 || qx >= w || qy < 0 || qy >= h)
+						continue;
+					int qIdx = qy * w + qx;
+					float weight = GeometryWeight(features[idx], features[qIdx], 1.0f);
+					float l = Luminance(illum[qIdx]);
+					weightSum += weight;
+					lum += weight * l;
+					lumSq += weight * l * l;
+				}
+			}
+			// the center may get no weight from its own features, keep the pixel's own estimate then
+			if (weightSum <= 0)
+			{
+				varianceOut[idx] = variance[idx];
+				continue;
+			}
+			lum /= weightSum;
+			varianceOut[idx] = glm::max(lumSq / weightSum - lum * lum, 0.0f);
+		}
+	}, threadNum);
+	variance.swap(varianceOut);
+
+	for (int i = 0; i < iterationNum; i++)
+	{
+		ATrousPass(w, h, 1 << i, features, illum, variance, illumOut, varianceOut, threadNum);
+		illum.swap(illumOut);
+		variance.swap(varianceOut);
+	}
+
+	// put the albedo back
+	ParallelFor(h, [&](int y)
+	{
+		for (int i = y * w; i < (y + 1) * w; i++)
+			pixels[i] = illum[i] * glm::max(features[i].albedo, glm::vec3(ALBEDO_EPSILON));
+	}, threadNum);
+}
+
+void Denoiser::ATrousPass(int w, int h, int step, const PixelFeature *features,
+	const std::vector<glm::vec3> &illum, const std::vector<float> &variance,
+	std::vector<glm::vec3> &illumOut, std::vector<float> &varianceOut, int threadNum)
+{
+	ParallelFor(h, [&](int y)
+	{
+		for (int x = 0; x < w; x++)
+		{
+			int idx = y * w + x;
+			const PixelFeature &p = features[idx];
+			float lum = Luminance(illum[idx]);
+			float lumScale = SIGMA_LUMINANCE * sqrt(variance[idx]) + MYEPSILON;
+
+			glm::vec3 sum(0.0f);
+			float weightSum = 0, varianceSum = 0;
+			for (int dy = -2; dy <= 2; dy++)
+			{
+				int qy = y + dy * step;
+				if (qy < 0 || qy >= h)
+					continue;
+				for (int dx = -2; dx <= 2; dx++)
+				{
+					int qx = x + dx * step;
+					if (qx < 0 || qx >= w)
+						continue;
+
+					int qIdx = qy * w + qx;
+					float weight = KERNEL[abs(dx)] * KERNEL[abs(dy)];
+					if (qIdx != idx)
+					{
+						float dis = step * sqrt((float)(dx * dx + dy * dy));
+						weight *= GeometryWeight(p, features[qIdx], dis);
+						weight *= exp(-fabs(lum - Luminance(illum[qIdx])) / lumScale);
+					}
+
+					sum += weight * illum[qIdx];
+					weightSum += weight;
+					varianceSum += weight * weight * variance[qIdx];
+				}
+			}
+
+			// the center always has a weight, the sum is never 0
+			illumOut[idx] = sum / weightSum;
+			varianceOut[idx] = varianceSum / (weightSum * weightSum);
+		}
+	}, threadNum);
+}
@@ -0,0 +1,38 @@
+// edge avoiding a-trous wavelet filter guided by the first hit's albedo, normal and depth, Reference:
+// Dammertz et al., Edge-Avoiding A-Trous Wavelet Transform for fast Global Illumination Filtering, HPG 2010
+#pragma once
+
+#include <vector>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Utils.h"
+
+// per pixel guides written by RayTracer::RenderPixels next to the radiance, averaged over the pixel's rays
+struct PixelFeature
+{
+	glm::vec3 albedo;	// pointColor of the first hit, the map color for background rays
+	glm::vec3 normal;	// zero when no ray of the pixel hit an object
+	float depth;		// ray distance of the first hit, -1 when no ray of the pixel hit an object
+	float variance;		// luminance variance of the pixel mean, 0 for a single ray
+};
+
+inline float Luminance(glm::vec3 c)
+{
+	return 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z;
+}
+
+class Denoiser
+{
+public:
+	// filters the radiance of a w * h image in place, before any exposure scale. the albedo is divided out
+	// first so texture is kept, then iterationNum passes with growing step smooth the lighting between
+	// pixels of the same surface, weighted by the normal, depth and the variance left at that pass
+	static void Denoise(int w, int h, glm::vec3 *pixels, const PixelFeature *features, int iterationNum = 5, int threadNum = MYTHREADNUM);
+
+private:
+	// one a-trous pass of the given pixel step from (illum, variance) to (illumOut, varianceOut)
+	static void ATrousPass(int w, int h, int step, const PixelFeature *features,
+		const std::vector<glm::vec3> &illum, const std::vector<float> &variance,
+		std::vector<glm::vec3> &illumOut, std::vector<float> &varianceOut, int threadNum);
+};
@@ -4,7 +4,14 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
-#include <ctime>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cfloat>
+#include <functional>
+#include <xmmintrin.h>
+
+#include "meshLoader.h"
+#include "traceLog.h"
 
 #pragma region GeometryObject
 GeometryObject::GeometryObject(std::string typeName, glm::vec3 color)
@@ -12,51 +19,14 @@ GeometryObject::GeometryObject(std::string typeName, glm::vec3 color)
 	, color(color)
 {
 }
-#pragma endregion
-
-#pragma region Sphere
-Sphere::Sphere(glm::vec3 center, float radius, glm::vec3 color)
-	: GeometryObject("sphere", color)
-	, center{ center }
-	, radius{ radius }
-{
-	this->AA = this->center - radius;
-	this->BB = this->center + radius;
-}
-void Sphere::RayIntersection(RayClass* ray, RayHitObjectRecord &rhor)
+void GeometryObject::RayIntersection(RayClass* ray, RayHitObjectRecord &rhor)
 {
-	glm::vec3 sc = ray->sPoint - this->center;
-	glm::vec3 d = ray->direction;
-
-	// At^2 + Bt + C = 0, solve t
-	float A = dot(d, d);
-	float B = 2 * dot(d, sc);
-	float C = dot(sc, sc) - this->radius*this->radius;
-
-	float det = B*B - 4 * A*C;
-	if (det > MYEPSILON)
+	RayHit hit;
+	hit.t = MYINFINITE;
+	if (Intersect(ray, hit))
 	{
-		float t1 = (-B - sqrt(det)) / (2 * A);
-		float t2 = (-B + sqrt(det)) / (2 * A);
-
-		if (t1 > MYEPSILON)
-		{
-			rhor.hitPoint = ray->getPoint(t1);
-			rhor.hitNormal = normalize(rhor.hitPoint - this->center);
-			rhor.rDirection = ray->direction - 2 * dot(ray->direction, rhor.hitNormal) * rhor.hitNormal; // it's already normalized
-			rhor.pointColor = this->color;
-			rhor.depth = t1;
-			return;
-		}
-		else if (t2 > MYEPSILON)
-		{
-			rhor.hitPoint = ray->getPoint(t2);
-			rhor.hitNormal = normalize(rhor.hitPoint - this->center);
-			rhor.rDirection = ray->direction - 2 * dot(ray->direction, rhor.hitNormal) * rhor.hitNormal; // it's already normalized
-			rhor.pointColor = this->color;
-			rhor.depth = t2;
-			return;
-		}
+		FillRecord(ray, hit, rhor);
+		return;
 	}
 
 	rhor.hitPoint = glm::vec3(0, 0, 0);
@@ -65,64 +35,39 @@ void Sphere::RayIntersection(RayClass* ray, RayHitObjectRecord &rhor)
 	rhor.pointColor = glm::vec3(0, 0, 0);
 	rhor.depth = -1;
 }
-void Sphere::GetBoundingBox(glm::vec3 &AA, glm::vec3 &BB)
+RayMask GeometryObject::Occlude(ShadowBundle &bundle, RayMask active)
 {
-	AA = this->AA;
-	BB = this->BB;
-}
-
-#pragma endregion
-
-#pragma region Plane
-Plane::Plane(float A, float B, float C, float D, glm::vec3 color)
-	: GeometryObject("plane", color)
-	, ABC{ glm::vec3(A, B, C) }
-	, D{D}
-{
-	this->AA = glm::vec3(-MYINFINITE);
-	this->BB = glm::vec3(MYINFINITE);
-
-	this->normal = normalize(glm::vec3(A, B, C));
-}
-void Plane::RayIntersection(RayClass* ray, RayHitObjectRecord &rhor)
-{
-	glm::vec3 sp = ray->sPoint;
-	glm::vec3 d = ray->direction;
-
-	float denominator = dot(this->ABC, d);
-	float numerator = -this->D - dot(this->ABC, sp);
-
-	float t = numerator / denominator;
-	if (t > MYEPSILON)
+	RayMask occluded = 0;
+	RayHit hit;
+	for (int r = 0; active; r++, active >>= 1)
 	{
-		rhor.hitPoint = ray->getPoint(t);
-		rhor.hitNormal = this->normal;
-		rhor.rDirection = ray->direction - 2 * dot(ray->direction, rhor.hitNormal) * rhor.hitNormal; // it's already normalized
-		rhor.pointColor = this->color;
-		rhor.depth = t;
-		return;
+		if (!(active & 1))
+			continue;
+		hit.t = bundle.maxT[r];
+		if (Intersect(&bundle.rays[r], hit))
+			occluded |= (RayMask)1 << r;
 	}
-
-	rhor.hitPoint = glm::vec3(0, 0, 0);
-	rhor.hitNormal = glm::vec3(0, 0, 0);
-	rhor.rDirection = glm::vec3(0, 0, 0);
-	rhor.pointColor = glm::vec3(0, 0, 0);
-	rhor.depth = -1;
+	return occluded;
 }
-void Plane::GetBoundingBox(glm::vec3 &AA, glm::vec3 &BB)
+void GeometryObject::ReportMemory(MemoryReport &report)
 {
-	AA = this->AA;
-	BB = this->BB;
+	report.Add(this->typeName, sizeof(*this));
 }
 #pragma endregion
 
 #pragma region Triangle
 Triangle::Triangle(const Vertex &A, const Vertex &B, const Vertex &C, glm::vec3 color)
 	: GeometryObject("triangle", color)
-	, A(A)
-	, B(B)
-	, C(C)
+	, faceIdx(0)
 {
+	SetVertices(A, B, C);
+}
+void Triangle::SetVertices(const Vertex &A, const Vertex &B, const Vertex &C)
+{
+	this->A = A;
+	this->B = B;
+	this->C = C;
+
 	AA[0] = glm::min(glm::min(A.Position[0], B.Position[0]), C.Position[0]);
 	AA[1] = glm::min(glm::min(A.Position[1], B.Position[1]), C.Position[1]);
 	AA[2] = glm::min(glm::min(A.Position[2], B.Position[2]), C.Position[2]);
@@ -135,32 +80,91 @@ Triangle::Triangle(const Vertex &A, const Vertex &B, const Vertex &C, glm::vec3
 	this->eAB = B.Position - A.Position;
 	this->eAC = C.Position - A.Position;
 }
-void Triangle::RayIntersection(RayClass* ray, RayHitObjectRecord &rhor)
+bool Triangle::Intersect(RayClass* ray, RayHit &hit)
+{
+	float t, b1, b2;
+	if (!Intersect(ray, t, b1, b2) || t >= hit.t)
+		return false;
+	hit.t = t;
+	hit.primID = 0;
+	hit.u = b1;
+	hit.v = b2;
+	return true;
+}
+void Triangle::FillRecord(RayClass* ray, const RayHit &hit, RayHitObjectRecord &rhor)
 {
+	FillRecord(ray, hit.t, hit.u, hit.v, rhor);
+}
+bool Triangle::Intersect(RayClass* ray, float &t, float &b1, float &b2)
+{
+	if (ray->cost)
+		ray->cost->primitiveNum++;
 	glm::vec3 s = ray->sPoint - A.Position;
 	glm::vec3 d = ray->direction;
 
-	float denominator = dot(cross(d, eAC), eAB);
+	// the same cramer's rule as before with the shared cross products computed once
+	glm::vec3 p = cross(d, eAC);
+	float invDenominator = 1.0f / dot(p, eAB);
+
+	b1 = dot(p, s) * invDenominator;
+	if (!(b1 > -MYEPSILON))
+		return false;
+	glm::vec3 q = cross(s, eAB);
+	b2 = dot(d, q) * invDenominator;
+	if (!(b2 > -MYEPSILON && b1 + b2 < 1 + MYEPSILON))
+		return false;
+	t = dot(eAC, q) * invDenominator;
+	return t > MYEPSILON;
+}
+RayMask Triangle::Occlude(ShadowBundle &bundle, RayMask active)
+{
+	// s, q and the numerator of t only depend on the origin
+	glm::vec3 s = bundle.origin - A.Position;
+	glm::vec3 q = cross(s, eAB);
+	const __m128 sx = _mm_set1_ps(s.x), sy = _mm_set1_ps(s.y), sz = _mm_set1_ps(s.z);
+	const __m128 qx = _mm_set1_ps(q.x), qy = _mm_set1_ps(q.y), qz = _mm_set1_ps(q.z);
+	const __m128 abx = _mm_set1_ps(eAB.x), aby = _mm_set1_ps(eAB.y), abz = _mm_set1_ps(eAB.z);
+	const __m128 acx = _mm_set1_ps(eAC.x), acy = _mm_set1_ps(eAC.y), acz = _mm_set1_ps(eAC.z);
+	const __m128 tNumerator = _mm_set1_ps(dot(eAC, q));
+	const __m128 one = _mm_set1_ps(1.0f), eps = _mm_set1_ps((float)MYEPSILON), negEps = _mm_set1_ps(-(float)MYEPSILON);
+	const __m128 onePlusEps = _mm_set1_ps(1 + (float)MYEPSILON);
 
-	float b1 = dot(cross(d, eAC), s) / denominator;
-	float b2 = dot(cross(eAB, d), s) / denominator;
-	float t = dot(cross(eAB, eAC), s) / denominator;
-	if (t > MYEPSILON && b1 > -MYEPSILON && b2 > -MYEPSILON && b1 + b2 < 1 + MYEPSILON)
+	// 4 rays at a time, the same cramer's rule as Intersect
+	RayMask occluded = 0;
+	for (int r = 0; active; r += 4, active >>= 4)
 	{
-		rhor.hitPoint = ray->getPoint(t);
-		rhor.hitNormal = normalize((1 - b1 - b2) * A.Normal + b1 * B.Normal + b2 * C.Normal);
-		//rhor.hitNormal = normalize(cross(eAB, eAC));
-		rhor.rDirection = ray->direction - 2 * dot(ray->direction, rhor.hitNormal) * rhor.hitNormal; // it's already normalized
-		rhor.pointColor = this->color;
-		rhor.depth = t;
-		return;
-	}
+		int lanes = (int)(active & 15);
+		if (!lanes)
+			continue;
+		if (bundle.cost)
+			bundle.cost->primitiveNum += (lanes & 1) + (lanes >> 1 & 1) + (lanes >> 2 & 1) + (lanes >> 3);
 
-	rhor.hitPoint = glm::vec3(0, 0, 0);
-	rhor.hitNormal = glm::vec3(0, 0, 0);
-	rhor.rDirection = glm::vec3(0, 0, 0);
-	rhor.pointColor = glm::vec3(0, 0, 0);
-	rhor.depth = -1;
+		__m128 dx = _mm_loadu_ps(&bundle.dirX[r]), dy = _mm_loadu_ps(&bundle.dirY[r]), dz = _mm_loadu_ps(&bundle.dirZ[r]);
+		// p = cross(d, eAC)
+		__m128 px = _mm_sub_ps(_mm_mul_ps(dy, acz), _mm_mul_ps(acy, dz));
+		__m128 py = _mm_sub_ps(_mm_mul_ps(dz, acx), _mm_mul_ps(acz, dx));
+		__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, acy), _mm_mul_ps(acx, dy));
+		__m128 invDenominator = _mm_div_ps(one, _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, abx), _mm_mul_ps(py, aby)), _mm_mul_ps(pz, abz)));
+
+		__m128 b1 = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, sx), _mm_mul_ps(py, sy)), _mm_mul_ps(pz, sz)), invDenominator);
+		__m128 b2 = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDenominator);
+		__m128 t = _mm_mul_ps(tNumerator, invDenominator);
+
+		__m128 hit = _mm_and_ps(_mm_cmpgt_ps(b1, negEps), _mm_cmpgt_ps(b2, negEps));
+		hit = _mm_and_ps(hit, _mm_cmplt_ps(_mm_add_ps(b1, b2), onePlusEps));
+		hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpgt_ps(t, eps), _mm_cmplt_ps(t, _mm_loadu_ps(&bundle.maxT[r]))));
+		occluded |= (RayMask)(_mm_movemask_ps(hit) & lanes) << r;
+	}
+	return occluded;
+}
+void Triangle::FillRecord(RayClass* ray, float t, float b1, float b2, RayHitObjectRecord &rhor)
+{
+	rhor.hitPoint = ray->getPoint(t);
+	rhor.hitNormal = normalize((1 - b1 - b2) * A.Normal + b1 * B.Normal + b2 * C.Normal);
+	//rhor.hitNormal = normalize(cross(eAB, eAC));
+	rhor.rDirection = ray->direction - 2 * dot(ray->direction, rhor.hitNormal) * rhor.hitNormal; // it's already normalized
+	rhor.pointColor = this->color;
+	rhor.depth = t;
 }
 void Triangle::GetBoundingBox(glm::vec3 &AA, glm::vec3 &BB)
 {
@@ -172,15 +176,27 @@ void Triangle::GetBoundingBox(glm::vec3 &AA, glm::vec3 &BB)
 #pragma region Mesh
 Mesh::Mesh(const std::vector<Triangle::Vertex> &vertices, const std::vector<int> &faces, glm::vec3 color)
 	: GeometryObject("Mesh", color)
+	, faces(faces)
 	, sKDT(NULL)
+	, wideBVH(NULL)
 {	
 	this->faceTriangles.clear();
 	for (int i = 0; i < faces.size(); i += 3)
 	{
 		this->faceTriangles.push_back(new Triangle(vertices[faces[i]], vertices[faces[i + 1]], vertices[faces[i + 2]], color));
+		this->faceTriangles.back()->faceIdx = i / 3;
 	}
 
-	this->sKDT = new SpaceKDTree(this->faceTriangles);
+	{
+		TraceScope trace("kd tree build", "load");
+		this->sKDT = new SpaceKDTree(this->faceTriangles);
+	}
+	{
+		TraceScope trace("wide bvh collapse", "load");
+		this->wideBVH = new WideBVH(this->sKDT);
+	}
+	this->AA = this->sKDT->rootNode->AA;
+	this->BB = this->sKDT->rootNode->BB;
 }
 Mesh::~Mesh()
 {
@@ -189,46 +205,119 @@ Mesh::~Mesh()
 		safe_delete(*i);
 	}
 	safe_delete(sKDT);
+	safe_delete(wideBVH);
 }
-void Mesh::RayIntersection(RayClass* ray, RayHitObjectRecord &rhor)
-{
-	SpaceKDTree::TreeNode* node = this->sKDT->rootNode;
-	HitTree(ray, node, rhor);
-}
-void Mesh::HitTree(RayClass* ray, SpaceKDTree::TreeNode* node, RayHitObjectRecord &rhor)
+bool Mesh::Intersect(RayClass* ray, RayHit &hit)
 {
-	if (RayHitAABB(ray, node->AA, node->BB))
+	float nearest = hit.t;
+	bool found = false;
+	this->wideBVH->Traverse(ray, nearest, [&](const WideBVH::Leaf &leaf)
 	{
-		if (node->triangleIdx.size() > 0)
+		float t, b1, b2;
+		for (int i = leaf.first; i < leaf.first + leaf.num; i++)
 		{
-			RayHitObjectRecord rhorT;
-			for (std::vector<int>::iterator i = node->triangleIdx.begin(); i != node->triangleIdx.end(); i++)
+			if (this->faceTriangles[i]->Intersect(ray, t, b1, b2) && t < nearest)
 			{
-				this->faceTriangles[*i]->RayIntersection(ray, rhorT);
-				if (rhorT.depth > MYEPSILON && (rhor.depth > rhorT.depth || rhor.depth < MYEPSILON))
-				{
-					rhor = rhorT;
-				}
+				nearest = t;
+				hit.t = t;
+				hit.primID = i;
+				hit.u = b1;
+				hit.v = b2;
+				found = true;
 			}
 		}
-		else
+	});
+	return found;
+}
+void Mesh::FillRecord(RayClass* ray, const RayHit &hit, RayHitObjectRecord &rhor)
+{
+	// only the nearest triangle computes its hit point, normal and reflection
+	this->faceTriangles[hit.primID]->FillRecord(ray, hit.t, hit.u, hit.v, rhor);
+}
+RayMask Mesh::Occlude(ShadowBundle &bundle, RayMask active)
+{
+	return this->wideBVH->Occlude(bundle, active, [&](const WideBVH::Leaf &leaf, RayMask mask)
+	{
+		RayMask occluded = 0;
+		for (int i = leaf.first; i < leaf.first + leaf.num && occluded != mask; i++)
+			occluded |= this->faceTriangles[i]->Occlude(bundle, mask & ~occluded);
+		return occluded;
+	});
+}
+void Mesh::GetBoundingBox(glm::vec3 &AA, glm::vec3 &BB)
+{
+	AA = this->AA;
+	BB = this->BB;
+}
+void Mesh::ReportMemory(MemoryReport &report)
+{
+	report.Add("mesh", sizeof(Mesh) + VectorBytes(this->faces) + VectorBytes(this->faceTriangles));
+	report.Add("mesh triangles", this->faceTriangles.size() * sizeof(Triangle), this->faceTriangles.size());
+	this->sKDT->ReportMemory(report);
+	this->wideBVH->ReportMemory(report);
+}
+bool Mesh::UpdateVertices(const std::vector<Triangle::Vertex> &vertices, float rebuildThreshold)
+{
+	// triangles are independent, update them in blocks
+	const int blockSize = 4096;
+	int triangleNum = this->faceTriangles.size();
+	ParallelFor((triangleNum + blockSize - 1) / blockSize, [&](int block)
+	{
+		int end = glm::min((block + 1) * blockSize, triangleNum);
+		for (int i = block * blockSize; i < end; i++)
 		{
-			HitTree(ray, node->lChild, rhor);
-			HitTree(ray, node->rChild, rhor);
+			Triangle *t = this->faceTriangles[i];
+			const int *f = &this->faces[t->faceIdx * 3];
+			t->SetVertices(vertices[f[0]], vertices[f[1]], vertices[f[2]]);
 		}
+	});
+
+	this->sKDT->Refit(this->faceTriangles);
+
+	bool rebuilt = false;
+	if (rebuildThreshold > 0 && this->sKDT->SAHCost() > this->sKDT->buildCost * rebuildThreshold)
+	{
+		safe_delete(this->sKDT);
+		this->sKDT = new SpaceKDTree(this->faceTriangles);
+		rebuilt = true;
 	}
+	this->wideBVH->Collapse(this->sKDT);
+
+	this->AA = this->sKDT->rootNode->AA;
+	this->BB = this->sKDT->rootNode->BB;
+	return rebuilt;
 }
 #pragma endregion
 
 #pragma region Model
 Model::Model(std::string modelPath, glm::vec3 color)
 	: GeometryObject("Model", color)
+	, colorRandom(std::hash<std::string>()(modelPath))
 {
-	srand(time(0));
+	this->meshes.clear();
+
+	// ply and obj go through our own memory mapped loader, assimp handles everything else
+	std::vector<Triangle::Vertex> vertices;
+	std::vector<int> faces;
+	bool loaded;
+	{
+		TraceScope trace("mesh parse", "load");
+		loaded = MeshLoader::Load(modelPath, vertices, faces);
+	}
+	if (loaded)
+	{
+		this->meshes.push_back(new Mesh(vertices, faces, NextMeshColor()));
+		UpdateBoundingBox();
+		return;
+	}
 
 	Assimp::Importer importer;
-	const aiScene* scene = importer.ReadFile(modelPath, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | 
-		aiProcess_FlipUVs | aiProcess_GenNormals | aiProcess_SplitLargeMeshes | aiProcess_OptimizeMeshes);
+	const aiScene* scene;
+	{
+		TraceScope trace("assimp import", "load");
+		scene = importer.ReadFile(modelPath, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices |
+			aiProcess_FlipUVs | aiProcess_GenNormals | aiProcess_SplitLargeMeshes | aiProcess_OptimizeMeshes);
+	}
 
 	if (!scene || scene->mFlags == AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
 	{
@@ -236,8 +325,8 @@ Model::Model(std::string modelPath, glm::vec3 color)
 		return;
 	}
 
-	this->meshes.clear();
 	this->processNode(scene->mRootNode, scene);
+	UpdateBoundingBox();
 }
 Model::~Model()
 {
@@ -246,17 +335,66 @@ Model::~Model()
 		safe_delete(*i);
 	}
 }
-void Model::RayIntersection(RayClass* Ray, RayHitObjectRecord &rhor)
+glm::vec3 Model::NextMeshColor()
+{
+	float r = colorRandom.NextFloat();
+	float g = colorRandom.NextFloat();
+	float b = colorRandom.NextFloat();
+	return glm::vec3(r, g, b);
+}
+void Model::ReportMemory(MemoryReport &report)
+{
+	report.Add("models", sizeof(Model) + VectorBytes(this->meshes));
+	for (unsigned int i = 0; i < this->meshes.size(); i++)
+		this->meshes[i]->ReportMemory(report);
+}
+void Model::UpdateBoundingBox()
+{
+	// a model that failed to load keeps an empty box
+	this->AA = glm::vec3(FLT_MAX);
+	this->BB = glm::vec3(-FLT_MAX);
+	for (unsigned int i = 0; i < meshes.size(); i++)
+	{
+		glm::vec3 AT, BT;
+		meshes[i]->GetBoundingBox(AT, BT);
+		if (i == 0)
+		{
+			this->AA = AT;
+			this->BB = BT;
+		}
+		else
+			MergeBoundingBox(this->AA, this->BB, this->AA, this->BB, AT, BT);
+	}
+}
+bool Model::Intersect(RayClass* ray, RayHit &hit)
 {
-	RayHitObjectRecord rhorT;
+	bool found = false;
 	for (unsigned int i = 0; i < meshes.size(); i++)
 	{
-		meshes[i]->RayIntersection(Ray, rhorT);
-		if (rhorT.depth > MYEPSILON && (rhor.depth > rhorT.depth || rhor.depth < MYEPSILON))
+		// each mesh only looks for hits closer than the ones before
+		if (meshes[i]->Intersect(ray, hit))
 		{
-			rhor = rhorT;
+			hit.object = i;
+			found = true;
 		}
 	}
+	return found;
+}
+void Model::FillRecord(RayClass* ray, const RayHit &hit, RayHitObjectRecord &rhor)
+{
+	this->meshes[hit.object]->FillRecord(ray, hit, rhor);
+}
+RayMask Model::Occlude(ShadowBundle &bundle, RayMask active)
+{
+	RayMask occluded = 0;
+	for (unsigned int i = 0; i < meshes.size() && occluded != active; i++)
+		occluded |= meshes[i]->Occlude(bundle, active & ~occluded);
+	return occluded;
+}
+void Model::GetBoundingBox(glm::vec3 &AA, glm::vec3 &BB)
+{
+	AA = this->AA;
+	BB = this->BB;
 }
 void Model::processNode(aiNode* node, const aiScene* scene)
 {
@@ -308,6 +446,112 @@ Mesh* Model::processMesh(aiMesh* mesh, const aiScene* scene)
 	}
 
 	//return new Mesh(vertices, faces, color);
-	return new Mesh(vertices, faces, glm::vec3(static_cast<float>(rand()) / RAND_MAX, static_cast<float>(rand()) / RAND_MAX, static_cast<float>(rand()) / RAND_MAX));
+	return new Mesh(vertices, faces, NextMeshColor());
 }
 #pragma endregion
+
+#pragma region ModelInstance
+ModelInstance::ModelInstance(Model *model, glm::mat4 transformMatrix)
+	: GeometryObject("ModelInstance", model->color)
+	, model(model)
+	, transformMatrix(transformMatrix)
+{
+	this->inverseMatrix = glm::inverse(transformMatrix);
+	this->normalMatrix = glm::transpose(glm::inverse(glm::mat3(transformMatrix)));
+	UpdateBoundingBox();
+}
+void ModelInstance::UpdateBoundingBox()
+{
+	// world space bounding box of the transformed object space box
+	glm::vec3 modelAA, modelBB;
+	this->model->GetBoundingBox(modelAA, modelBB);
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec3 corner((i & 1) ? modelBB.x : modelAA.x, (i & 2) ? modelBB.y : modelAA.y, (i & 4) ? modelBB.z : modelAA.z);
+		corner = glm::vec3(this->transformMatrix * glm::vec4(corner, 1.0f));
+		if (i == 0)
+		{
+			this->AA = corner;
+			this->BB = corner;
+		}
+		else
+			MergeBoundingBox(this->AA, this->BB, this->AA, this->BB, corner, corner);
+	}
+}
+bool ModelInstance::Intersect(RayClass* ray, RayHit &hit)
+{
+	if (!RayHitAABB(ray, this->AA, this->BB))
+		return false;
+
+	glm::vec3 localStart = glm::vec3(this->inverseMatrix * glm::vec4(ray->sPoint, 1.0f));
+	glm::vec3 localDirection = glm::vec3(this->inverseMatrix * glm::vec4(ray->direction, 0.0f));
+	// RayClass normalizes its direction, object space distances are scaled by this factor
+	float localScale = length(localDirection);
+	RayClass localRay(localStart, localDirection);
+	localRay.cost = ray->cost;
+
+	RayHit localHit;
+	localHit.t = hit.t * localScale;
+	if (!this->model->Intersect(&localRay, localHit))
+		return false;
+	float t = localHit.t / localScale;
+	if (t <= MYEPSILON || t >= hit.t)
+		return false;
+	hit = localHit;
+	hit.t = t;
+	return true;
+}
+void ModelInstance::FillRecord(RayClass* ray, const RayHit &hit, RayHitObjectRecord &rhor)
+{
+	glm::vec3 localStart = glm::vec3(this->inverseMatrix * glm::vec4(ray->sPoint, 1.0f));
+	glm::vec3 localDirection = glm::vec3(this->inverseMatrix * glm::vec4(ray->direction, 0.0f));
+	float localScale = length(localDirection);
+	RayClass localRay(localStart, localDirection);
+
+	RayHit localHit = hit;
+	localHit.t = hit.t * localScale;
+	RayHitObjectRecord localRecord;
+	this->model->FillRecord(&localRay, localHit, localRecord);
+
+	rhor.depth = hit.t;
+	rhor.hitPoint = ray->getPoint(rhor.depth);
+	rhor.hitNormal = normalize(this->normalMatrix * localRecord.hitNormal);
+	rhor.rDirection = ray->direction - 2 * dot(ray->direction, rhor.hitNormal) * rhor.hitNormal; // it's already normalized
+	rhor.pointColor = localRecord.pointColor;
+}
+RayMask ModelInstance::Occlude(ShadowBundle &bundle, RayMask active)
+{
+	ShadowBundle localBundle(glm::vec3(this->inverseMatrix * glm::vec4(bundle.origin, 1.0f)));
+	localBundle.cost = bundle.cost;
+	int bundleRay[ShadowBundle::MAX_RAYS]; // the ray of bundle each local ray stands for
+	for (int r = 0; r < bundle.Size(); r++)
+	{
+		if (!((active >> r) & 1) || !RayHitAABB(&bundle.rays[r], this->AA, this->BB))
+			continue;
+		glm::vec3 localDirection = glm::vec3(this->inverseMatrix * glm::vec4(bundle.rays[r].direction, 0.0f));
+		// object space distances are scaled like in Intersect
+		bundleRay[localBundle.Size()] = r;
+		localBundle.Add(localDirection, bundle.maxT[r] * length(localDirection));
+	}
+	if (localBundle.Size() == 0)
+		return 0;
+
+	RayMask localOccluded = this->model->Occlude(localBundle, localBundle.AllRays());
+	RayMask occluded = 0;
+	for (int i = 0; i < localBundle.Size(); i++)
+	{
+		if ((localOccluded >> i) & 1)
+			occluded |= (RayMask)1 << bundleRay[i];
+	}
+	return occluded;
+}
+void ModelInstance::GetBoundingBox(glm::vec3 &AA, glm::vec3 &BB)
+{
+	AA = this->AA;
+	BB = this->BB;
+}
+void ModelInstance::ReportMemory(MemoryReport &report)
+{
+	report.Add("model instances", sizeof(ModelInstance));
+}
+#pragma endregion
\ No newline at end of file
@@ -10,6 +10,8 @@
 
 #include "rayTracingCamera.h"
 #include "spaceKDTree.h"
+#include "wideBVH.h"
+#include "memoryReport.h"
 #include "Utils.h"
 
 // saved data of each hit point and reflection direction
@@ -41,6 +43,14 @@ struct RayHitObjectRecord
 	glm::vec3 pointColor;
 };
 
+// the minimal result of an intersection test, the full record is built once for the hit that is kept
+struct RayHit
+{
+	float t;
+	int object; // mesh of a model
+	int primID;
+	float u, v; // barycentrics for triangles
+};
 
 // parent class
 class GeometryObject
@@ -49,11 +59,25 @@ public:
 	GeometryObject(std::string typeName, glm::vec3 color);
 	virtual ~GeometryObject(){};
 
-	virtual void RayIntersection(RayClass*, RayHitObjectRecord&) = 0;
+	// the nearest hit closer than hit.t, which it replaces, false if there is none. hit only keeps what
+	// FillRecord needs to find the primitive again
+	virtual bool Intersect(RayClass* ray, RayHit &hit) = 0;
+	// the full record of a hit Intersect found for the same ray
+	virtual void FillRecord(RayClass* ray, const RayHit &hit, RayHitObjectRecord &rhor) = 0;
+
+	// Intersect and FillRecord in one, depth is -1 without a hit
+	void RayIntersection(RayClass* ray, RayHitObjectRecord &rhor);
+
+	// the rays of active that hit the object closer than their maxT, one Intersect per ray unless the
+	// object can test the shared origin bundle at once
+	virtual RayMask Occlude(ShadowBundle &bundle, RayMask active);
 
 	// we need to save the bounding box to accerlerate the ray hit test
 	virtual void GetBoundingBox(glm::vec3 &AA, glm::vec3 &BB) = 0;
 
+	// add the object and everything it owns to the report
+	virtual void ReportMemory(MemoryReport &report);
+
 	// void getMaterial();
 
 	std::string typeName;
@@ -62,39 +86,6 @@ public:
 	//glm::mat4 transformMatrix;
 };
 
-class Sphere : public GeometryObject
-{
-public:
-	Sphere(glm::vec3 center, float radius, glm::vec3 color = glm::vec3(1, 1, 1));
-	virtual ~Sphere(){};
-
-	virtual void RayIntersection(RayClass* ray, RayHitObjectRecord &rhor) override;
-
-	virtual void GetBoundingBox(glm::vec3 &AA, glm::vec3 &BB) override;
-
-private:
-	glm::vec3 center;
-	float radius;
-};
-
-class Plane : public GeometryObject
-{
-public:
-	Plane(float A, float B, float C, float D, glm::vec3 color = glm::vec3(1, 1, 1));
-	virtual ~Plane(){};
-
-	virtual void RayIntersection(RayClass* ray, RayHitObjectRecord &rhor) override;
-
-	virtual void GetBoundingBox(glm::vec3 &AA, glm::vec3 &BB) override;
-
-	glm::vec3 normal;
-
-private:
-	// Ax + By + Cz + D = 0;
-	glm::vec3 ABC;
-	float D;
-};
-
 class Triangle : public GeometryObject
 {
 public:
@@ -107,11 +98,23 @@ public:
 	Triangle(const Vertex &A, const Vertex &B, const Vertex &C, glm::vec3 color = glm::vec3(1, 1, 1));
 	virtual ~Triangle(){};
 
-	virtual void RayIntersection(RayClass* ray, RayHitObjectRecord &rhor) override;
+	virtual bool Intersect(RayClass* ray, RayHit &hit) override;
+	virtual void FillRecord(RayClass* ray, const RayHit &hit, RayHitObjectRecord &rhor) override;
+
+	// distance and barycentrics only, meshes test many triangles per ray and fill one record at the end
+	bool Intersect(RayClass* ray, float &t, float &b1, float &b2);
+	void FillRecord(RayClass* ray, float t, float b1, float b2, RayHitObjectRecord &rhor);
+
+	// Intersect for 4 rays of active at a time, the terms that only depend on the shared origin are computed once
+	virtual RayMask Occlude(ShadowBundle &bundle, RayMask active) override;
 
 	virtual void GetBoundingBox(glm::vec3 &AA, glm::vec3 &BB) override;
 
+	// move the corners, the bounding box and bary center follow
+	void SetVertices(const Vertex &A, const Vertex &B, const Vertex &C);
+
 	glm::vec3 baryCenter;
+	int faceIdx; // index of the face in its mesh, the kd tree reorders the triangles
 
 private:
 	Vertex A, B, C;
@@ -124,11 +127,21 @@ public:
 	Mesh(const std::vector<Triangle::Vertex> &vertices, const std::vector<int> &faces, glm::vec3 color = glm::vec3(1, 1, 1));
 	virtual ~Mesh();
 
-	virtual void RayIntersection(RayClass* Ray, RayHitObjectRecord &rhor) override;
+	// traverses the wide bvh, the kd tree is only kept to refit and collapse it again
+	virtual bool Intersect(RayClass* ray, RayHit &hit) override;
+	virtual void FillRecord(RayClass* ray, const RayHit &hit, RayHitObjectRecord &rhor) override;
+
+	// one wide bvh traversal for the whole bundle
+	virtual RayMask Occlude(ShadowBundle &bundle, RayMask active) override;
+
+	virtual void GetBoundingBox(glm::vec3 &AA, glm::vec3 &BB) override;
 
-	void HitTree(RayClass* ray, SpaceKDTree::TreeNode* node, RayHitObjectRecord &rhor);
+	// move the vertices of a deforming mesh, vertices has the layout the mesh was created with. the kd tree
+	// is refitted in parallel, and rebuilt only when rebuildThreshold > 0 and its SAH cost grew past
+	// rebuildThreshold times the cost of a fresh build. returns true if it was rebuilt
+	bool UpdateVertices(const std::vector<Triangle::Vertex> &vertices, float rebuildThreshold = 0);
 
-	virtual void GetBoundingBox(glm::vec3 &AA, glm::vec3 &BB) override { /*to do*/ };
+	virtual void ReportMemory(MemoryReport &report) override;
 
 	inline static bool SortByX(const Triangle *t1, const Triangle *t2)
 	{
@@ -145,7 +158,9 @@ public:
 
 private:
 	std::vector<Triangle*> faceTriangles;
+	std::vector<int> faces; // vertex indices, 3 per face
 	SpaceKDTree* sKDT;
+	WideBVH* wideBVH;
 };
 
 class Model : public GeometryObject
@@ -154,13 +169,58 @@ public:
 	Model(std::string modelPath, glm::vec3 color = glm::vec3(1, 1, 1));
 	virtual ~Model();
 
-	virtual void RayIntersection(RayClass* Ray, RayHitObjectRecord &rhor) override;
+	// hit.object is the mesh that was hit
+	virtual bool Intersect(RayClass* ray, RayHit &hit) override;
+	virtual void FillRecord(RayClass* ray, const RayHit &hit, RayHitObjectRecord &rhor) override;
 
-	virtual void GetBoundingBox(glm::vec3 &AA, glm::vec3 &BB) override { /*to do*/ };
+	virtual RayMask Occlude(ShadowBundle &bundle, RayMask active) override;
+
+	virtual void GetBoundingBox(glm::vec3 &AA, glm::vec3 &BB) override;
+
+	// deforming models update their meshes directly, then merge the mesh boxes again
+	int getMeshNum()			{ return this->meshes.size(); }
+	Mesh* getMesh(int i)		{ return this->meshes[i]; }
+	void UpdateBoundingBox();
+
+	virtual void ReportMemory(MemoryReport &report) override;
 
 private:
 	void processNode(aiNode* node, const aiScene* scene);
 	Mesh* processMesh(aiMesh* mesh, const aiScene* scene);
 
+	// meshes get a random color, seeded by the model path so every load looks the same
+	glm::vec3 NextMeshColor();
+	PCG32 colorRandom;
+
 	std::vector<Mesh*> meshes;
+};
+
+// one placement of a shared model, the instance only keeps its transform and a pointer to the model,
+// so the mesh and its kd tree are built once however many times the model is placed
+class ModelInstance : public GeometryObject
+{
+public:
+	ModelInstance(Model *model, glm::mat4 transformMatrix);
+	virtual ~ModelInstance(){};
+
+	// the ray is moved into object space and the hit distance is moved back, FillRecord moves the ray again
+	// and only turns the normal of the model's record into world space
+	virtual bool Intersect(RayClass* ray, RayHit &hit) override;
+	virtual void FillRecord(RayClass* ray, const RayHit &hit, RayHitObjectRecord &rhor) override;
+
+	// the bundle is moved into object space as a whole, its origin is still shared there
+	virtual RayMask Occlude(ShadowBundle &bundle, RayMask active) override;
+
+	virtual void GetBoundingBox(glm::vec3 &AA, glm::vec3 &BB) override;
+
+	// recompute the world box after the model was deformed
+	void UpdateBoundingBox();
+
+	// only the instance itself, the model is reported by the library that owns it
+	virtual void ReportMemory(MemoryReport &report) override;
+
+private:
+	Model *model; // owned by the scene's model library, not by the instance
+	glm::mat4 transformMatrix, inverseMatrix;
+	glm::mat3 normalMatrix;
 };
\ No newline at end of file
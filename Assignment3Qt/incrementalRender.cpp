@@ -0,0 +1,200 @@
+#include "incrementalRender.h"
+
+#include <algorithm>
+
+#include "traceLog.h"
+
+using namespace std;
+
+namespace
+{
+	// the float intersection tests lose precision far from the origin, a shadow ray from a plane hit thousands
+	// of units away can report a sphere it passes at a distance of this ratio of its coordinates
+	const float FAR_HIT_TOLERANCE = 1e-3f;
+}
+
+IncrementalRenderer::IncrementalRenderer(int tileSize, int threadNum)
+	: tileSize(glm::max(tileSize, 1))
+	, threadNum(glm::max(threadNum, 1))
+	, w(0)
+	, h(0)
+	, tileCountX(0)
+	, settingsKey(0)
+{
+}
+
+void IncrementalRenderer::Reset()
+{
+	this->tiles.clear();
+	this->framebuffer.clear();
+	this->lastObjects.clear();
+}
+
+int IncrementalRenderer::Render(SceneData *sceneData, RayTracer *rayTracer, glm::vec3 cameraPos, glm::vec3 cameraLookat, const QTInputParam &qtIP, vector<glm::vec3> &pixels)
+{
+	rayTracer->SetIrradianceCache(0);
+
+	float view[6] = { cameraPos.x, cameraPos.y, cameraPos.z, cameraLookat.x, cameraLookat.y, cameraLookat.z };
+	int settings[4] = { qtIP.resolutionW, qtIP.resolutionH, qtIP.antiAliasingLevel, (int)rayTracer->SampleSeed() };
+	unsigned long long key = HashBytes(view, sizeof(view), sceneData->lightKey);
+	key = HashBytes(settings, sizeof(settings), key);
+	key = HashBytes(&qtIP.lightCutError, sizeof(qtIP.lightCutError), key);
+
+	RayTracingCameraClass *camera = CreateRenderCamera(cameraPos, cameraLookat, qtIP);
+	const int W = camera->getW(), H = camera->getH();
+	this->tileCountX = (W + this->tileSize - 1) / this->tileSize;
+	const int tileNum = this->tileCountX * ((H + this->tileSize - 1) / this->tileSize);
+
+	vector<bool> dirty(tileNum, true);
+	if (key == this->settingsKey && W == this->w && H == this->h && (int)this->tiles.size() == tileNum)
+		this->FindDirtyTiles(sceneData->objectInfo, dirty);
+	else
+	{
+		this->tiles.assign(tileNum, Tile());
+		this->framebuffer.assign(W * H, glm::vec3(0.0f));
+	}
+	this->settingsKey = key;
+	this->w = W;
+	this->h = H;
+
+	vector<int> dirtyTiles;
+	for (int i = 0; i < tileNum; i++)
+		if (dirty[i])
+			dirtyTiles.push_back(i);
+
+	ParallelFor(dirtyTiles.size(), [&](int taskIdx)
+	{
+		TraceScope trace("incremental tile");
+		int tileIdx = dirtyTiles[taskIdx];
+		int x0 = (tileIdx % this->tileCountX) * this->tileSize, y0 = (tileIdx / this->tileCountX) * this->tileSize;
+		int x1 = glm::min(x0 + this->tileSize, W), y1 = glm::min(y0 + this->tileSize, H);
+
+		RayDependency deps;
+		for (int row = y0; row < y1; row++)
+		{
+			rayTracer->RenderPixels(camera, row, x0, x1, &this->framebuffer[row * W + x0], NULL, &deps);
+			// hits of one row repeat a lot, keep the list short
+			sort(deps.objects.begin(), deps.objects.end());
+			deps.objects.erase(unique(deps.objects.begin(), deps.objects.end()), deps.objects.end());
+		}
+
+		Tile &tile = this->tiles[tileIdx];
+		tile.objects.resize(deps.objects.size());
+		for (unsigned int i = 0; i < deps.objects.size(); i++)
+			tile.objects[i] = sceneData->objectInfo[deps.objects[i]].key;
+		sort(tile.objects.begin(), tile.objects.end());
+		deps.objects.clear();
+		deps.objects.shrink_to_fit();
+		tile.bounds = deps;
+	}, this->threadNum);
+	safe_delete(camera);
+
+	this->lastObjects.clear();
+	for (vector<SceneObjectInfo>::const_iterator i = sceneData->objectInfo.begin(); i != sceneData->objectInfo.end(); i++)
+		this->lastObjects[i->key] = *i;
+
+	pixels = this->framebuffer;
+	return (int)dirtyTiles.size();
+}
+
+void IncrementalRenderer::FindDirtyTiles(const vector<SceneObjectInfo> &objects, vector<bool> &dirty) const
+{
+	// removed and recolored objects change the tiles that hit them
+	vector<unsigned long long> changed;
+	vector<const SceneObjectInfo*> added;
+	map<unsigned long long, const SceneObjectInfo*> current;
+	for (vector<SceneObjectInfo>::const_iterator i = objects.begin(); i != objects.end(); i++)
+	{
+		current[i->key] = &*i;
+		map<unsigned long long, SceneObjectInfo>::const_iterator last = this->lastObjects.find(i->key);
+		if (last == this->lastObjects.end())
+			added.push_back(&*i);
+		else if (last->second.colorKey != i->colorKey)
+			changed.push_back(i->key);
+	}
+	for (map<unsigned long long, SceneObjectInfo>::const_iterator i = this->lastObjects.begin(); i != this->lastObjects.end(); i++)
+		if (current.find(i->first) == current.end())
+			changed.push_back(i->first);
+	sort(changed.begin(), changed.end());
+
+	for (unsigned int t = 0; t < this->tiles.size(); t++)
+	{
+		const Tile &tile = this->tiles[t];
+		bool isDirty = false;
+
+		// both lists are sorted
+		vector<unsigned long long>::const_iterator a = tile.objects.begin(), b = changed.begin();
+		while (!isDirty && a != tile.objects.end() && b != changed.end())
+		{
+			if (*a < *b)
+				a++;
+			else if (*b < *a)
+				b++;
+			else
+				isDirty = true;
+		}
+
+		// an added object changes rays that pass through its bounds
+		for (unsigned int i = 0; !isDirty && i < added.size(); i++)
+			isDirty = RaysReach(tile.bounds, added[i]->boundMin, added[i]->boundMax);
+
+		dirty[t] = isDirty;
+	}
+}
+
+bool IncrementalRenderer::RaysReach(const RayDependency &bounds, glm::vec3 boxMin, glm::vec3 boxMax)
+{
+	// MYEPSILON covers the offset rays start at from a surface
+	glm::vec3 farthest = glm::max(glm::max(glm::abs(bounds.boundMin), glm::abs(bounds.boundMax)),
+		glm::max(glm::abs(bounds.escapeOriginMin), glm::abs(bounds.escapeOriginMax)));
+	float scale = 0;
+	for (int i = 0; i < 3; i++)
+		if (farthest[i] < FLT_MAX)
+			scale = glm::max(scale, farthest[i]);
+	boxMin -= glm::vec3(MYEPSILON + FAR_HIT_TOLERANCE * scale);
+	boxMax += glm::vec3(MYEPSILON + FAR_HIT_TOLERANCE * scale);
+
+	// segments stay inside their box
+	if (bounds.boundMin.x <= boxMax.x && boxMin.x <= bounds.boundMax.x &&
+		bounds.boundMin.y <= boxMax.y && boxMin.y <= bounds.boundMax.y &&
+		bounds.boundMin.z <= boxMax.z && boxMin.z <= bounds.boundMax.z)
+		return true;
+
+	// an escaping ray at distance t is in [originMin + t * dirMin, originMax + t * dirMax] on every axis, the
+	// box is out of reach when no t >= 0 overlaps it on all three
+	if (bounds.escapeOriginMin.x > bounds.escapeOriginMax.x)
+		return false;
+	float tLow = 0, tHigh = FLT_MAX;
+	for (int i = 0; i < 3; i++)
+	{
+		float oLow = bounds.escapeOriginMin[i], oHigh = bounds.escapeOriginMax[i];
+		float dLow = bounds.escapeDirMin[i], dHigh = bounds.escapeDirMax[i];
+
+		// the lowest reach must stay below boxMax
+		if (dLow > 0)
+			tHigh = glm::min(tHigh, (boxMax[i] - oLow) / dLow);
+		else if (dLow < 0)
+			tLow = glm::max(tLow, (boxMax[i] - oLow) / dLow);
+		else if (oLow > boxMax[i])
+			return false;
+
+		// and the highest above boxMin
+		if (dHigh < 0)
+			tHigh = glm::min(tHigh, (boxMin[i] - oHigh) / dHigh);
+		else if (dHigh > 0)
+			tLow = glm::max(tLow, (boxMin[i] - oHigh) / dHigh);
+		else if (oHigh < boxMin[i])
+			return false;
+	}
+	return tLow <= tHigh;
+}
+
+void IncrementalRenderer::ReportMemory(MemoryReport &report) const
+{
+	size_t objectBytes = 0;
+	for (vector<Tile>::const_iterator i = this->tiles.begin(); i != this->tiles.end(); i++)
+		objectBytes += VectorBytes(i->objects);
+	report.Add("incremental tiles", VectorBytes(this->tiles) + objectBytes, this->tiles.size());
+	report.Add("incremental framebuffer", VectorBytes(this->framebuffer));
+	report.Add("incremental objects", this->lastObjects.size() * (sizeof(SceneObjectInfo) + sizeof(unsigned long long) + 4 * sizeof(void*)), this->lastObjects.size());
+}
@@ -0,0 +1,55 @@
+// re-rendering an edited scene by tracing only the tiles the edit could have changed
+#pragma once
+
+#include <vector>
+#include <map>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "rayTracer.h"
+
+// keeps the last image with, per tile, the objects its primary, reflection and shadow rays hit and a box
+// around every segment they traced. on the next Render the scene's objects are compared by key with the last
+// one: tiles that hit a removed or recolored object are traced again, and so are tiles with a ray that could
+// pass through an added object's bounds, since a new object can only change those. a moved object is a
+// removed one plus an added one. anything that changes every pixel, the view, the resolution, the lights or
+// the settings, traces the whole image
+class IncrementalRenderer
+{
+public:
+	IncrementalRenderer(int tileSize = 32, int threadNum = MYTHREADNUM);
+	~IncrementalRenderer(){};
+
+	// pixels receives the whole image, the number of tiles traced is returned. irradiance cache records are
+	// shared between tiles without their dependencies, so the tracer's cache is turned off. sceneData has to be
+	// loaded withObjectInfo
+	int Render(SceneData *sceneData, RayTracer *rayTracer, glm::vec3 cameraPos, glm::vec3 cameraLookat, const QTInputParam &qtIP, std::vector<glm::vec3> &pixels);
+
+	int TileNum() const { return (int)this->tiles.size(); }
+
+	// forget the last image, the next Render traces everything
+	void Reset();
+
+	void ReportMemory(MemoryReport &report) const;
+
+private:
+	struct Tile
+	{
+		std::vector<unsigned long long> objects; // keys, sorted
+		RayDependency bounds; // without its objects
+	};
+
+	// conservative, false only if no ray of the tile can reach the box
+	static bool RaysReach(const RayDependency &bounds, glm::vec3 boxMin, glm::vec3 boxMax);
+
+	// true for the tiles an edit from lastObjects to objects could change
+	void FindDirtyTiles(const std::vector<SceneObjectInfo> &objects, std::vector<bool> &dirty) const;
+
+	int tileSize, threadNum;
+	int w, h, tileCountX;
+	// everything besides the objects that the image depends on
+	unsigned long long settingsKey;
+	std::vector<Tile> tiles;
+	std::vector<glm::vec3> framebuffer;
+	std::map<unsigned long long, SceneObjectInfo> lastObjects;
+};
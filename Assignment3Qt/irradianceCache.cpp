@@ -0,0 +1,162 @@
+#include "irradianceCache.h"
+
+#include <cmath>
+
+#include "Utils.h"
+
+namespace
+{
+	const int MAX_OCTREE_DEPTH = 20;
+}
+
+IrradianceCache::OctreeNode::OctreeNode()
+{
+	for (int i = 0; i < 8; i++)
+		children[i] = NULL;
+}
+
+IrradianceCache::OctreeNode::~OctreeNode()
+{
+	for (int i = 0; i < 8; i++)
+		safe_delete(children[i]);
+}
+
+IrradianceCache::IrradianceCache(float tolerance, float minRadius, float maxRadius, glm::vec3 center, float halfSize)
+	: tolerance(tolerance)
+	, minRadius(minRadius)
+	, maxRadius(maxRadius)
+	, center(center)
+	, halfSize(halfSize)
+	, recordNum(0)
+	, recordBytes(0)
+	, octreeBytes(sizeof(OctreeNode))
+	, octreeNodeNum(1)
+{
+	this->root = new OctreeNode();
+}
+
+IrradianceCache::~IrradianceCache()
+{
+	safe_delete(this->root);
+}
+
+int IrradianceCache::RecordNum()
+{
+	return this->recordNum;
+}
+
+void IrradianceCache::ReportMemory(MemoryReport &report)
+{
+	report.Add("irradiance cache records", sizeof(IrradianceCache) + this->recordBytes, this->recordNum);
+	report.Add("irradiance cache octree", this->octreeBytes, this->octreeNodeNum);
+}
+
+bool IrradianceCache::Lookup(glm::vec3 pos, glm::vec3 normal, glm::vec3 &irradiance)
+{
+	glm::vec3 offset = pos - this->center;
+	if (glm::abs(offset.x) > this->halfSize || glm::abs(offset.y) > this->halfSize || glm::abs(offset.z) > this->halfSize)
+		return false;
+
+	glm::vec3 weightedSum(0.0f);
+	float weightSum = 0;
+
+	QReadLocker lock(&this->cacheLock);
+	OctreeNode *node = this->root;
+	glm::vec3 nodeCenter = this->center;
+	float nodeHalfSize = this->halfSize;
+	while (node)
+	{
+		for (unsigned int i = 0; i < node->recordIdx.size(); i++)
+		{
+			const Record &r = this->records[node->recordIdx[i]];
+
+			float normalDot = dot(normal, r.normal);
+			if (normalDot <= 0)
+				continue;
+
+			// a record in front of the point sees different geometry
+			glm::vec3 d = pos - r.pos;
+			if (dot(d, r.normal + normal) < -0.1f * r.radius)
+				continue;
+
+			float error = length(d) / r.radius + sqrt(glm::max(0.0f, 1.0f - normalDot));
+			if (error >= this->tolerance)
+				continue;
+
+			// ward's weight shifted to reach 0 at the tolerance, so records fade out instead of popping
+			float weight = 1.0f / glm::max(error, 1e-4f) - 1.0f / this->tolerance;
+
+			// rotational gradient: the irradiance changes as the record's normal turns into ours
+			glm::vec3 axis = cross(r.normal, normal);
+			glm::vec3 e = r.irradiance + glm::vec3(dot(axis, r.rotationalGradient[0]), dot(axis, r.rotationalGradient[1]), dot(axis, r.rotationalGradient[2]));
+			weightedSum += weight * glm::max(e, glm::vec3(0.0f));
+			weightSum += weight;
+		}
+
+		nodeHalfSize *= 0.5f;
+		int child = 0;
+		if (pos.x > nodeCenter.x) { child |= 1; nodeCenter.x += nodeHalfSize; } else nodeCenter.x -= nodeHalfSize;
+		if (pos.y > nodeCenter.y) { child |= 2; nodeCenter.y += nodeHalfSize; } else nodeCenter.y -= nodeHalfSize;
+		if (pos.z > nodeCenter.z) { child |= 4; nodeCenter.z += nodeHalfSize; } else nodeCenter.z -= nodeHalfSize;
+		node = node->children[child];
+	}
+
+	if (weightSum <= 0)
+		return false;
+	irradiance = weightedSum / weightSum;
+	return true;
+}
+
+void IrradianceCache::Add(glm::vec3 pos, glm::vec3 normal, glm::vec3 irradiance, const glm::vec3 rotationalGradient[3], float radius)
+{
+	glm::vec3 offset = pos - this->center;
+	if (glm::abs(offset.x) > this->halfSize || glm::abs(offset.y) > this->halfSize || glm::abs(offset.z) > this->halfSize)
+		return;
+
+	Record r;
+	r.pos = pos;
+	r.normal = normal;
+	r.irradiance = irradiance;
+	for (int c = 0; c < 3; c++)
+		r.rotationalGradient[c] = rotationalGradient[c];
+	r.radius = glm::clamp(radius, this->minRadius, this->maxRadius);
+
+	// the record is never used further away than tolerance * radius
+	float influence = this->tolerance * r.radius;
+
+	QWriteLocker lock(&this->cacheLock);
+	this->records.push_back(r);
+	AddToNode(this->root, this->center, this->halfSize, 0, this->records.size() - 1, pos - influence, pos + influence, influence);
+	this->recordBytes = VectorBytes(this->records);
+	this->recordNum = this->records.size();
+}
+
+void IrradianceCache::AddToNode(OctreeNode *node, glm::vec3 nodeCenter, float nodeHalfSize, int depth, int idx, glm::vec3 AA, glm::vec3 BB, float influence)
+{
+	if (nodeHalfSize < 2.0f * influence || depth == MAX_OCTREE_DEPTH)
+	{
+		size_t bytes = VectorBytes(node->recordIdx);
+		node->recordIdx.push_back(idx);
+		this->octreeBytes += VectorBytes(node->recordIdx) - bytes;
+		return;
+	}
+
+	float childHalfSize = nodeHalfSize * 0.5f;
+	for (int child = 0; child < 8; child++)
+	{
+		glm::vec3 childCenter = nodeCenter + glm::vec3((child & 1) ? childHalfSize : -childHalfSize,
+			(child & 2) ? childHalfSize : -childHalfSize, (child & 4) ? childHalfSize : -childHalfSize);
+		if (AA.x > childCenter.x + childHalfSize || BB.x < childCenter.x - childHalfSize ||
+			AA.y > childCenter.y + childHalfSize || BB.y < childCenter.y - childHalfSize ||
+			AA.z > childCenter.z + childHalfSize || BB.z < childCenter.z - childHalfSize)
+			continue;
+
+		if (!node->children[child])
+		{
+			node->children[child] = new OctreeNode();
+			this->octreeBytes += sizeof(OctreeNode);
+			this->octreeNodeNum++;
+		}
+		AddToNode(node->children[child], childCenter, childHalfSize, depth + 1, idx, AA, BB, influence);
+	}
+}
@@ -0,0 +1,66 @@
+// ward style irradiance cache: diffuse lighting is computed at sparse surface points and interpolated
+// for hits near them with a similar normal
+#pragma once
+
+#include <QReadWriteLock>
+
+#include <vector>
+#include <atomic>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "memoryReport.h"
+
+class IrradianceCache
+{
+public:
+	// tolerance is the largest accepted error (distance / radius + sqrt(1 - normal similarity)), a bigger
+	// value reuses records further away. the harmonic mean distance of a record is clamped to
+	// [minRadius, maxRadius], points outside the box of halfSize around center are never cached
+	IrradianceCache(float tolerance, float minRadius = 0.05f, float maxRadius = 2.0f, glm::vec3 center = glm::vec3(0), float halfSize = 1024.0f);
+	~IrradianceCache();
+
+	// interpolate the irradiance at (pos, normal) from the records valid there, false if there is none
+	bool Lookup(glm::vec3 pos, glm::vec3 normal, glm::vec3 &irradiance);
+
+	// rotationalGradient[c] is the change of channel c when the normal is rotated around an axis,
+	// radius the harmonic mean distance of the geometry seen from pos
+	void Add(glm::vec3 pos, glm::vec3 normal, glm::vec3 irradiance, const glm::vec3 rotationalGradient[3], float radius);
+
+	int RecordNum();
+
+	void ReportMemory(MemoryReport &report);
+
+private:
+	struct Record
+	{
+		glm::vec3 pos, normal, irradiance;
+		glm::vec3 rotationalGradient[3];
+		float radius;
+	};
+
+	struct OctreeNode
+	{
+		OctreeNode();
+		~OctreeNode();
+
+		OctreeNode *children[8];
+		std::vector<int> recordIdx;
+	};
+
+	// a record goes into every node its area of influence overlaps, at the level where the nodes are not
+	// much larger than that area, so a lookup only checks the nodes on the path to the point
+	void AddToNode(OctreeNode *node, glm::vec3 nodeCenter, float nodeHalfSize, int depth, int idx, glm::vec3 AA, glm::vec3 BB, float influence);
+
+	float tolerance, minRadius, maxRadius;
+	glm::vec3 center;
+	float halfSize;
+
+	OctreeNode *root;
+	std::vector<Record> records;
+	// guards root and records, lookups from every render thread share it and only Add takes it alone
+	QReadWriteLock cacheLock;
+	// kept up to date by Add, so counting and memory reports never wait for the lookups
+	std::atomic<int> recordNum;
+	std::atomic<size_t> recordBytes, octreeBytes, octreeNodeNum;
+};
@@ -1,6 +1,7 @@
 #include "lightSource.h"
 
 #include "Utils.h"
+#include "traceLog.h"
 
 // stb_image, Reference: https://github.com/nothings/stb/blob/master/stb_image.h#L4
 #define STB_IMAGE_IMPLEMENTATION
@@ -8,8 +9,47 @@
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <queue>
+
 bool hasHDRLighting;
 
+namespace
+{
+	// the largest cut taken for one shading point, the rest of the error is accepted
+	const int MAX_LIGHT_CUT = 1024;
+
+	float MaxComponent(glm::vec3 v)
+	{
+		return glm::max(glm::max(v.x, v.y), v.z);
+	}
+
+	// upper bound of dot(normal, direction to p) over every p in the box, negative when the whole box is
+	// below the horizon of sPoint
+	float MaxCosineToBox(glm::vec3 sPoint, glm::vec3 normal, glm::vec3 AA, glm::vec3 BB)
+	{
+		// the largest height above the tangent plane is at a corner
+		glm::vec3 corner(normal.x > 0 ? BB.x : AA.x, normal.y > 0 ? BB.y : AA.y, normal.z > 0 ? BB.z : AA.z);
+		float maxHeight = dot(normal, corner - sPoint);
+		if (maxHeight <= 0)
+			return -1;
+
+		glm::vec3 nearest = glm::clamp(sPoint, AA, BB);
+		float minDis = length(nearest - sPoint);
+		if (minDis < MYEPSILON)
+			return 1;
+		return glm::min(1.0f, maxHeight / minDis);
+	}
+
+	struct CutEntry
+	{
+		int cluster;
+		float error;
+		glm::vec3 estimate;
+
+		bool operator<(const CutEntry &other) const { return error < other.error; }
+	};
+}
+
 #pragma region PointLight
 PointLight::PointLight(glm::vec3 pos, glm::vec3 color)
 	: color(color)
@@ -30,6 +70,10 @@ void PointLight::RayIntersection(RayClass* ray, RayHitObjectRecord &rhor)
 	rhor.pointColor = glm::vec3(0, 0, 0);
 	rhor.depth = -1;
 }
+void PointLight::ReportMemory(MemoryReport &report)
+{
+	report.Add("point lights", sizeof(PointLight));
+}
 #pragma endregion
 
 #pragma region AreaLight
@@ -78,6 +122,12 @@ void AreaLight::RayIntersection(RayClass* ray, RayHitObjectRecord &rhor)
 	rhor.pointColor = glm::vec3(0, 0, 0);
 	rhor.depth = -1;
 }
+void AreaLight::ReportMemory(MemoryReport &report)
+{
+	report.Add("area lights", sizeof(AreaLight) + VectorBytes(this->pointSamples));
+	for (unsigned int i = 0; i < this->pointSamples.size(); i++)
+		this->pointSamples[i]->ReportMemory(report);
+}
 #pragma endregion
 
 #pragma region SquareMap
@@ -93,14 +143,20 @@ SquareMap::SquareMap(glm::vec3 **data, int n, glm::vec3 ulCorner, glm::vec3 dRig
 	this->normal = normalize(cross(dDown, dRight));
 	this->D = -dot(ulCorner, normal);
 
-	this->quadT = new QuadTree(data, n, size);
+	{
+		TraceScope trace("quad tree build", "load");
+		this->quadT = new QuadTree(data, n, size);
+	}
 
+	TraceScope trace("light samples", "load");
 	for (unsigned int i = 0; i < quadT->areaColor.size(); i++)
 	{
 		glm::vec3 pos;
 		pos = ulCorner + (dRight * (float)quadT->posRC[i][1] + dDown * (float)quadT->posRC[i][0]) * (size / n);
 		this->lightSamples.push_back(new AreaLight(quadT->sizeWH[i], quadT->resoWH[i], pos, quadT->areaColor[i], dRight, dDown));
 	}
+
+	this->rootCluster = BuildCluster(0);
 }
 SquareMap::~SquareMap()
 {
@@ -125,80 +181,125 @@ void SquareMap::GetLight(glm::vec3 sPoint, std::vector<glm::vec3> &colorList, st
 		this->lightSamples[i]->GetLight(sPoint, colorList, disList, lightDirList);
 	}
 }
-void SquareMap::RayIntersection(RayClass* ray, RayHitObjectRecord &rhor)
+int SquareMap::BuildCluster(int quadNode)
 {
-	glm::vec3 sp = ray->sPoint;
-	glm::vec3 d = ray->direction;
-	
-	float denominator = dot(this->normal, d);
-	float numerator = -this->D - dot(this->normal, sp);
-
-	float t = numerator / denominator;
-	while (t > MYEPSILON)
+	std::vector<int> children;
+	const QuadTree::Node &node = this->quadT->nodes[quadNode];
+	if (node.leafIdx >= 0)
+	{
+		// every point sample of the area is a single sample cluster
+		const std::vector<PointLight*> &samples = this->lightSamples[node.leafIdx]->getPointSamples();
+		for (unsigned int i = 0; i < samples.size(); i++)
+		{
+			LightCluster sample;
+			sample.AA = sample.BB = sample.repPos = samples[i]->getPos();
+			sample.power = samples[i]->getColor();
+			sample.repIntensity = MaxComponent(sample.power);
+			sample.sampleNum = 1;
+			children.push_back(this->clusters.size());
+			this->clusters.push_back(sample);
+		}
+	}
+	else
 	{
-		glm::vec3 hitPoint = ray->getPoint(t);
 		for (int i = 0; i < 4; i++)
 		{
-			glm::vec3 &e = glm::vec3();
-			glm::vec3 n;
-			glm::vec3 &n_ = glm::vec3();
+			int child = BuildCluster(node.child[i]);
+			if (child >= 0)
+				children.push_back(child);
+		}
+	}
 
-			switch (i)
-			{
-			case 0:
-				e = this->dDown;
-				n_ = hitPoint - ulCorner;
-				break;
-			case 1:
-				e = this->dRight;
-				n_ = hitPoint - ulCorner - dDown * size;
-				break;
-			case 2:
-				e = -this->dDown;
-				n_ = hitPoint - ulCorner - dDown * size - dRight * size;
-				break;
-			case 3:
-				e = -this->dRight;
-				n_ = hitPoint - ulCorner - dRight * size;
-				break;
-			}
-			n = cross(this->normal, e);
+	if (children.empty())
+		return -1;
+	if (children.size() == 1)
+		return children[0];
 
-			if (dot(n, n_) < 0)
-			{
-				rhor.hitPoint = glm::vec3(0, 0, 0);
-				rhor.hitNormal = glm::vec3(0, 0, 0);
-				rhor.rDirection = glm::vec3(0, 0, 0);
-				rhor.pointColor = glm::vec3(0, 0, 0);
-				rhor.depth = -1;
-				return;
-			}
+	LightCluster cluster;
+	cluster.power = glm::vec3(0.0f);
+	cluster.repIntensity = -1;
+	cluster.sampleNum = 0;
+	for (unsigned int i = 0; i < children.size(); i++)
+	{
+		const LightCluster &child = this->clusters[children[i]];
+		if (i == 0)
+		{
+			cluster.AA = child.AA;
+			cluster.BB = child.BB;
 		}
+		else
+			MergeBoundingBox(cluster.AA, cluster.BB, cluster.AA, cluster.BB, child.AA, child.BB);
+		cluster.power += child.power;
+		cluster.sampleNum += child.sampleNum;
+		if (child.repIntensity > cluster.repIntensity)
+		{
+			cluster.repIntensity = child.repIntensity;
+			cluster.repPos = child.repPos;
+		}
+	}
+	cluster.children = children;
+	this->clusters.push_back(cluster);
+	return this->clusters.size() - 1;
+}
+int SquareMap::GetLightCut(glm::vec3 sPoint, glm::vec3 normal, float errorRatio, std::vector<glm::vec3> &colorList, std::vector<float> &disList, std::vector<glm::vec3> &lightDirList)
+{
+	if (this->rootCluster < 0)
+		return 0;
 
-		rhor.hitPoint = ray->getPoint(t);
-		rhor.hitNormal = this->normal;
-		rhor.rDirection = ray->direction - 2 * dot(ray->direction, rhor.hitNormal) * rhor.hitNormal; // it's already normalized
-		
-		float wCoord = dot((rhor.hitPoint - ulCorner), dRight) / size * n;
-		float hCoord = dot((rhor.hitPoint - ulCorner), dDown) / size * n;
-
-		if ((int)wCoord < 0) wCoord = 0.0f;
-		if ((int)wCoord >= n - 2) wCoord = (float)(n - 2);
-		if ((int)hCoord < 0) hCoord = 0.0f;
-		if ((int)hCoord >= n - 2) hCoord = (float)(n - 2);
-
-		float ww1 = wCoord - floor(wCoord);
-		float ww2 = 1.0f - ww1;
-		float wh1 = hCoord - floor(hCoord);
-		float wh2 = 1.0f - wh1;
-		
-		glm::vec3 color = data[(int)hCoord][(int)wCoord] * ww2 * wh2 +
-			data[(int)hCoord][(int)wCoord + 1] * ww1 * wh2 +
-			data[(int)hCoord + 1][(int)wCoord] * ww2 * wh1 +
-			data[(int)hCoord + 1][(int)wCoord + 1] * ww1 * wh1;
+	// every cut entry has the unshadowed estimate through its representative and a bound of its error
+	std::priority_queue<CutEntry> cut;
+	glm::vec3 total(0.0f);
+	int cutSize = 0;
+
+	std::vector<int> expand(1, this->rootCluster);
+	while (true)
+	{
+		for (unsigned int i = 0; i < expand.size(); i++)
+		{
+			const LightCluster &cluster = this->clusters[expand[i]];
+			float maxCos = cluster.sampleNum == 1 ? dot(normal, normalize(cluster.repPos - sPoint)) : MaxCosineToBox(sPoint, normal, cluster.AA, cluster.BB);
+			if (maxCos <= 0)
+				continue; // below the horizon, none of its samples can light the point
+
+			CutEntry entry;
+			entry.cluster = expand[i];
+			entry.estimate = cluster.power * glm::max(dot(normal, normalize(cluster.repPos - sPoint)), 0.0f);
+			// a single sample is exact up to its visibility
+			entry.error = cluster.children.empty() ? 0 : MaxComponent(cluster.power) * maxCos;
+			total += entry.estimate;
+			cut.push(entry);
+			cutSize++;
+		}
+		expand.clear();
+
+		if (cut.empty())
+			break;
+		CutEntry worst = cut.top();
+		if (worst.error <= errorRatio * MaxComponent(total) || cutSize + 3 > MAX_LIGHT_CUT)
+			break;
 
-		rhor.pointColor = color;
-		rhor.depth = t;
+		cut.pop();
+		cutSize--;
+		total -= worst.estimate;
+		expand = this->clusters[worst.cluster].children;
+	}
+
+	for (; !cut.empty(); cut.pop())
+	{
+		const LightCluster &cluster = this->clusters[cut.top().cluster];
+		colorList.push_back(cluster.power);
+		disList.push_back(length(cluster.repPos - sPoint));
+		lightDirList.push_back(normalize(cluster.repPos - sPoint));
+	}
+
+	return this->clusters[this->rootCluster].sampleNum;
+}
+void SquareMap::RayIntersection(RayClass* ray, RayHitObjectRecord &rhor)
+{
+	float t;
+	if (Intersect(ray, t))
+	{
+		FillRecord(ray, t, rhor);
 		return;
 	}
 
@@ -208,14 +309,104 @@ void SquareMap::RayIntersection(RayClass* ray, RayHitObjectRecord &rhor)
 	rhor.pointColor = glm::vec3(0, 0, 0);
 	rhor.depth = -1;
 }
+void SquareMap::ReportMemory(MemoryReport &report)
+{
+	report.Add("cube map texels", this->n * (sizeof(glm::vec3*) + this->n * sizeof(glm::vec3)));
+	this->quadT->ReportMemory(report);
+
+	size_t clusterBytes = VectorBytes(this->clusters);
+	for (unsigned int i = 0; i < this->clusters.size(); i++)
+		clusterBytes += VectorBytes(this->clusters[i].children);
+	report.Add("light clusters", clusterBytes, this->clusters.size());
+
+	report.Add("cube map faces", sizeof(SquareMap) + VectorBytes(this->lightSamples));
+	for (unsigned int i = 0; i < this->lightSamples.size(); i++)
+		this->lightSamples[i]->ReportMemory(report);
+}
+bool SquareMap::Intersect(RayClass* ray, float &t)
+{
+	glm::vec3 sp = ray->sPoint;
+	glm::vec3 d = ray->direction;
+	
+	float denominator = dot(this->normal, d);
+	float numerator = -this->D - dot(this->normal, sp);
+
+	t = numerator / denominator;
+	if (!(t > MYEPSILON))
+		return false;
+
+	// inside all 4 edges of the square
+	glm::vec3 hitPoint = ray->getPoint(t);
+	for (int i = 0; i < 4; i++)
+	{
+		glm::vec3 e, n_;
+		switch (i)
+		{
+		case 0:
+			e = this->dDown;
+			n_ = hitPoint - ulCorner;
+			break;
+		case 1:
+			e = this->dRight;
+			n_ = hitPoint - ulCorner - dDown * size;
+			break;
+		case 2:
+			e = -this->dDown;
+			n_ = hitPoint - ulCorner - dDown * size - dRight * size;
+			break;
+		case 3:
+			e = -this->dRight;
+			n_ = hitPoint - ulCorner - dRight * size;
+			break;
+		}
+		glm::vec3 n = cross(this->normal, e);
+
+		if (dot(n, n_) < 0)
+			return false;
+	}
+
+	return true;
+}
+void SquareMap::FillRecord(RayClass* ray, float t, RayHitObjectRecord &rhor)
+{
+	rhor.hitPoint = ray->getPoint(t);
+	rhor.hitNormal = this->normal;
+	rhor.rDirection = ray->direction - 2 * dot(ray->direction, rhor.hitNormal) * rhor.hitNormal; // it's already normalized
+	rhor.pointColor = Lookup(rhor.hitPoint);
+	rhor.depth = t;
+}
+glm::vec3 SquareMap::Lookup(glm::vec3 point)
+{
+	float wCoord = dot((point - ulCorner), dRight) / size * n;
+	float hCoord = dot((point - ulCorner), dDown) / size * n;
+
+	if ((int)wCoord < 0) wCoord = 0.0f;
+	if ((int)wCoord >= n - 2) wCoord = (float)(n - 2);
+	if ((int)hCoord < 0) hCoord = 0.0f;
+	if ((int)hCoord >= n - 2) hCoord = (float)(n - 2);
+
+	float ww1 = wCoord - floor(wCoord);
+	float ww2 = 1.0f - ww1;
+	float wh1 = hCoord - floor(hCoord);
+	float wh2 = 1.0f - wh1;
+		
+	return data[(int)hCoord][(int)wCoord] * ww2 * wh2 +
+		data[(int)hCoord][(int)wCoord + 1] * ww1 * wh2 +
+		data[(int)hCoord + 1][(int)wCoord] * ww2 * wh1 +
+		data[(int)hCoord + 1][(int)wCoord + 1] * ww1 * wh1;
+}
 #pragma endregion
 
 #pragma region CubeMap
 CubeMap::CubeMap(std::string cubeMapPath, float size)
 	: loadImage(NULL)
+	, size(size)
 {
 	hasHDRLighting = stbi_is_hdr(cubeMapPath.c_str());
-	loadImage = stbi_loadf(cubeMapPath.c_str(), &width, &height, &dimension, 0);
+	{
+		TraceScope trace("hdr decode", "load");
+		loadImage = stbi_loadf(cubeMapPath.c_str(), &width, &height, &dimension, 0);
+	}
 	N = width > height ? width / 4 : height / 4;
 	
 	if (dimension != 3)	
@@ -249,8 +440,19 @@ CubeMap::~CubeMap()
 	safe_delete(forward);
 	safe_delete(backward);
 }
+void CubeMap::ReportMemory(MemoryReport &report)
+{
+	report.Add("cube maps", sizeof(CubeMap));
+	this->top->ReportMemory(report);
+	this->bottom->ReportMemory(report);
+	this->left->ReportMemory(report);
+	this->right->ReportMemory(report);
+	this->forward->ReportMemory(report);
+	this->backward->ReportMemory(report);
+}
 void CubeMap::ExtractSquareMap(SquareMap *&sm, int idx, int rowIdx, int colIdx, bool rowInverse, bool colInverse, float size)
 {
+	TraceScope trace("extract square map", "load");
 	glm::vec3 **area = new glm::vec3*[N];
 	for (int i = 0; i < N; i++)
 		area[i] = new glm::vec3[N];
@@ -331,21 +533,52 @@ void CubeMap::GetLight(glm::vec3 sPoint, std::vector<glm::vec3> &colorList, std:
 	this->forward->GetLight(sPoint, colorList, disList, lightDirList);
 	this->backward->GetLight(sPoint, colorList, disList, lightDirList);
 }
+int CubeMap::GetLightCut(glm::vec3 sPoint, glm::vec3 normal, float errorRatio, std::vector<glm::vec3> &colorList, std::vector<float> &disList, std::vector<glm::vec3> &lightDirList)
+{
+	// the same faces as GetLight, each face cuts its own tree
+	int sampleNum = 0;
+	sampleNum += this->top->GetLightCut(sPoint, normal, errorRatio, colorList, disList, lightDirList);
+	sampleNum += this->left->GetLightCut(sPoint, normal, errorRatio, colorList, disList, lightDirList);
+	sampleNum += this->right->GetLightCut(sPoint, normal, errorRatio, colorList, disList, lightDirList);
+	sampleNum += this->forward->GetLightCut(sPoint, normal, errorRatio, colorList, disList, lightDirList);
+	sampleNum += this->backward->GetLightCut(sPoint, normal, errorRatio, colorList, disList, lightDirList);
+	return sampleNum;
+}
 void CubeMap::RayIntersection(RayClass* ray, RayHitObjectRecord &rhor)
 {
-	RayHitObjectRecord rhorT;
-	for (int i = 0; i < 5; i++)
+	glm::vec3 d = ray->direction;
+	glm::vec3 absD = glm::abs(d);
+
+	// the face the direction points at and its component along that axis
+	SquareMap *face;
+	float major;
+	if (absD.x >= absD.y && absD.x >= absD.z)
 	{
-		SquareMap *p;
-		if (i == 0) p = this->top;
-		else if (i == 1) p = this->left;
-		else if (i == 2) p = this->right;
-		else if (i == 3) p = this->forward;
-		else if (i == 4) p = this->backward;
-
-		p->RayIntersection(ray, rhorT);
-		if (rhorT.depth > MYEPSILON && (rhor.depth > rhorT.depth || rhor.depth < MYEPSILON))
-			rhor = rhorT;
+		face = d.x > 0 ? this->right : this->left;
+		major = absD.x;
 	}
+	else if (absD.y >= absD.z)
+	{
+		face = d.y > 0 ? this->top : this->bottom;
+		major = absD.y;
+	}
+	else
+	{
+		face = d.z > 0 ? this->backward : this->forward;
+		major = absD.z;
+	}
+
+	if (!(major > 0))
+	{
+		rhor.depth = -1;
+		return;
+	}
+
+	// where the direction leaves a cube of the map's size around the origin
+	rhor.pointColor = face->Lookup(d * (this->size / 2.0f / major));
+	rhor.depth = MYINFINITE;
+	rhor.hitPoint = ray->getPoint(rhor.depth);
+	rhor.hitNormal = -d;
+	rhor.rDirection = -d;
 }
 #pragma endregion
\ No newline at end of file
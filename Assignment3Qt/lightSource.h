@@ -16,7 +16,19 @@ public:
 
 	virtual void GetLight(glm::vec3 sPoint, std::vector<glm::vec3> &colorList, std::vector<float> &disList, std::vector<glm::vec3> &lightDirList) = 0;
 
+	// like GetLight for a surface point with the given normal, but a cluster of samples may come back as one
+	// sample carrying their summed color. returns the number of samples represented, which normalizes the
+	// diffuse sum the same way the list size of GetLight does
+	virtual int GetLightCut(glm::vec3 sPoint, glm::vec3 /*normal*/, float /*errorRatio*/, std::vector<glm::vec3> &colorList, std::vector<float> &disList, std::vector<glm::vec3> &lightDirList)
+	{
+		GetLight(sPoint, colorList, disList, lightDirList);
+		return lightDirList.size();
+	}
+
 	virtual void RayIntersection(RayClass*, RayHitObjectRecord&) = 0;
+
+	// add the light and its samples to the report
+	virtual void ReportMemory(MemoryReport &report) = 0;
 };
 
 // a voxel point light, will a vexel be toooooo big?
@@ -30,6 +42,11 @@ public:
 
 	virtual void RayIntersection(RayClass*, RayHitObjectRecord&) override;
 
+	virtual void ReportMemory(MemoryReport &report) override;
+
+	glm::vec3 getPos()		{ return this->pos; }
+	glm::vec3 getColor()	{ return this->color; }
+
 private:
 	glm::vec3 color, pos;
 };
@@ -44,6 +61,10 @@ public:
 
 	virtual void RayIntersection(RayClass*, RayHitObjectRecord&) override;
 
+	virtual void ReportMemory(MemoryReport &report) override;
+
+	const std::vector<PointLight*>& getPointSamples() { return this->pointSamples; }
+
 private:
 	glm::vec3 unitColor, pos, normal;
 	float w, h;
@@ -58,8 +79,21 @@ public:
 
 	virtual void GetLight(glm::vec3, std::vector<glm::vec3>&, std::vector<float>&, std::vector<glm::vec3>&) override;
 
+	// walks the cluster tree from the root, always refining the cluster with the largest error bound until
+	// every bound is below errorRatio times the estimated total. clusters below the horizon are dropped
+	virtual int GetLightCut(glm::vec3 sPoint, glm::vec3 normal, float errorRatio, std::vector<glm::vec3>&, std::vector<float>&, std::vector<glm::vec3>&) override;
+
 	virtual void RayIntersection(RayClass*, RayHitObjectRecord&) override;
 
+	virtual void ReportMemory(MemoryReport &report) override;
+
+	// distance only, the cube map fills the record of the nearest face once
+	bool Intersect(RayClass* ray, float &t);
+	void FillRecord(RayClass* ray, float t, RayHitObjectRecord &rhor);
+
+	// bilinear texel fetch at a point on the face
+	glm::vec3 Lookup(glm::vec3 point);
+
 private:
 	glm::vec3 **data;
 	int n;
@@ -69,6 +103,22 @@ private:
 	float D;
 	QuadTree* quadT;
 	std::vector<AreaLight*> lightSamples;
+
+	// light hierarchy over the point samples: the quad tree nodes, then the area lights' samples as leaves
+	struct LightCluster
+	{
+		glm::vec3 AA, BB;	// box of the sample positions
+		glm::vec3 power;	// summed sample colors
+		glm::vec3 repPos;	// the brightest sample stands for the cluster
+		float repIntensity;
+		int sampleNum;
+		std::vector<int> children;
+	};
+	std::vector<LightCluster> clusters;
+	int rootCluster; // -1 when the map has no sample
+
+	// returns the cluster index, -1 for a quad node without samples
+	int BuildCluster(int quadNode);
 };
 
 class CubeMap : public LightBase
@@ -80,11 +130,18 @@ public:
 
 	virtual void GetLight(glm::vec3, std::vector<glm::vec3>&, std::vector<float>&, std::vector<glm::vec3>&) override;
 
+	virtual int GetLightCut(glm::vec3 sPoint, glm::vec3 normal, float errorRatio, std::vector<glm::vec3>&, std::vector<float>&, std::vector<glm::vec3>&) override;
+
+	// the map is at infinity: the face comes from the major axis of the direction, no plane is tested and
+	// the record gets a depth every object is in front of
 	virtual void RayIntersection(RayClass*, RayHitObjectRecord&) override;
 
+	virtual void ReportMemory(MemoryReport &report) override;
+
 private:
 	float *loadImage;
 	int width, height, dimension, N;
+	float size;
 	SquareMap *top;
 	SquareMap *bottom;
 	SquareMap *left;
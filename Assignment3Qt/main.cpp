@@ -1,8 +1,54 @@
 #include "assignment3qt.h"
 #include <QtWidgets/QApplication>
+#include <QCoreApplication>
+#include <cstring>
+
+#include "tileCoordinator.h"
+#include "batchRender.h"
+#include "benchmark.h"
 
 int main(int argc, char *argv[])
 {
+	// headless tile worker started by a TileCoordinator
+	if (argc > 1 && strcmp(argv[1], "--worker") == 0)
+	{
+		QCoreApplication a(argc, argv);
+		return RunTileWorker(argc, argv);
+	}
+
+	// render a camera path to numbered images without the window
+	if (argc > 1 && strcmp(argv[1], "--animate") == 0)
+	{
+		QCoreApplication a(argc, argv);
+		return RunAnimation(argc, argv);
+	}
+
+	// a single image that resumes from its checkpoint when restarted
+	if (argc > 1 && strcmp(argv[1], "--render") == 0)
+	{
+		QCoreApplication a(argc, argv);
+		return RunRender(argc, argv);
+	}
+
+	// posters too large for memory, streamed to a tiled tiff
+	if (argc > 1 && strcmp(argv[1], "--poster") == 0)
+	{
+		QCoreApplication a(argc, argv);
+		return RunPoster(argc, argv);
+	}
+
+	// stress scenes and the thread scaling benchmark
+	if (argc > 1 && strcmp(argv[1], "--generate") == 0)
+	{
+		QCoreApplication a(argc, argv);
+		return RunGenerate(argc, argv);
+	}
+	if (argc > 1 && strcmp(argv[1], "--benchmark") == 0)
+	{
+		QCoreApplication a(argc, argv);
+		return RunBenchmark(argc, argv);
+	}
+
 	QApplication a(argc, argv);
 	Assignment3Qt w;
 	w.show();
@@ -0,0 +1,47 @@
+#include "memoryReport.h"
+
+#include <algorithm>
+#include <cstdio>
+
+void MemoryReport::Add(const std::string &subsystem, size_t bytes, size_t objectNum)
+{
+	std::map<std::string, Entry>::iterator i = this->entries.find(subsystem);
+	if (i == this->entries.end())
+	{
+		Entry entry = { bytes, objectNum };
+		this->entries[subsystem] = entry;
+	}
+	else
+	{
+		i->second.bytes += bytes;
+		i->second.objectNum += objectNum;
+	}
+}
+
+size_t MemoryReport::TotalBytes() const
+{
+	size_t total = 0;
+	for (std::map<std::string, Entry>::const_iterator i = this->entries.begin(); i != this->entries.end(); i++)
+		total += i->second.bytes;
+	return total;
+}
+
+std::string MemoryReport::ToString() const
+{
+	std::vector<std::pair<size_t, std::string> > order;
+	for (std::map<std::string, Entry>::const_iterator i = this->entries.begin(); i != this->entries.end(); i++)
+		order.push_back(std::make_pair(i->second.bytes, i->first));
+	std::sort(order.rbegin(), order.rend());
+
+	std::string text;
+	char line[256];
+	for (unsigned int i = 0; i < order.size(); i++)
+	{
+		const Entry &entry = this->entries.find(order[i].second)->second;
+		sprintf(line, "%-24s %10lu objects %10.2f MB\n", order[i].second.c_str(), (unsigned long)entry.objectNum, entry.bytes / 1048576.0);
+		text += line;
+	}
+	sprintf(line, "%-24s %29.2f MB\n", "total", TotalBytes() / 1048576.0);
+	text += line;
+	return text;
+}
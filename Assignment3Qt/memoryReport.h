@@ -0,0 +1,32 @@
+// bytes and object counts per subsystem. the scene, the lights and the tracer walk their own data and add it
+// to a report on request, so nothing is counted on the render paths and a report is always current
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+
+class MemoryReport
+{
+public:
+	void Add(const std::string &subsystem, size_t bytes, size_t objectNum = 1);
+
+	size_t TotalBytes() const;
+
+	// one line per subsystem with its objects and MB, largest first, then the total
+	std::string ToString() const;
+
+private:
+	struct Entry
+	{
+		size_t bytes, objectNum;
+	};
+	std::map<std::string, Entry> entries;
+};
+
+// heap bytes held by a vector, what it reserved and not only what it uses
+template <typename T>
+size_t VectorBytes(const std::vector<T> &v)
+{
+	return v.capacity() * sizeof(T);
+}
@@ -0,0 +1,863 @@
+#include "meshLoader.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "Utils.h"
+#include "textParse.h"
+
+#pragma region MappedFile
+MappedFile::MappedFile()
+	: data(NULL)
+	, size(0)
+#ifdef _WIN32
+	, fileHandle(INVALID_HANDLE_VALUE)
+	, mappingHandle(NULL)
+#else
+	, fd(-1)
+#endif
+{
+}
+MappedFile::~MappedFile()
+{
+	Close();
+}
+bool MappedFile::Open(const std::string &path)
+{
+	Close();
+#ifdef _WIN32
+	fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+	size = static_cast<size_t>(fileSize.QuadPart);
+	mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mappingHandle == NULL)
+	{
+		Close();
+		return false;
+	}
+	data = static_cast<const char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+#else
+	fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		Close();
+		return false;
+	}
+	size = static_cast<size_t>(st.st_size);
+	void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p != MAP_FAILED)
+	{
+		madvise(p, size, MADV_SEQUENTIAL);
+		data = static_cast<const char*>(p);
+	}
+#endif
+	if (data == NULL)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (data)
+		UnmapViewOfFile(data);
+	if (mappingHandle)
+		CloseHandle(mappingHandle);
+	if (fileHandle != INVALID_HANDLE_VALUE)
+		CloseHandle(fileHandle);
+	mappingHandle = NULL;
+	fileHandle = INVALID_HANDLE_VALUE;
+#else
+	if (data)
+		munmap(const_cast<char*>(data), size);
+	if (fd >= 0)
+		close(fd);
+	fd = -1;
+#endif
+	data = NULL;
+	size = 0;
+}
+#pragma endregion
+
+// parsing helpers that split the mapped file for the parallel parse
+namespace
+{
+	// cut [begin, end) into chunkNum pieces that start at the beginning of a line
+	void SplitLines(const char *begin, const char *end, int chunkNum, std::vector<const char*> &bounds)
+	{
+		bounds.resize(chunkNum + 1);
+		bounds[0] = begin;
+		for (int i = 1; i < chunkNum; i++)
+		{
+			const char *p = begin + (end - begin) * i / chunkNum;
+			p = std::max(p, bounds[i - 1]);
+			bounds[i] = (p == begin) ? begin : NextLine(p - 1, end);
+		}
+		bounds[chunkNum] = end;
+	}
+
+	#pragma region PLY
+	enum PlyType { PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64, PLY_UNKNOWN };
+
+	PlyType ParsePlyType(const std::string &name)
+	{
+		if (name == "char" || name == "int8") return PLY_INT8;
+		if (name == "uchar" || name == "uint8") return PLY_UINT8;
+		if (name == "short" || name == "int16") return PLY_INT16;
+		if (name == "ushort" || name == "uint16") return PLY_UINT16;
+		if (name == "int" || name == "int32") return PLY_INT32;
+		if (name == "uint" || name == "uint32") return PLY_UINT32;
+		if (name == "float" || name == "float32") return PLY_FLOAT32;
+		if (name == "double" || name == "float64") return PLY_FLOAT64;
+		return PLY_UNKNOWN;
+	}
+
+	int PlyTypeSize(PlyType type)
+	{
+		static const int sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8, 0 };
+		return sizes[type];
+	}
+
+	double ReadPlyScalar(const char *p, PlyType type, bool swap)
+	{
+		unsigned char buf[8];
+		int n = PlyTypeSize(type);
+		for (int i = 0; i < n; i++)
+			buf[i] = swap ? p[n - 1 - i] : p[i];
+
+		switch (type)
+		{
+		case PLY_INT8:		return *reinterpret_cast<signed char*>(buf);
+		case PLY_UINT8:		return *reinterpret_cast<unsigned char*>(buf);
+		case PLY_INT16:		{ short v; memcpy(&v, buf, 2); return v; }
+		case PLY_UINT16:	{ unsigned short v; memcpy(&v, buf, 2); return v; }
+		case PLY_INT32:		{ int v; memcpy(&v, buf, 4); return v; }
+		case PLY_UINT32:	{ unsigned int v; memcpy(&v, buf, 4); return v; }
+		case PLY_FLOAT32:	{ float v; memcpy(&v, buf, 4); return v; }
+		case PLY_FLOAT64:	{ double v; memcpy(&v, buf, 8); return v; }
+		default:			return 0;
+		}
+	}
+
+	struct PlyProperty
+	{
+		std::string name;
+		PlyType type;
+		bool isList;
+		PlyType countType;
+	};
+
+	struct PlyElement
+	{
+		std::string name;
+		int count;
+		std::vector<PlyProperty> properties;
+
+		// byte size of one binary record, -1 when the element contains a list
+		int Stride() const
+		{
+			int stride = 0;
+			for (unsigned int i = 0; i < properties.size(); i++)
+			{
+				if (properties[i].isList)
+					return -1;
+				stride += PlyTypeSize(properties[i].type);
+			}
+			return stride;
+		}
+		int Find(const char *propertyName) const
+		{
+			for (unsigned int i = 0; i < properties.size(); i++)
+				if (properties[i].name == propertyName)
+					return i;
+			return -1;
+		}
+	};
+
+	inline bool IsIndexList(const PlyProperty &prop)
+	{
+		return prop.isList && (prop.name == "vertex_indices" || prop.name == "vertex_index");
+	}
+
+	// skip one binary record of an element that contains lists, returns NULL if the file is truncated
+	const char* SkipPlyRecord(const PlyElement &element, const char *p, const char *end, bool swap)
+	{
+		for (unsigned int i = 0; i < element.properties.size() && p; i++)
+		{
+			const PlyProperty &prop = element.properties[i];
+			if (prop.isList)
+			{
+				if (p + PlyTypeSize(prop.countType) > end)
+					return NULL;
+				int n = static_cast<int>(ReadPlyScalar(p, prop.countType, swap));
+				p += PlyTypeSize(prop.countType) + n * PlyTypeSize(prop.type);
+			}
+			else
+				p += PlyTypeSize(prop.type);
+			if (p > end)
+				return NULL;
+		}
+		return p;
+	}
+
+	// fan triangulation of one polygon
+	inline void AppendPolygon(const int *idx, int n, std::vector<int> &faces)
+	{
+		for (int k = 2; k < n; k++)
+		{
+			faces.push_back(idx[0]);
+			faces.push_back(idx[k - 1]);
+			faces.push_back(idx[k]);
+		}
+	}
+	#pragma endregion
+
+	#pragma region OBJ
+	// everything one thread found in its piece of an obj file
+	struct ObjChunk
+	{
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec3> normals;
+		// two entries per triangle corner (position, normal), negative obj indices are stored relative to
+		// this chunk and resolved once the number of elements in the previous chunks is known
+		std::vector<int> corners;
+		std::vector<unsigned char> relative; // bit 0: position is relative, bit 1: normal is relative
+		bool missingNormal;
+		bool failed;
+
+		ObjChunk() : missingNormal(false), failed(false) {}
+	};
+
+	const int OBJ_NO_INDEX = -2147483647 - 1;
+
+	// "v", "v/vt", "v//vn" or "v/vt/vn"
+	bool ParseObjCorner(const char *&p, const char *end, const ObjChunk &chunk, int &v, int &n, unsigned char &rel)
+	{
+		rel = 0;
+		n = OBJ_NO_INDEX;
+		if (!ParseInt(p, end, v) || v == 0)
+			return false;
+		if (v < 0) { v += static_cast<int>(chunk.positions.size()); rel |= 1; }
+		else v -= 1;
+
+		if (p < end && *p == '/')
+		{
+			p++;
+			int vt;
+			if (p < end && *p != '/' && !ParseInt(p, end, vt))
+				return false;
+			if (p < end && *p == '/')
+			{
+				p++;
+				if (!ParseInt(p, end, n) || n == 0)
+					return false;
+				if (n < 0) { n += static_cast<int>(chunk.normals.size()); rel |= 2; }
+				else n -= 1;
+			}
+		}
+		return true;
+	}
+
+	void ParseObjChunk(const char *p, const char *end, ObjChunk &chunk)
+	{
+		std::vector<int> polyV, polyN;
+		std::vector<unsigned char> polyRel;
+
+		while (p < end && !chunk.failed)
+		{
+			const char *lineEnd = NextLine(p, end);
+			SkipBlank(p, lineEnd);
+
+			if (lineEnd - p > 2 && p[0] == 'v' && IsBlank(p[1]))
+			{
+				glm::vec3 v;
+				p++;
+				if (!ParseFloat(p, lineEnd, v.x) || !ParseFloat(p, lineEnd, v.y) || !ParseFloat(p, lineEnd, v.z))
+					chunk.failed = true;
+				chunk.positions.push_back(v);
+			}
+			else if (lineEnd - p > 3 && p[0] == 'v' && p[1] == 'n' && IsBlank(p[2]))
+			{
+				glm::vec3 n;
+				p += 2;
+				if (!ParseFloat(p, lineEnd, n.x) || !ParseFloat(p, lineEnd, n.y) || !ParseFloat(p, lineEnd, n.z))
+					chunk.failed = true;
+				chunk.normals.push_back(n);
+			}
+			else if (lineEnd - p > 2 && p[0] == 'f' && IsBlank(p[1]))
+			{
+				p++;
+				polyV.clear();
+				polyN.clear();
+				polyRel.clear();
+				SkipBlank(p, lineEnd);
+				while (p < lineEnd && *p != '\n')
+				{
+					int v, n;
+					unsigned char rel;
+					if (!ParseObjCorner(p, lineEnd, chunk, v, n, rel))
+					{
+						chunk.failed = true;
+						break;
+					}
+					polyV.push_back(v);
+					polyN.push_back(n);
+					polyRel.push_back(rel);
+					SkipBlank(p, lineEnd);
+				}
+				for (unsigned int k = 2; k < polyV.size(); k++)
+				{
+					unsigned int fan[3] = { 0, k - 1, k };
+					for (int c = 0; c < 3; c++)
+					{
+						chunk.corners.push_back(polyV[fan[c]]);
+						chunk.corners.push_back(polyN[fan[c]]);
+						chunk.relative.push_back(polyRel[fan[c]]);
+						if (polyN[fan[c]] == OBJ_NO_INDEX)
+							chunk.missingNormal = true;
+					}
+				}
+			}
+			// vt, vp, o, g, s, l, usemtl, mtllib and comments are of no use to the ray tracer
+
+			p = lineEnd;
+		}
+	}
+	#pragma endregion
+}
+
+#pragma region MeshLoader
+bool MeshLoader::Load(const std::string &path, std::vector<Triangle::Vertex> &vertices, std::vector<int> &faces)
+{
+	std::string ext;
+	size_t dot = path.find_last_of('.');
+	if (dot != std::string::npos)
+		ext = path.substr(dot + 1);
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+	if (ext != "ply" && ext != "obj")
+		return false;
+
+	MappedFile file;
+	if (!file.Open(path))
+		return false;
+
+	vertices.clear();
+	faces.clear();
+	bool ok = (ext == "ply") ? LoadPLY(file.data, file.size, vertices, faces) : LoadOBJ(file.data, file.size, vertices, faces);
+	if (!ok || faces.empty())
+	{
+		vertices.clear();
+		faces.clear();
+		return false;
+	}
+	return true;
+}
+
+bool MeshLoader::LoadPLY(const char *data, size_t size, std::vector<Triangle::Vertex> &vertices, std::vector<int> &faces)
+{
+	const char *end = data + size;
+	const char *p = data;
+
+	// the header is tiny, parse it sequentially
+	enum { ASCII, BINARY_LE, BINARY_BE } format = ASCII;
+	std::vector<PlyElement> elements;
+	bool hasFormat = false, hasEnd = false;
+	for (int lineNum = 0; p < end && !hasEnd; lineNum++)
+	{
+		const char *lineEnd = NextLine(p, end);
+		std::string line(p, lineEnd);
+		p = lineEnd;
+		while (!line.empty() && (line.back() == '\n' || line.back() == '\r'))
+			line.pop_back();
+
+		std::vector<std::string> tokens;
+		for (size_t s = 0, e; s < line.size(); s = e + 1)
+		{
+			e = line.find(' ', s);
+			if (e == std::string::npos)
+				e = line.size();
+			if (e > s)
+				tokens.push_back(line.substr(s, e - s));
+		}
+
+		if (lineNum == 0)
+		{
+			if (line != "ply")
+				return false;
+		}
+		else if (tokens.empty() || tokens[0] == "comment" || tokens[0] == "obj_info")
+			continue;
+		else if (tokens[0] == "format" && tokens.size() >= 2)
+		{
+			hasFormat = true;
+			if (tokens[1] == "ascii") format = ASCII;
+			else if (tokens[1] == "binary_little_endian") format = BINARY_LE;
+			else if (tokens[1] == "binary_big_endian") format = BINARY_BE;
+			else return false;
+		}
+		else if (tokens[0] == "element" && tokens.size() == 3)
+		{
+			PlyElement element;
+			element.name = tokens[1];
+			element.count = atoi(tokens[2].c_str());
+			if (element.count < 0)
+				return false;
+			elements.push_back(element);
+		}
+		else if (tokens[0] == "property" && !elements.empty())
+		{
+			PlyProperty prop;
+			prop.isList = tokens.size() == 5 && tokens[1] == "list";
+			if (prop.isList)
+			{
+				prop.countType = ParsePlyType(tokens[2]);
+				prop.type = ParsePlyType(tokens[3]);
+				prop.name = tokens[4];
+				if (prop.countType == PLY_UNKNOWN)
+					return false;
+			}
+			else if (tokens.size() == 3)
+			{
+				prop.countType = PLY_UNKNOWN;
+				prop.type = ParsePlyType(tokens[1]);
+				prop.name = tokens[2];
+			}
+			else
+				return false;
+			if (prop.type == PLY_UNKNOWN)
+				return false;
+			elements.back().properties.push_back(prop);
+		}
+		else if (tokens[0] == "end_header")
+			hasEnd = true;
+		else
+			return false;
+	}
+	if (!hasFormat || !hasEnd)
+		return false;
+
+	int vertexElem = -1, faceElem = -1;
+	for (unsigned int i = 0; i < elements.size(); i++)
+	{
+		if (elements[i].name == "vertex") vertexElem = i;
+		else if (elements[i].name == "face") faceElem = i;
+	}
+	if (vertexElem < 0 || faceElem < 0)
+		return false;
+	const PlyElement &vElem = elements[vertexElem];
+	const PlyElement &fElem = elements[faceElem];
+	int px = vElem.Find("x"), py = vElem.Find("y"), pz = vElem.Find("z");
+	int nx = vElem.Find("nx"), ny = vElem.Find("ny"), nz = vElem.Find("nz");
+	bool hasNormal = nx >= 0 && ny >= 0 && nz >= 0;
+	int indexProp = -1;
+	for (unsigned int i = 0; i < fElem.properties.size(); i++)
+		if (IsIndexList(fElem.properties[i]))
+			indexProp = i;
+	if (px < 0 || py < 0 || pz < 0 || indexProp < 0)
+		return false;
+
+	const int vertexNum = vElem.count;
+	vertices.resize(vertexNum);
+	std::atomic<bool> failed(false);
+
+	if (format == ASCII)
+	{
+		// pass 1 counts the non-empty lines of every chunk so each chunk knows which element its lines belong to,
+		// pass 2 parses vertices in place and collects triangles per chunk
+		const int chunkNum = MYTHREADNUM * 4;
+		std::vector<const char*> bounds;
+		SplitLines(p, end, chunkNum, bounds);
+
+		std::vector<int> lineStart(chunkNum + 1, 0);
+		ParallelFor(chunkNum, [&](int c)
+		{
+			int lines = 0;
+			for (const char *q = bounds[c]; q < bounds[c + 1]; )
+			{
+				const char *lineEnd = NextLine(q, bounds[c + 1]);
+				SkipBlank(q, lineEnd);
+				if (q < lineEnd && *q != '\n')
+					lines++;
+				q = lineEnd;
+			}
+			lineStart[c + 1] = lines;
+		});
+		for (int c = 0; c < chunkNum; c++)
+			lineStart[c + 1] += lineStart[c];
+
+		std::vector<int> elementStart(elements.size() + 1, 0);
+		for (unsigned int i = 0; i < elements.size(); i++)
+			elementStart[i + 1] = elementStart[i] + elements[i].count;
+		if (lineStart[chunkNum] < elementStart[elements.size()])
+			return false;
+
+		std::vector<std::vector<int> > chunkFaces(chunkNum);
+		ParallelFor(chunkNum, [&](int c)
+		{
+			std::vector<float> values(vElem.properties.size());
+			std::vector<int> polygon;
+			int lineIdx = lineStart[c];
+			for (const char *q = bounds[c]; q < bounds[c + 1] && !failed; )
+			{
+				const char *lineEnd = NextLine(q, bounds[c + 1]);
+				SkipBlank(q, lineEnd);
+				if (q >= lineEnd || *q == '\n')
+				{
+					q = lineEnd;
+					continue;
+				}
+
+				if (lineIdx >= elementStart[vertexElem] && lineIdx < elementStart[vertexElem + 1])
+				{
+					for (unsigned int k = 0; k < vElem.properties.size(); k++)
+					{
+						if (vElem.properties[k].isList)
+						{
+							int n;
+							if (!ParseInt(q, lineEnd, n)) { failed = true; break; }
+							for (int m = 0; m < n; m++)
+								SkipToken(q, lineEnd);
+							values[k] = 0;
+						}
+						else if (!ParseFloat(q, lineEnd, values[k])) { failed = true; break; }
+					}
+					Triangle::Vertex &v = vertices[lineIdx - elementStart[vertexElem]];
+					v.Position = glm::vec3(values[px], values[py], values[pz]);
+					if (hasNormal)
+						v.Normal = glm::vec3(values[nx], values[ny], values[nz]);
+				}
+				else if (lineIdx >= elementStart[faceElem] && lineIdx < elementStart[faceElem + 1])
+				{
+					for (unsigned int k = 0; k < fElem.properties.size(); k++)
+					{
+						if (!fElem.properties[k].isList)
+						{
+							SkipToken(q, lineEnd);
+							continue;
+						}
+						int n;
+						if (!ParseInt(q, lineEnd, n) || n < 0) { failed = true; break; }
+						polygon.resize(n);
+						for (int m = 0; m < n; m++)
+						{
+							if (!ParseInt(q, lineEnd, polygon[m]) || polygon[m] < 0 || polygon[m] >= vertexNum) { failed = true; break; }
+						}
+						if (static_cast<int>(k) == indexProp)
+							AppendPolygon(polygon.data(), n, chunkFaces[c]);
+					}
+				}
+
+				lineIdx++;
+				q = lineEnd;
+			}
+		});
+		if (failed)
+			return false;
+
+		std::vector<size_t> faceStart(chunkNum + 1, 0);
+		for (int c = 0; c < chunkNum; c++)
+			faceStart[c + 1] = faceStart[c] + chunkFaces[c].size();
+		faces.resize(faceStart[chunkNum]);
+		ParallelFor(chunkNum, [&](int c)
+		{
+			std::copy(chunkFaces[c].begin(), chunkFaces[c].end(), faces.begin() + faceStart[c]);
+		});
+	}
+	else
+	{
+		bool swap = format == BINARY_BE;
+		for (unsigned int e = 0; e < elements.size(); e++)
+		{
+			const PlyElement &element = elements[e];
+			int stride = element.Stride();
+
+			if (static_cast<int>(e) == vertexElem)
+			{
+				if (stride < 0 || p + static_cast<size_t>(stride) * vertexNum > end)
+					return false;
+
+				std::vector<int> offset(element.properties.size(), 0);
+				for (unsigned int k = 1; k < offset.size(); k++)
+					offset[k] = offset[k - 1] + PlyTypeSize(element.properties[k - 1].type);
+
+				const char *base = p;
+				const int blockNum = MYTHREADNUM * 4;
+				ParallelFor(blockNum, [&](int b)
+				{
+					int first = static_cast<int>(static_cast<long long>(vertexNum) * b / blockNum);
+					int last = static_cast<int>(static_cast<long long>(vertexNum) * (b + 1) / blockNum);
+					for (int i = first; i < last; i++)
+					{
+						const char *record = base + static_cast<size_t>(stride) * i;
+						Triangle::Vertex &v = vertices[i];
+						v.Position.x = static_cast<float>(ReadPlyScalar(record + offset[px], element.properties[px].type, swap));
+						v.Position.y = static_cast<float>(ReadPlyScalar(record + offset[py], element.properties[py].type, swap));
+						v.Position.z = static_cast<float>(ReadPlyScalar(record + offset[pz], element.properties[pz].type, swap));
+						if (hasNormal)
+						{
+							v.Normal.x = static_cast<float>(ReadPlyScalar(record + offset[nx], element.properties[nx].type, swap));
+							v.Normal.y = static_cast<float>(ReadPlyScalar(record + offset[ny], element.properties[ny].type, swap));
+							v.Normal.z = static_cast<float>(ReadPlyScalar(record + offset[nz], element.properties[nz].type, swap));
+						}
+					}
+				});
+				p += static_cast<size_t>(stride) * vertexNum;
+			}
+			else if (static_cast<int>(e) == faceElem)
+			{
+				// scans almost always store triangles only, then every face record has the same size and the
+				// faces can be read in parallel; the guess is verified record by record and we fall back to a
+				// sequential scan with fan triangulation if any face is not a triangle
+				const PlyProperty &indexList = element.properties[indexProp];
+				int before = 0, after = 0;
+				bool fixedOtherwise = true;
+				for (unsigned int k = 0; k < element.properties.size(); k++)
+				{
+					if (static_cast<int>(k) == indexProp)
+						continue;
+					if (element.properties[k].isList)
+						fixedOtherwise = false;
+					else if (static_cast<int>(k) < indexProp)
+						before += PlyTypeSize(element.properties[k].type);
+					else
+						after += PlyTypeSize(element.properties[k].type);
+				}
+				int countSize = PlyTypeSize(indexList.countType);
+				int idxSize = PlyTypeSize(indexList.type);
+				size_t triStride = before + countSize + 3 * idxSize + after;
+				const int faceNum = element.count;
+
+				bool allTriangles = fixedOtherwise && p + triStride * faceNum <= end;
+				if (allTriangles)
+				{
+					faces.resize(3 * static_cast<size_t>(faceNum));
+					std::atomic<bool> notTriangle(false);
+					const char *base = p;
+					const int blockNum = MYTHREADNUM * 4;
+					ParallelFor(blockNum, [&](int b)
+					{
+						int first = static_cast<int>(static_cast<long long>(faceNum) * b / blockNum);
+						int last = static_cast<int>(static_cast<long long>(faceNum) * (b + 1) / blockNum);
+						for (int i = first; i < last && !notTriangle; i++)
+						{
+							const char *record = base + triStride * i + before;
+							if (static_cast<int>(ReadPlyScalar(record, indexList.countType, swap)) != 3)
+							{
+								notTriangle = true;
+								break;
+							}
+							record += countSize;
+							for (int m = 0; m < 3; m++)
+							{
+								int idx = static_cast<int>(ReadPlyScalar(record + m * idxSize, indexList.type, swap));
+								if (idx < 0 || idx >= vertexNum)
+									failed = true;
+								faces[3 * static_cast<size_t>(i) + m] = idx;
+							}
+						}
+					});
+					if (failed)
+						return false;
+					allTriangles = !notTriangle;
+					if (allTriangles)
+						p += triStride * faceNum;
+				}
+				if (!allTriangles)
+				{
+					faces.clear();
+					std::vector<int> polygon;
+					for (int i = 0; i < faceNum; i++)
+					{
+						for (unsigned int k = 0; k < element.properties.size(); k++)
+						{
+							const PlyProperty &prop = element.properties[k];
+							if (!prop.isList)
+							{
+								p += PlyTypeSize(prop.type);
+								continue;
+							}
+							if (p + PlyTypeSize(prop.countType) > end)
+								return false;
+							int n = static_cast<int>(ReadPlyScalar(p, prop.countType, swap));
+							p += PlyTypeSize(prop.countType);
+							if (n < 0 || p + static_cast<size_t>(n) * PlyTypeSize(prop.type) > end)
+								return false;
+							if (static_cast<int>(k) == indexProp)
+							{
+								polygon.resize(n);
+								for (int m = 0; m < n; m++)
+								{
+									polygon[m] = static_cast<int>(ReadPlyScalar(p + m * PlyTypeSize(prop.type), prop.type, swap));
+									if (polygon[m] < 0 || polygon[m] >= vertexNum)
+										return false;
+								}
+								AppendPolygon(polygon.data(), n, faces);
+							}
+							p += n * PlyTypeSize(prop.type);
+						}
+					}
+				}
+			}
+			else if (stride >= 0)
+				p += static_cast<size_t>(stride) * element.count;
+			else
+			{
+				for (int i = 0; i < element.count && p; i++)
+					p = SkipPlyRecord(element, p, end, swap);
+				if (!p)
+					return false;
+			}
+
+			if (p > end)
+				return false;
+		}
+	}
+
+	if (!hasNormal)
+		GenerateFlatNormals(vertices, faces);
+
+	return true;
+}
+
+bool MeshLoader::LoadOBJ(const char *data, size_t size, std::vector<Triangle::Vertex> &vertices, std::vector<int> &faces)
+{
+	const int chunkNum = MYTHREADNUM * 4;
+	std::vector<const char*> bounds;
+	SplitLines(data, data + size, chunkNum, bounds);
+
+	std::vector<ObjChunk> chunks(chunkNum);
+	ParallelFor(chunkNum, [&](int c)
+	{
+		ParseObjChunk(bounds[c], bounds[c + 1], chunks[c]);
+	});
+
+	// prefix sums turn chunk local numbering into global numbering
+	std::vector<int> posStart(chunkNum + 1, 0), normalStart(chunkNum + 1, 0);
+	std::vector<size_t> cornerStart(chunkNum + 1, 0);
+	bool missingNormal = false;
+	for (int c = 0; c < chunkNum; c++)
+	{
+		if (chunks[c].failed)
+			return false;
+		missingNormal = missingNormal || chunks[c].missingNormal;
+		posStart[c + 1] = posStart[c] + static_cast<int>(chunks[c].positions.size());
+		normalStart[c + 1] = normalStart[c] + static_cast<int>(chunks[c].normals.size());
+		cornerStart[c + 1] = cornerStart[c] + chunks[c].relative.size();
+	}
+	const int posNum = posStart[chunkNum];
+	const int normalNum = normalStart[chunkNum];
+	const size_t cornerNum = cornerStart[chunkNum];
+
+	std::vector<glm::vec3> positions(posNum), normals(normalNum);
+	faces.resize(cornerNum);
+	std::vector<int> normalIdx(missingNormal ? 0 : cornerNum);
+	std::atomic<bool> failed(false);
+	ParallelFor(chunkNum, [&](int c)
+	{
+		const ObjChunk &chunk = chunks[c];
+		std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + posStart[c]);
+		std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + normalStart[c]);
+		for (size_t i = 0; i < chunk.relative.size(); i++)
+		{
+			int v = chunk.corners[2 * i] + ((chunk.relative[i] & 1) ? posStart[c] : 0);
+			if (v < 0 || v >= posNum)
+				failed = true;
+			faces[cornerStart[c] + i] = v;
+
+			if (!missingNormal)
+			{
+				int n = chunk.corners[2 * i + 1] + ((chunk.relative[i] & 2) ? normalStart[c] : 0);
+				if (n < 0 || n >= normalNum)
+					failed = true;
+				normalIdx[cornerStart[c] + i] = n;
+			}
+		}
+	});
+	chunks.clear();
+	if (failed)
+		return false;
+
+	if (missingNormal)
+	{
+		vertices.resize(posNum);
+		for (int i = 0; i < posNum; i++)
+			vertices[i].Position = positions[i];
+		GenerateFlatNormals(vertices, faces);
+	}
+	else
+	{
+		// obj indexes positions and normals separately, every corner gets its own vertex
+		vertices.resize(cornerNum);
+		const int blockNum = MYTHREADNUM * 4;
+		ParallelFor(blockNum, [&](int b)
+		{
+			size_t first = cornerNum * b / blockNum, last = cornerNum * (b + 1) / blockNum;
+			for (size_t i = first; i < last; i++)
+			{
+				vertices[i].Position = positions[faces[i]];
+				vertices[i].Normal = normals[normalIdx[i]];
+				faces[i] = static_cast<int>(i);
+			}
+		});
+	}
+
+	return true;
+}
+
+void MeshLoader::GenerateFlatNormals(std::vector<Triangle::Vertex> &vertices, std::vector<int> &faces)
+{
+	const size_t triangleNum = faces.size() / 3;
+	std::vector<Triangle::Vertex> flat(3 * triangleNum);
+
+	const int blockNum = MYTHREADNUM * 4;
+	ParallelFor(blockNum, [&](int b)
+	{
+		size_t first = triangleNum * b / blockNum, last = triangleNum * (b + 1) / blockNum;
+		for (size_t i = first; i < last; i++)
+		{
+			const glm::vec3 &A = vertices[faces[3 * i]].Position;
+			const glm::vec3 &B = vertices[faces[3 * i + 1]].Position;
+			const glm::vec3 &C = vertices[faces[3 * i + 2]].Position;
+			glm::vec3 n = cross(B - A, C - A);
+			float len = length(n);
+			n = len > 0 ? n / len : glm::vec3(0, 1, 0);
+
+			for (int m = 0; m < 3; m++)
+			{
+				flat[3 * i + m].Position = vertices[faces[3 * i + m]].Position;
+				flat[3 * i + m].Normal = n;
+			}
+		}
+	});
+
+	vertices.swap(flat);
+	for (size_t i = 0; i < faces.size(); i++)
+		faces[i] = static_cast<int>(i);
+}
+#pragma endregion
@@ -0,0 +1,44 @@
+// native loader for the mesh formats we actually use (ply and obj)
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "geometryObject.h"
+
+// read-only view of a whole file, mapped instead of copied
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool Open(const std::string &path);
+	void Close();
+
+	const char *data;
+	size_t size;
+
+private:
+#ifdef _WIN32
+	void *fileHandle, *mappingHandle;
+#else
+	int fd;
+#endif
+};
+
+// the file is memory mapped and parsed in parallel chunks straight into the vertex / face arrays
+// consumed by Mesh, Load() returns false for anything it does not understand so Model can fall
+// back to assimp
+class MeshLoader
+{
+public:
+	static bool Load(const std::string &path, std::vector<Triangle::Vertex> &vertices, std::vector<int> &faces);
+
+private:
+	static bool LoadPLY(const char *data, size_t size, std::vector<Triangle::Vertex> &vertices, std::vector<int> &faces);
+	static bool LoadOBJ(const char *data, size_t size, std::vector<Triangle::Vertex> &vertices, std::vector<int> &faces);
+
+	// files without normals get face normals, the same as aiProcess_GenNormals does
+	static void GenerateFlatNormals(std::vector<Triangle::Vertex> &vertices, std::vector<int> &faces);
+};
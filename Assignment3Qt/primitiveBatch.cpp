@@ -0,0 +1,317 @@
+#include "primitiveBatch.h"
+
+#include <xmmintrin.h>
+#include <limits>
+#include <cstring>
+
+#include "Utils.h"
+
+#pragma region SphereBatch
+SphereBatch::SphereBatch()
+	: count(0)
+{
+}
+
+void SphereBatch::Add(glm::vec3 center, float radius, glm::vec3 color)
+{
+	if (this->count % 4 == 0)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			this->centerX.push_back(0);
+			this->centerY.push_back(0);
+			this->centerZ.push_back(0);
+			this->radius2.push_back(std::numeric_limits<float>::quiet_NaN());
+		}
+	}
+
+	this->centerX[this->count] = center.x;
+	this->centerY[this->count] = center.y;
+	this->centerZ[this->count] = center.z;
+	this->radius2[this->count] = radius * radius;
+	this->colors.push_back(color);
+	this->count++;
+}
+
+void SphereBatch::AddArray(int num, const char *data)
+{
+	// the lanes are sized once, new padding lanes get the NaN radius like in Add()
+	int laneNum = (this->count + num + 3) / 4 * 4;
+	this->centerX.resize(laneNum, 0);
+	this->centerY.resize(laneNum, 0);
+	this->centerZ.resize(laneNum, 0);
+	this->radius2.resize(laneNum, std::numeric_limits<float>::quiet_NaN());
+	this->colors.reserve(this->count + num);
+
+	for (int i = 0; i < num; i++)
+	{
+		float row[7];
+		memcpy(row, data + i * sizeof(row), sizeof(row));
+		this->centerX[this->count] = row[0];
+		this->centerY[this->count] = row[1];
+		this->centerZ[this->count] = row[2];
+		this->radius2[this->count] = row[3] * row[3];
+		this->colors.push_back(glm::vec3(row[4], row[5], row[6]));
+		this->count++;
+	}
+}
+
+void SphereBatch::ReportMemory(MemoryReport &report) const
+{
+	report.Add("sphere batch", VectorBytes(this->centerX) + VectorBytes(this->centerY) + VectorBytes(this->centerZ) +
+		VectorBytes(this->radius2) + VectorBytes(this->colors), this->count);
+}
+
+int SphereBatch::Intersect(RayClass *ray, float &nearest, bool anyHit) const
+{
+	// At^2 + Bt + C = 0 for 4 spheres at once, near root first
+	const float a = dot(ray->direction, ray->direction);
+	const __m128 ox = _mm_set1_ps(ray->sPoint.x), oy = _mm_set1_ps(ray->sPoint.y), oz = _mm_set1_ps(ray->sPoint.z);
+	const __m128 dx = _mm_set1_ps(ray->direction.x), dy = _mm_set1_ps(ray->direction.y), dz = _mm_set1_ps(ray->direction.z);
+	const __m128 fourA = _mm_set1_ps(4 * a), inv2A = _mm_set1_ps(0.5f / a);
+	const __m128 two = _mm_set1_ps(2.0f), zero = _mm_setzero_ps(), eps = _mm_set1_ps((float)MYEPSILON);
+
+	int hitIdx = -1;
+	for (int i = 0; i < this->count; i += 4)
+	{
+		__m128 scx = _mm_sub_ps(ox, _mm_loadu_ps(&this->centerX[i]));
+		__m128 scy = _mm_sub_ps(oy, _mm_loadu_ps(&this->centerY[i]));
+		__m128 scz = _mm_sub_ps(oz, _mm_loadu_ps(&this->centerZ[i]));
+
+		__m128 B = _mm_mul_ps(two, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, scx), _mm_mul_ps(dy, scy)), _mm_mul_ps(dz, scz)));
+		__m128 C = _mm_add_ps(_mm_add_ps(_mm_mul_ps(scx, scx), _mm_mul_ps(scy, scy)), _mm_mul_ps(scz, scz));
+		C = _mm_sub_ps(C, _mm_loadu_ps(&this->radius2[i]));
+
+		__m128 det = _mm_sub_ps(_mm_mul_ps(B, B), _mm_mul_ps(fourA, C));
+		__m128 hit = _mm_cmpgt_ps(det, eps);
+		if (!_mm_movemask_ps(hit))
+			continue;
+
+		__m128 sqrtDet = _mm_sqrt_ps(_mm_max_ps(det, zero));
+		__m128 negB = _mm_sub_ps(zero, B);
+		__m128 t1 = _mm_mul_ps(_mm_sub_ps(negB, sqrtDet), inv2A);
+		__m128 t2 = _mm_mul_ps(_mm_add_ps(negB, sqrtDet), inv2A);
+
+		// the near root, or the far one when the ray starts inside the sphere
+		__m128 useT1 = _mm_cmpgt_ps(t1, eps);
+		__m128 t = _mm_or_ps(_mm_and_ps(useT1, t1), _mm_andnot_ps(useT1, t2));
+		hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpgt_ps(t, eps), _mm_cmplt_ps(t, _mm_set1_ps(nearest))));
+
+		int mask = _mm_movemask_ps(hit);
+		if (!mask)
+			continue;
+
+		float tLane[4];
+		_mm_storeu_ps(tLane, t);
+		for (int lane = 0; lane < 4; lane++)
+		{
+			if ((mask & (1 << lane)) && tLane[lane] < nearest)
+			{
+				nearest = tLane[lane];
+				hitIdx = i + lane;
+			}
+		}
+		if (anyHit)
+			return hitIdx;
+	}
+
+	return hitIdx;
+}
+
+RayMask SphereBatch::Occlude(const ShadowBundle &bundle, RayMask active) const
+{
+	const __m128 ox = _mm_set1_ps(bundle.origin.x), oy = _mm_set1_ps(bundle.origin.y), oz = _mm_set1_ps(bundle.origin.z);
+	const __m128 two = _mm_set1_ps(2.0f), zero = _mm_setzero_ps(), eps = _mm_set1_ps((float)MYEPSILON);
+
+	RayMask occluded = 0;
+	for (int i = 0; i < this->count && occluded != active; i += 4)
+	{
+		// sPoint - center and C are the same for every ray of the bundle
+		__m128 scx = _mm_sub_ps(ox, _mm_loadu_ps(&this->centerX[i]));
+		__m128 scy = _mm_sub_ps(oy, _mm_loadu_ps(&this->centerY[i]));
+		__m128 scz = _mm_sub_ps(oz, _mm_loadu_ps(&this->centerZ[i]));
+		__m128 C = _mm_add_ps(_mm_add_ps(_mm_mul_ps(scx, scx), _mm_mul_ps(scy, scy)), _mm_mul_ps(scz, scz));
+		C = _mm_sub_ps(C, _mm_loadu_ps(&this->radius2[i]));
+
+		for (int r = 0; r < bundle.Size(); r++)
+		{
+			if (!(((active & ~occluded) >> r) & 1))
+				continue;
+			const RayClass &ray = bundle.rays[r];
+			const float a = dot(ray.direction, ray.direction);
+			const __m128 dx = _mm_set1_ps(ray.direction.x), dy = _mm_set1_ps(ray.direction.y), dz = _mm_set1_ps(ray.direction.z);
+
+			__m128 B = _mm_mul_ps(two, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, scx), _mm_mul_ps(dy, scy)), _mm_mul_ps(dz, scz)));
+			__m128 det = _mm_sub_ps(_mm_mul_ps(B, B), _mm_mul_ps(_mm_set1_ps(4 * a), C));
+			__m128 hit = _mm_cmpgt_ps(det, eps);
+			if (!_mm_movemask_ps(hit))
+				continue;
+
+			__m128 sqrtDet = _mm_sqrt_ps(_mm_max_ps(det, zero));
+			__m128 negB = _mm_sub_ps(zero, B);
+			__m128 inv2A = _mm_set1_ps(0.5f / a);
+			__m128 t1 = _mm_mul_ps(_mm_sub_ps(negB, sqrtDet), inv2A);
+			__m128 t2 = _mm_mul_ps(_mm_add_ps(negB, sqrtDet), inv2A);
+
+			__m128 useT1 = _mm_cmpgt_ps(t1, eps);
+			__m128 t = _mm_or_ps(_mm_and_ps(useT1, t1), _mm_andnot_ps(useT1, t2));
+			hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpgt_ps(t, eps), _mm_cmplt_ps(t, _mm_set1_ps(bundle.maxT[r]))));
+			if (_mm_movemask_ps(hit))
+				occluded |= (RayMask)1 << r;
+		}
+	}
+
+	return occluded;
+}
+
+void SphereBatch::FillRecord(int idx, RayClass *ray, float t, RayHitObjectRecord &rhor) const
+{
+	glm::vec3 center(this->centerX[idx], this->centerY[idx], this->centerZ[idx]);
+	rhor.hitPoint = ray->getPoint(t);
+	rhor.hitNormal = normalize(rhor.hitPoint - center);
+	rhor.rDirection = ray->direction - 2 * dot(ray->direction, rhor.hitNormal) * rhor.hitNormal; // it's already normalized
+	rhor.pointColor = this->colors[idx];
+	rhor.depth = t;
+}
+#pragma endregion
+
+#pragma region PlaneBatch
+PlaneBatch::PlaneBatch()
+	: count(0)
+{
+}
+
+void PlaneBatch::Add(float A, float B, float C, float D, glm::vec3 color)
+{
+	if (this->count % 4 == 0)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			this->planeA.push_back(0);
+			this->planeB.push_back(0);
+			this->planeC.push_back(0);
+			this->planeD.push_back(0);
+		}
+	}
+
+	this->planeA[this->count] = A;
+	this->planeB[this->count] = B;
+	this->planeC[this->count] = C;
+	this->planeD[this->count] = D;
+	this->normals.push_back(normalize(glm::vec3(A, B, C)));
+	this->colors.push_back(color);
+	this->count++;
+}
+
+void PlaneBatch::AddArray(int num, const char *data)
+{
+	int laneNum = (this->count + num + 3) / 4 * 4;
+	this->planeA.resize(laneNum, 0);
+	this->planeB.resize(laneNum, 0);
+	this->planeC.resize(laneNum, 0);
+	this->planeD.resize(laneNum, 0);
+	this->normals.reserve(this->count + num);
+	this->colors.reserve(this->count + num);
+
+	for (int i = 0; i < num; i++)
+	{
+		float row[7];
+		memcpy(row, data + i * sizeof(row), sizeof(row));
+		this->planeA[this->count] = row[0];
+		this->planeB[this->count] = row[1];
+		this->planeC[this->count] = row[2];
+		this->planeD[this->count] = row[3];
+		this->normals.push_back(normalize(glm::vec3(row[0], row[1], row[2])));
+		this->colors.push_back(glm::vec3(row[4], row[5], row[6]));
+		this->count++;
+	}
+}
+
+void PlaneBatch::ReportMemory(MemoryReport &report) const
+{
+	report.Add("plane batch", VectorBytes(this->planeA) + VectorBytes(this->planeB) + VectorBytes(this->planeC) +
+		VectorBytes(this->planeD) + VectorBytes(this->normals) + VectorBytes(this->colors), this->count);
+}
+
+int PlaneBatch::Intersect(RayClass *ray, float &nearest, bool anyHit) const
+{
+	const __m128 ox = _mm_set1_ps(ray->sPoint.x), oy = _mm_set1_ps(ray->sPoint.y), oz = _mm_set1_ps(ray->sPoint.z);
+	const __m128 dx = _mm_set1_ps(ray->direction.x), dy = _mm_set1_ps(ray->direction.y), dz = _mm_set1_ps(ray->direction.z);
+	const __m128 zero = _mm_setzero_ps(), eps = _mm_set1_ps((float)MYEPSILON);
+
+	int hitIdx = -1;
+	for (int i = 0; i < this->count; i += 4)
+	{
+		__m128 A = _mm_loadu_ps(&this->planeA[i]);
+		__m128 B = _mm_loadu_ps(&this->planeB[i]);
+		__m128 C = _mm_loadu_ps(&this->planeC[i]);
+
+		// t = (-D - ABC . sPoint) / (ABC . direction), parallel planes give an infinite t and fail the nearest test
+		__m128 denominator = _mm_add_ps(_mm_add_ps(_mm_mul_ps(A, dx), _mm_mul_ps(B, dy)), _mm_mul_ps(C, dz));
+		__m128 numerator = _mm_add_ps(_mm_add_ps(_mm_mul_ps(A, ox), _mm_mul_ps(B, oy)), _mm_mul_ps(C, oz));
+		numerator = _mm_sub_ps(_mm_sub_ps(zero, _mm_loadu_ps(&this->planeD[i])), numerator);
+		__m128 t = _mm_div_ps(numerator, denominator);
+
+		__m128 hit = _mm_and_ps(_mm_cmpgt_ps(t, eps), _mm_cmplt_ps(t, _mm_set1_ps(nearest)));
+		int mask = _mm_movemask_ps(hit);
+		if (!mask)
+			continue;
+
+		float tLane[4];
+		_mm_storeu_ps(tLane, t);
+		for (int lane = 0; lane < 4; lane++)
+		{
+			if ((mask & (1 << lane)) && tLane[lane] < nearest)
+			{
+				nearest = tLane[lane];
+				hitIdx = i + lane;
+			}
+		}
+		if (anyHit)
+			return hitIdx;
+	}
+
+	return hitIdx;
+}
+
+RayMask PlaneBatch::Occlude(const ShadowBundle &bundle, RayMask active) const
+{
+	const __m128 ox = _mm_set1_ps(bundle.origin.x), oy = _mm_set1_ps(bundle.origin.y), oz = _mm_set1_ps(bundle.origin.z);
+	const __m128 zero = _mm_setzero_ps(), eps = _mm_set1_ps((float)MYEPSILON);
+
+	RayMask occluded = 0;
+	for (int i = 0; i < this->count && occluded != active; i += 4)
+	{
+		__m128 A = _mm_loadu_ps(&this->planeA[i]);
+		__m128 B = _mm_loadu_ps(&this->planeB[i]);
+		__m128 C = _mm_loadu_ps(&this->planeC[i]);
+		// the numerator only depends on the shared origin
+		__m128 numerator = _mm_add_ps(_mm_add_ps(_mm_mul_ps(A, ox), _mm_mul_ps(B, oy)), _mm_mul_ps(C, oz));
+		numerator = _mm_sub_ps(_mm_sub_ps(zero, _mm_loadu_ps(&this->planeD[i])), numerator);
+
+		for (int r = 0; r < bundle.Size(); r++)
+		{
+			if (!(((active & ~occluded) >> r) & 1))
+				continue;
+			const RayClass &ray = bundle.rays[r];
+			const __m128 dx = _mm_set1_ps(ray.direction.x), dy = _mm_set1_ps(ray.direction.y), dz = _mm_set1_ps(ray.direction.z);
+			__m128 denominator = _mm_add_ps(_mm_add_ps(_mm_mul_ps(A, dx), _mm_mul_ps(B, dy)), _mm_mul_ps(C, dz));
+			__m128 t = _mm_div_ps(numerator, denominator);
+			__m128 hit = _mm_and_ps(_mm_cmpgt_ps(t, eps), _mm_cmplt_ps(t, _mm_set1_ps(bundle.maxT[r])));
+			if (_mm_movemask_ps(hit))
+				occluded |= (RayMask)1 << r;
+		}
+	}
+
+	return occluded;
+}
+
+void PlaneBatch::FillRecord(int idx, RayClass *ray, float t, RayHitObjectRecord &rhor) const
+{
+	rhor.hitPoint = ray->getPoint(t);
+	rhor.hitNormal = this->normals[idx];
+	rhor.rDirection = ray->direction - 2 * dot(ray->direction, rhor.hitNormal) * rhor.hitNormal; // it's already normalized
+	rhor.pointColor = this->colors[idx];
+	rhor.depth = t;
+}
+#pragma endregion
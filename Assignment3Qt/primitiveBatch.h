@@ -0,0 +1,71 @@
+// analytic primitives stored per type as structure of arrays and intersected 4 at a time with SSE
+#pragma once
+
+#include <vector>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "rayTracingCamera.h"
+#include "geometryObject.h"
+#include "memoryReport.h"
+
+// both batches have the same interface, RayTracer calls them through a template so nothing is virtual.
+// Intersect() only finds the distance and index of the nearest hit, FillRecord() builds the full record
+// once for the hit that is finally kept
+
+class SphereBatch
+{
+public:
+	SphereBatch();
+	~SphereBatch(){};
+
+	void Add(glm::vec3 center, float radius, glm::vec3 color = glm::vec3(1, 1, 1));
+	// num spheres from rows of 7 floats (center, radius, color), data needs no alignment
+	void AddArray(int num, const char *data);
+	int Size() const { return this->count; }
+
+	void ReportMemory(MemoryReport &report) const;
+
+	// index of the nearest sphere hit closer than nearest (which is lowered to it), -1 if none.
+	// with anyHit the first batch with a hit ends the search
+	int Intersect(RayClass *ray, float &nearest, bool anyHit) const;
+
+	// the rays of active that hit a sphere closer than their maxT, the terms that only depend on the shared
+	// origin are computed once per 4 spheres
+	RayMask Occlude(const ShadowBundle &bundle, RayMask active) const;
+
+	void FillRecord(int idx, RayClass *ray, float t, RayHitObjectRecord &rhor) const;
+
+private:
+	// padded to a multiple of 4, padding lanes have a NaN radius so every comparison on them fails
+	std::vector<float> centerX, centerY, centerZ, radius2;
+	std::vector<glm::vec3> colors;
+	int count;
+};
+
+class PlaneBatch
+{
+public:
+	PlaneBatch();
+	~PlaneBatch(){};
+
+	// Ax + By + Cz + D = 0
+	void Add(float A, float B, float C, float D, glm::vec3 color = glm::vec3(1, 1, 1));
+	// num planes from rows of 7 floats (ABCD, color), data needs no alignment
+	void AddArray(int num, const char *data);
+	int Size() const { return this->count; }
+
+	void ReportMemory(MemoryReport &report) const;
+
+	int Intersect(RayClass *ray, float &nearest, bool anyHit) const;
+
+	RayMask Occlude(const ShadowBundle &bundle, RayMask active) const;
+
+	void FillRecord(int idx, RayClass *ray, float t, RayHitObjectRecord &rhor) const;
+
+private:
+	// padded to a multiple of 4, padding lanes are all zero so their distance is 0 / 0
+	std::vector<float> planeA, planeB, planeC, planeD;
+	std::vector<glm::vec3> normals, colors;
+	int count;
+};
@@ -38,21 +38,38 @@ QuadTree::~QuadTree()
 	delete[] sumMatrix;
 }
 
-void QuadTree::BuildQTree(int sR, int sC, int n)
+int QuadTree::BuildQTree(int sR, int sC, int n)
 {
+	int nodeIdx = nodes.size();
+	Node node = { { -1, -1, -1, -1 }, -1 };
+	nodes.push_back(node);
+
 	int n_2 = n / 2;
 	glm::vec3 value = sumMatrix[sR + n - 1][sC + n - 1] + sumMatrix[sR][sC] - sumMatrix[sR + n - 1][sC] - sumMatrix[sR][sC + n - 1];
 	if (value.x < COLORINTENSITYTHRES && value.y < COLORINTENSITYTHRES && value.z < COLORINTENSITYTHRES)
 	{
+		nodes[nodeIdx].leafIdx = areaColor.size();
 		posRC.push_back(glm::ivec2(sR + n_2, sC + n_2));
 		sizeWH.push_back(glm::vec2(n * unitSize));
 		resoWH.push_back(glm::ivec2(n));
 		areaColor.push_back(value);
-		return;
+		return nodeIdx;
 	}
 	
-	BuildQTree(sR, sC, n_2);
-	BuildQTree(sR, sC + n_2, n_2);
-	BuildQTree(sR + n_2, sC, n_2);
-	BuildQTree(sR + n_2, sC + n_2, n_2);
+	int child0 = BuildQTree(sR, sC, n_2);
+	int child1 = BuildQTree(sR, sC + n_2, n_2);
+	int child2 = BuildQTree(sR + n_2, sC, n_2);
+	int child3 = BuildQTree(sR + n_2, sC + n_2, n_2);
+	nodes[nodeIdx].child[0] = child0;
+	nodes[nodeIdx].child[1] = child1;
+	nodes[nodeIdx].child[2] = child2;
+	nodes[nodeIdx].child[3] = child3;
+	return nodeIdx;
+}
+
+void QuadTree::ReportMemory(MemoryReport &report)
+{
+	report.Add("quad tree area tables", this->N * (sizeof(glm::dvec3*) + this->N * sizeof(glm::dvec3)), 1);
+	report.Add("quad tree nodes", sizeof(QuadTree) + VectorBytes(this->posRC) + VectorBytes(this->sizeWH) + VectorBytes(this->resoWH) +
+		VectorBytes(this->areaColor) + VectorBytes(this->nodes), this->nodes.size());
 }
@@ -4,6 +4,8 @@
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include "memoryReport.h"
+
 class QuadTree
 {
 public:
@@ -15,8 +17,20 @@ public:
 	std::vector<glm::ivec2> resoWH;
 	std::vector<glm::vec3> areaColor;
 
+	// the tree itself, nodes[0] is the root. a leaf has no children (-1) and the index of its area in the
+	// lists above, an inner node has 4 children
+	struct Node
+	{
+		int child[4];
+		int leafIdx;
+	};
+	std::vector<Node> nodes;
+
+	// the summed area table and the area lists
+	void ReportMemory(MemoryReport &report);
+
 private:
-	void BuildQTree(int sR, int sC, int n);
+	int BuildQTree(int sR, int sC, int n);
 	
 	glm::dvec3 **sumMatrix;
 	int N;
@@ -0,0 +1,446 @@
+#include "rayTracer.h"
+#include "traceLog.h"
+
+#include <QElapsedTimer>
+#include <QStringList>
+
+#include <algorithm>
+
+using namespace std;
+
+RayTracingCameraClass* CreateRenderCamera(glm::vec3 cameraPos, glm::vec3 cameraLookat, const QTInputParam &qtIP)
+{
+	RayTracingCameraClass* camera = new RayTracingCameraClass(cameraPos, cameraLookat, glm::vec3(0, 1, 0), qtIP.antiAliasingLevel);
+	camera->setW(qtIP.resolutionW); // pixel width resolution
+	camera->setH(qtIP.resolutionH); // pixel height resolution
+	camera->setFL(8);  // help to set image center?
+	camera->setIW(8);
+	camera->setIH(6);
+	camera->setP(camera->getPos() + camera->getFront() * camera->getFL());
+	return camera;
+}
+
+glm::vec3 ParseVec3(QString text)
+{
+	QStringList list = text.split(',');
+	if (list.length() != 3)
+		return glm::vec3(0);
+	return glm::vec3(list[0].toFloat(), list[1].toFloat(), list[2].toFloat());
+}
+
+float CalExposureScale(const glm::vec3 *pixels, int pixelNum)
+{
+	TraceScope trace("exposure");
+	vector<float> pixelListR;
+	vector<float> pixelListG;
+	vector<float> pixelListB;
+	pixelListR.resize(pixelNum);
+	pixelListG.resize(pixelNum);
+	pixelListB.resize(pixelNum);
+	for (int i = 0; i < pixelNum; i++)
+	{
+		pixelListR[i] = pixels[i][0];
+		pixelListG[i] = pixels[i][1];
+		pixelListB[i] = pixels[i][2];
+	}
+
+	// calculate the scale ratio
+	int nthIdx = pixelNum * NTHIDX - 1;
+	nth_element(pixelListR.begin(), pixelListR.begin() + nthIdx, pixelListR.end());
+	nth_element(pixelListG.begin(), pixelListG.begin() + nthIdx, pixelListG.end());
+	nth_element(pixelListB.begin(), pixelListB.begin() + nthIdx, pixelListB.end());
+
+	float maxRadiance = glm::max(0.01f, pixelListR[nthIdx]);
+	maxRadiance = glm::max(maxRadiance, pixelListG[nthIdx]);
+	maxRadiance = glm::max(maxRadiance, pixelListB[nthIdx]);
+	return 255.0f / maxRadiance;
+}
+
+RayTracer::RayTracer(SceneData *sceneData)
+	: scene(sceneData->scene)
+	, light(sceneData->light)
+	, spheres(sceneData->spheres)
+	, planes(sceneData->planes)
+	, irradianceCache(NULL)
+	, lightCutError(0)
+	, sampleSeed(0)
+	, costMetric(COST_NONE)
+	, diffuseStrength(DEFAULT_DIFFUSE_STRENGTH)
+	, specularStrength(DEFAULT_SPECULAR_STRENGTH)
+{
+}
+
+RayTracer::~RayTracer()
+{
+	safe_delete(irradianceCache);
+}
+
+void RayTracer::SetIrradianceCache(float tolerance)
+{
+	safe_delete(irradianceCache);
+	if (tolerance > 0)
+		irradianceCache = new IrradianceCache(tolerance);
+}
+
+void RayTracer::ReportMemory(MemoryReport &report)
+{
+	if (irradianceCache)
+		irradianceCache->ReportMemory(report);
+}
+
+void RayTracer::RenderPixels(RayTracingCameraClass* camera, int row, int start, int end, glm::vec3 *pixels, PixelFeature *features, RayDependency *deps)
+{
+	vector<RayClass*> rayList;
+	RayHitObjectRecord curRayRecord;
+	Sampler sampler(this->sampleSeed);
+	int arrayIdx = 0;
+	RayCost pixelCost;
+	RayCost *cost = this->costMetric != COST_NONE ? &pixelCost : NULL;
+	QElapsedTimer pixelTimer;
+	if (cost)
+		features = NULL;
+	
+	for (int col = start; col < end; col++)
+	{
+		if (cost)
+		{
+			pixelCost = RayCost();
+			pixelTimer.start();
+		}
+		camera->GenerateRay(row, col, rayList, &sampler);
+		// for each ray inside a pixel
+		pixels[arrayIdx] = glm::vec3();
+		glm::vec3 albedo(0.0f), normal(0.0f);
+		float depth = 0, lumSum = 0, lumSqSum = 0;
+		int hitNum = 0;
+		for (vector<RayClass*>::iterator i = rayList.begin(); i != rayList.end(); i++)
+		{
+			// find the hit object and hit type
+			glm::vec3 color(0.0f);
+			(*i)->cost = cost;
+			(*i)->deps = deps;
+			if (cost)
+				cost->rayNum++;
+			int hitType = RayHitTest(*i, curRayRecord);
+			if (hitType == 1)
+			{
+				albedo += curRayRecord.pointColor;
+				normal += curRayRecord.hitNormal;
+				depth += curRayRecord.depth;
+				hitNum++;
+				color = calColorOnHitPoint(curRayRecord, 1, cost, deps);
+			}
+			else if (hitType == 2)
+			{
+				albedo += curRayRecord.pointColor;
+				color = curRayRecord.pointColor;
+			}
+			pixels[arrayIdx] += color;
+
+			float lum = Luminance(color);
+			lumSum += lum;
+			lumSqSum += lum * lum;
+
+			safe_delete(*i);
+		}
+		rayList.clear();
+
+		int rayNum = camera->getRayNumEachPixel();
+		pixels[arrayIdx] /= rayNum;
+		if (cost)
+			pixels[arrayIdx] = glm::vec3(CostValue(this->costMetric, pixelCost, pixelTimer.nsecsElapsed() / 1000.0f));
+
+		if (features)
+		{
+			PixelFeature &feature = features[arrayIdx];
+			feature.albedo = albedo / (float)rayNum;
+			feature.normal = hitNum > 0 && length(normal) > 0 ? normalize(normal) : glm::vec3(0.0f);
+			feature.depth = hitNum > 0 ? depth / hitNum : -1.0f;
+			float mean = lumSum / rayNum;
+			feature.variance = glm::max(lumSqSum / rayNum - mean * mean, 0.0f) / rayNum;
+		}
+
+		arrayIdx++;
+	}
+}
+
+glm::vec3 RayTracer::TraceSample(RayTracingCameraClass* camera, int row, int col, int sampleIdx)
+{
+	vector<RayClass*> rayList;
+	RayHitObjectRecord record;
+	Sampler sampler(this->sampleSeed);
+	camera->GenerateRay(row, col, rayList, &sampler, sampleIdx);
+
+	glm::vec3 color(0.0f);
+	for (vector<RayClass*>::iterator i = rayList.begin(); i != rayList.end(); i++)
+	{
+		int hitType = RayHitTest(*i, record);
+		if (hitType == 1)
+			color += calColorOnHitPoint(record, 1);
+		else if (hitType == 2)
+			color += record.pointColor;
+		safe_delete(*i);
+	}
+	return color;
+}
+
+void RayTracer::RenderTile(RayTracingCameraClass* camera, int x, int y, int w, int h, glm::vec3 *tile)
+{
+	for (int row = 0; row < h; row++)
+		RenderPixels(camera, y + row, x, x + w, tile + row * w);
+}
+
+int RayTracer::RayHitTest(RayClass* ray, RayHitObjectRecord &record, float lightDis)
+{
+	record.depth = -1;
+	int hitType = 0;
+	RayHitObjectRecord tmpRecord;
+
+	// a shadow ray stops at the first object in front of the light
+	bool anyHit = lightDis != MYINFINITE;
+	// objects at the light's distance or further don't count
+	float nearest = lightDis - MYEPSILON;
+
+	// the batches only report a distance, the record of the nearest primitive is filled at the end
+	// objects are numbered spheres first, then planes, then the scene list, the same as SceneData::objectInfo
+	int sphereIdx = -1, planeIdx = -1, sceneIdx = -1;
+	if (HitBatch(spheres, ray, nearest, sphereIdx, anyHit))
+	{
+		if (anyHit)
+		{
+			if (ray->deps)
+				Touch(ray, sphereIdx, nearest);
+			return 1;
+		}
+		hitType = 1;
+	}
+	if (HitBatch(planes, ray, nearest, planeIdx, anyHit))
+	{
+		if (anyHit)
+		{
+			if (ray->deps)
+				Touch(ray, spheres.Size() + planeIdx, nearest);
+			return 1;
+		}
+		sphereIdx = -1;
+		hitType = 1;
+	}
+
+	// each object only looks for hits closer than nearest, the hit of the last one that found one is kept
+	RayHit sceneHit;
+	sceneHit.t = nearest;
+	for (vector<GeometryObject*>::iterator j = scene.begin(); j != scene.end(); j++)
+	{
+		if ((*j)->Intersect(ray, sceneHit))
+		{
+			if (anyHit)
+			{
+				if (ray->deps)
+					Touch(ray, spheres.Size() + planes.Size() + (j - scene.begin()), sceneHit.t);
+				return 1;
+			}
+			nearest = sceneHit.t;
+			sphereIdx = planeIdx = -1;
+			sceneIdx = j - scene.begin();
+			hitType = 1;
+		}
+	}
+
+	if (sphereIdx >= 0)
+		spheres.FillRecord(sphereIdx, ray, nearest, record);
+	else if (planeIdx >= 0)
+		planes.FillRecord(planeIdx, ray, nearest, record);
+	else if (sceneIdx >= 0)
+		scene[sceneIdx]->FillRecord(ray, sceneHit, record);
+
+	if (lightDis == MYINFINITE && HitLight(ray, tmpRecord, record.depth > MYEPSILON ? record.depth : FLT_MAX))
+	{
+		record = tmpRecord;
+		hitType = 2;
+	}
+
+	if (ray->deps)
+	{
+		if (hitType == 1)
+			Touch(ray, sphereIdx >= 0 ? sphereIdx : planeIdx >= 0 ? spheres.Size() + planeIdx : spheres.Size() + planes.Size() + sceneIdx, nearest);
+		else if (hitType == 2 && record.depth < MYINFINITE)
+			ray->deps->AddSegment(ray->sPoint, ray->getPoint(record.depth));
+		else if (anyHit)
+			ray->deps->AddSegment(ray->sPoint, ray->getPoint(lightDis));
+		else
+			ray->deps->AddEscape(ray->sPoint, ray->direction); // also a cube map hit, the map is at infinity
+	}
+
+	return hitType;
+}
+
+RayMask RayTracer::OccludedBundle(ShadowBundle &bundle)
+{
+	RayMask active = bundle.AllRays();
+	RayMask occluded = OccludeBatch(spheres, bundle, active);
+	occluded |= OccludeBatch(planes, bundle, active & ~occluded);
+	for (vector<GeometryObject*>::iterator j = scene.begin(); j != scene.end() && occluded != active; j++)
+		occluded |= (*j)->Occlude(bundle, active & ~occluded);
+	return occluded;
+}
+
+bool RayTracer::HitLight(RayClass* ray, RayHitObjectRecord &record, float nearest)
+{
+	RayHitObjectRecord tmpRecord;
+	bool hit = false;
+	for (vector<LightBase*>::iterator j = light.begin(); j != light.end(); j++)
+	{
+		(*j)->RayIntersection(ray, tmpRecord);
+		if (tmpRecord.depth > MYEPSILON && tmpRecord.depth < nearest)
+		{
+			record = tmpRecord;
+			nearest = tmpRecord.depth;
+			hit = true;
+		}
+	}
+	return hit;
+}
+
+float levelDegenerateRatio = 0.5f;
+glm::vec3 RayTracer::calColorOnHitPoint(RayHitObjectRecord &record, int level, RayCost *cost, RayDependency *deps)
+{
+	// level starts from 1
+	if (level > 3)
+		return glm::vec3(0, 0, 0);
+
+	glm::vec3 specular(0.0f);
+	
+	glm::vec3 reflectionColor = glm::vec3(0, 0, 0);
+	RayClass* reflectionRay = new RayClass(record.hitPoint, record.rDirection);
+	reflectionRay->cost = cost;
+	reflectionRay->deps = deps;
+	if (cost)
+		cost->rayNum++;
+	RayHitObjectRecord reflectionHitRecord;
+	int hitType = RayHitTest(reflectionRay, reflectionHitRecord);
+	if (hitType == 1)
+	{
+		glm::vec3 recursiveHitPointColor = calColorOnHitPoint(reflectionHitRecord, level + 1, cost, deps);
+		reflectionColor = levelDegenerateRatio * max(dot(record.hitNormal, record.rDirection), 0.0f) * recursiveHitPointColor;
+	}
+	else if (hitType == 2)
+	{
+		specular += specularStrength * reflectionHitRecord.pointColor;
+	}
+	safe_delete(reflectionRay);
+
+	glm::vec3 diffuse = calDiffuseOnHitPoint(record, cost, deps);
+
+	glm::vec3 returnColor = glm::vec3(0);
+	returnColor += diffuse + specular;
+	//if (1 == level)
+	//	returnColor = glm::vec3(0, 0, 0);
+
+	returnColor += reflectionColor;
+
+	returnColor *= record.pointColor;
+
+	return returnColor;
+}
+
+glm::vec3 RayTracer::calDiffuseOnHitPoint(RayHitObjectRecord &record, RayCost *cost, RayDependency *deps)
+{
+	glm::vec3 diffuse(0.0f);
+	if (irradianceCache && irradianceCache->Lookup(record.hitPoint, record.hitNormal, diffuse))
+		return diffuse;
+
+	// a new cache record also needs the rotational gradient and the distances to the occluders
+	bool newRecord = irradianceCache != NULL;
+	glm::vec3 rotationalGradient[3] = { glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f) };
+	float invDisSum = 0;
+	int sampleNum = 0;
+
+	RayHitObjectRecord lightHitRecord;
+	// for each light source
+	std::vector<glm::vec3> lightColorList;
+	std::vector<float> lightDisList;
+	std::vector<glm::vec3> lightDirList;
+	int lightSampleNum = 0;
+	// visibility alone can be tested for all rays of the hit point at once, a new cache record needs the nearest
+	// hits and recorded dependencies the object each ray stopped at, those are traced one ray at a time
+	bool bundled = !newRecord && !deps;
+	ShadowBundle bundle(record.hitPoint);
+	bundle.cost = cost;
+	for (vector<LightBase*>::iterator i = light.begin(); i != light.end(); i++)
+	{
+		lightColorList.clear();
+		lightDisList.clear();
+		lightDirList.clear();
+		if (lightCutError > 0)
+			lightSampleNum = (*i)->GetLightCut(record.hitPoint, record.hitNormal, lightCutError, lightColorList, lightDisList, lightDirList);
+		else
+		{
+			(*i)->GetLight(record.hitPoint, lightColorList, lightDisList, lightDirList);
+			lightSampleNum = lightDirList.size();
+		}
+
+		for (unsigned int first = 0; bundled && first < lightDirList.size(); first += ShadowBundle::MAX_RAYS)
+		{
+			bundle.Reset(record.hitPoint);
+			for (unsigned int j = first; j < lightDirList.size() && j < first + ShadowBundle::MAX_RAYS; j++)
+				bundle.Add(lightDirList[j], lightDisList[j] - MYEPSILON);
+			if (cost)
+				cost->shadowRayNum += bundle.Size();
+
+			RayMask occluded = OccludedBundle(bundle);
+			for (int r = 0; r < bundle.Size(); r++)
+			{
+				if (!((occluded >> r) & 1))
+					diffuse += diffuseStrength * max(dot(record.hitNormal, lightDirList[first + r]), 0.0f) * lightColorList[first + r];
+			}
+		}
+
+		for (unsigned int j = 0; !bundled && j < lightDirList.size(); j++)
+		{
+			RayClass* lightRay = new RayClass(record.hitPoint, lightDirList[j]);
+			lightRay->cost = cost;
+			lightRay->deps = deps;
+			if (cost)
+				cost->shadowRayNum++;
+			bool visible;
+			if (newRecord)
+			{
+				// nearest hit instead of any hit, its distance goes into the record's radius
+				int hitType = RayHitTest(lightRay, lightHitRecord);
+				visible = !(hitType == 1 && lightHitRecord.depth < lightDisList[j] - MYEPSILON);
+				invDisSum += 1.0f / (visible ? lightDisList[j] : glm::max(lightHitRecord.depth, (float)MYEPSILON));
+				sampleNum++;
+			}
+			else
+				visible = !RayHitTest(lightRay, lightHitRecord, lightDisList[j]);
+
+			if (visible)
+			{
+				float diff = max(dot(record.hitNormal, lightDirList[j]), 0.0f);
+				diffuse += diffuseStrength * diff * lightColorList[j];
+				if (newRecord && diff > 0)
+				{
+					glm::vec3 axis = cross(record.hitNormal, lightDirList[j]);
+					for (int c = 0; c < 3; c++)
+						rotationalGradient[c] += diffuseStrength * lightColorList[j][c] * axis;
+				}
+			}
+
+			safe_delete(lightRay);
+		}
+	}
+
+	float scale = hasHDRLighting ? 1.0f : 15.0f;
+	// a cut is normalized by the samples it stands for, not by its size
+	scale /= (float)lightSampleNum;
+	diffuse *= scale;
+
+	if (newRecord && sampleNum > 0)
+	{
+		for (int c = 0; c < 3; c++)
+			rotationalGradient[c] *= scale;
+		irradianceCache->Add(record.hitPoint, record.hitNormal, diffuse, rotationalGradient, sampleNum / invDisSum);
+	}
+
+	return diffuse;
+}
@@ -0,0 +1,139 @@
+// the tracing core, independent from the qt window so tile workers and batch modes can use it too
+#pragma once
+
+#include <vector>
+
+#include "rayTracingCamera.h"
+#include "geometryObject.h"
+#include "lightSource.h"
+#include "sceneData.h"
+#include "irradianceCache.h"
+#include "denoiser.h"
+#include "costMap.h"
+#include "Utils.h"
+
+// struct for qt UI input params
+struct QTInputParam
+{
+	int resolutionW;
+	int resolutionH;
+	int antiAliasingLevel;
+	int imageScaleRatio;
+	float irradianceTolerance; // 0 traces every diffuse hit
+	float lightCutError; // 0 traces every light sample
+	bool denoise; // filter the image with Denoiser before it is scaled for display
+	CostMetric costMetric; // COST_NONE renders radiance, anything else a cost map
+	float diffuseStrength; // weight of the diffuse lighting
+	float specularStrength; // weight of the lights seen in a reflection
+};
+
+// shading weights of a render that doesn't set them
+#define DEFAULT_DIFFUSE_STRENGTH 0.8f
+#define DEFAULT_SPECULAR_STRENGTH 0.2f
+
+// camera of the given pose with the image plane used by every render
+RayTracingCameraClass* CreateRenderCamera(glm::vec3 cameraPos, glm::vec3 cameraLookat, const QTInputParam &qtIP);
+// "x,y,z" as the camera is written in the ui, (0, 0, 0) unless there are three values
+glm::vec3 ParseVec3(QString text);
+
+// radiance to 8 bit scale of a finished image, the NTHIDX radiance of each channel maps to 255
+float CalExposureScale(const glm::vec3 *pixels, int pixelNum);
+
+class RayTracer
+{
+public:
+	RayTracer(SceneData *sceneData);
+	~RayTracer();
+
+	// interpolate diffuse lighting from an irradiance cache with the given error tolerance, 0 turns it off.
+	// the cache only depends on the scene, so it is kept across frames rendered by this tracer
+	void SetIrradianceCache(float tolerance);
+
+	// shade with a cut of each light's sample hierarchy, see LightBase::GetLightCut, 0 uses every sample
+	void SetLightCut(float errorRatio) { this->lightCutError = errorRatio; }
+
+	// camera rays are jittered by a Sampler with this seed, the same seed renders the same image
+	void SetSampleSeed(unsigned int seed) { this->sampleSeed = seed; }
+	unsigned int SampleSeed() const { return this->sampleSeed; }
+
+	// weights of the diffuse lighting and of the lights seen in a reflection. the irradiance cache keeps the
+	// weighted diffuse lighting, SetIrradianceCache starts a new one after they changed
+	void SetShadingWeights(float diffuse, float specular) { this->diffuseStrength = diffuse; this->specularStrength = specular; }
+
+	// RenderPixels writes the cost of each pixel in every channel instead of its radiance, see costMap.h
+	void SetCostMetric(CostMetric metric) { this->costMetric = metric; }
+
+	// what the tracer builds while rendering, the irradiance cache
+	void ReportMemory(MemoryReport &report);
+
+	// render pixels [start, end) of a row, pixels[0] receives pixel (row, start). features, when given, receives
+	// the denoiser guides of the same pixels, they are not written for a cost map. deps, when given, collects
+	// what every ray of the pixels hit, see IncrementalRenderer
+	void RenderPixels(RayTracingCameraClass* camera, int row, int start, int end, glm::vec3 *pixels, PixelFeature *features = NULL, RayDependency *deps = NULL);
+
+	// summed radiance of the camera's rays for pixel (row, col), jittered by samples [sampleIdx, sampleIdx + rays)
+	// of the pixel. a progressive render asks for one sample after another, see DeadlineRenderer
+	glm::vec3 TraceSample(RayTracingCameraClass* camera, int row, int col, int sampleIdx);
+
+	// render the rectangle [x, x + w) * [y, y + h), tile is row major with w pixels per row
+	void RenderTile(RayTracingCameraClass* camera, int x, int y, int w, int h, glm::vec3 *tile);
+
+	int RayHitTest(RayClass* ray, RayHitObjectRecord &record, float lightDis = MYINFINITE);
+
+	// the rays of the bundle that hit an object closer than their maxT, the same as a RayHitTest with
+	// lightDis = maxT + MYEPSILON for each of them. lights are not tested and no dependencies are recorded
+	RayMask OccludedBundle(ShadowBundle &bundle);
+
+	// the nearest light the ray sees closer than nearest, objects are not tested. a cube map is at MYINFINITE,
+	// so nearest has to be above that for it to be seen
+	bool HitLight(RayClass* ray, RayHitObjectRecord &record, float nearest = FLT_MAX);
+
+	// cost and deps, when given, are handed to the reflection and shadow rays
+	glm::vec3 calColorOnHitPoint(RayHitObjectRecord &record, int level, RayCost *cost = NULL, RayDependency *deps = NULL);
+
+	// the diffuse part of calColorOnHitPoint, from the irradiance cache when it has a record nearby
+	glm::vec3 calDiffuseOnHitPoint(RayHitObjectRecord &record, RayCost *cost = NULL, RayDependency *deps = NULL);
+
+private:
+	// a ray carrying deps hit object objectIdx at distance t
+	void Touch(RayClass* ray, int objectIdx, float t)
+	{
+		ray->deps->objects.push_back(objectIdx);
+		ray->deps->AddSegment(ray->sPoint, ray->getPoint(t));
+	}
+
+	// nearest hit of a primitive batch, see primitiveBatch.h
+	template <typename Batch>
+	bool HitBatch(const Batch &batch, RayClass* ray, float &nearest, int &hitIdx, bool anyHit)
+	{
+		if (ray->cost)
+			ray->cost->primitiveNum += batch.Size();
+		int idx = batch.Intersect(ray, nearest, anyHit);
+		if (idx < 0)
+			return false;
+		hitIdx = idx;
+		return true;
+	}
+
+	// OccludedBundle of a primitive batch
+	template <typename Batch>
+	RayMask OccludeBatch(const Batch &batch, const ShadowBundle &bundle, RayMask active)
+	{
+		if (bundle.cost)
+		{
+			for (int r = 0; r < bundle.Size(); r++)
+				bundle.cost->primitiveNum += ((active >> r) & 1) ? batch.Size() : 0;
+		}
+		return batch.Occlude(bundle, active);
+	}
+
+	std::vector<GeometryObject*> &scene;
+	std::vector<LightBase*> &light;
+	SphereBatch &spheres;
+	PlaneBatch &planes;
+	IrradianceCache *irradianceCache;
+	float lightCutError;
+	unsigned int sampleSeed;
+	CostMetric costMetric;
+	float diffuseStrength, specularStrength;
+};
@@ -2,8 +2,20 @@
 
 RayClass::RayClass(glm::vec3 sPoint, glm::vec3 directoin)
 	: sPoint(sPoint)
+	, cost(NULL)
+	, deps(NULL)
 {
 	this->direction = normalize(directoin);
+
+	// a zero component gets a huge finite inverse instead of inf, so 0 * inv stays a number
+	for (int i = 0; i < 3; i++)
+	{
+		float d = this->direction[i];
+		if (d > -1e-20f && d < 1e-20f)
+			d = d < 0 ? -1e-20f : 1e-20f;
+		this->invDirection[i] = 1.0f / d;
+		this->sign[i] = this->invDirection[i] < 0 ? 1 : 0;
+	}
 }
 
 
@@ -21,7 +33,7 @@ RayTracingCameraClass::RayTracingCameraClass(glm::vec3 pos, glm::vec3 lookat, gl
 }
 
 // row and col start from 0
-void RayTracingCameraClass::GenerateRay(int row, int col, std::vector<RayClass*> &rays)
+void RayTracingCameraClass::GenerateRay(int row, int col, std::vector<RayClass*> &rays, Sampler *sampler, int firstSample)
 {
 	if (!hasPixelSize)
 	{
@@ -41,8 +53,15 @@ void RayTracingCameraClass::GenerateRay(int row, int col, std::vector<RayClass*>
 	{
 		for (int j = 1; j <= this->antiAliasingLevel; j++)
 		{
-			glm::vec3 colOffsetLocal = glm::vec3(this->ir * (i * step - 0.5f)) * this->pixelWidth;
-			glm::vec3 rowOffsetLocal = glm::vec3(this->id * (j * step - 0.5f)) * this->pixelHeight;
+			glm::vec2 offset(i * step - 0.5f, j * step - 0.5f);
+			if (sampler)
+			{
+				sampler->StartSample(col, row, firstSample + loop);
+				offset = sampler->Get2D() - glm::vec2(0.5f);
+			}
+
+			glm::vec3 colOffsetLocal = glm::vec3(this->ir * offset.x) * this->pixelWidth;
+			glm::vec3 rowOffsetLocal = glm::vec3(this->id * offset.y) * this->pixelHeight;
 
 			glm::vec3 directionLocal = normalize(ePoint + colOffsetLocal + rowOffsetLocal - this->pos);
 			rays[loop++] = new RayClass(this->pos, directionLocal);
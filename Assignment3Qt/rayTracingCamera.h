@@ -1,9 +1,53 @@
 #pragma once
 
 #include <vector>
+#include <cfloat>
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include "sampler.h"
+
+// work done for one pixel, counted by the traversal and intersection code when a ray carries it
+struct RayCost
+{
+	RayCost() : nodeNum(0), primitiveNum(0), rayNum(0), shadowRayNum(0) {}
+
+	int nodeNum; // wide bvh nodes whose children were tested
+	int primitiveNum; // sphere, plane and triangle tests, a batch counts all of its primitives
+	int rayNum; // camera and reflection rays
+	int shadowRayNum;
+};
+
+// what the rays of one tile depended on, recorded by RayTracer::RayHitTest when a ray carries it
+struct RayDependency
+{
+	RayDependency()
+		: boundMin(FLT_MAX), boundMax(-FLT_MAX)
+		, escapeOriginMin(FLT_MAX), escapeOriginMax(-FLT_MAX), escapeDirMin(FLT_MAX), escapeDirMax(-FLT_MAX)
+	{}
+
+	// box around a traced segment
+	void AddSegment(glm::vec3 a, glm::vec3 b)
+	{
+		boundMin = glm::min(boundMin, glm::min(a, b));
+		boundMax = glm::max(boundMax, glm::max(a, b));
+	}
+
+	// a ray that left the scene
+	void AddEscape(glm::vec3 origin, glm::vec3 direction)
+	{
+		escapeOriginMin = glm::min(escapeOriginMin, origin);
+		escapeOriginMax = glm::max(escapeOriginMax, origin);
+		escapeDirMin = glm::min(escapeDirMin, direction);
+		escapeDirMax = glm::max(escapeDirMax, direction);
+	}
+
+	std::vector<int> objects; // index of every object hit, see SceneData::objectInfo, with repeats
+	glm::vec3 boundMin, boundMax; // every segment from a ray's origin to where it stopped
+	// the rays that hit nothing, as boxes of their origins and their directions
+	glm::vec3 escapeOriginMin, escapeOriginMax, escapeDirMin, escapeDirMax;
+};
+
 class RayClass
 {
 public:
@@ -14,6 +58,68 @@ public:
 	inline glm::vec3 getPoint(float t) { return this->sPoint + this->direction * t; }
 
 	glm::vec3 sPoint, direction;
+	// for slab tests without divisions, sign[i] is 1 when direction[i] is negative
+	glm::vec3 invDirection;
+	int sign[3];
+
+	// NULL unless a cost map is rendered, secondary rays get the pointer of the ray that spawned them
+	RayCost *cost;
+	// NULL unless an incremental render records dependencies, handed on the same way as cost
+	RayDependency *deps;
+};
+
+// one bit per ray of a ShadowBundle
+typedef unsigned long long RayMask;
+
+// shadow rays that leave the same point, tested for occlusion together so the shared origin is only
+// subtracted once per box and primitive, see RayTracer::OccludedBundle
+class ShadowBundle
+{
+public:
+	static const int MAX_RAYS = 64;
+
+	ShadowBundle(glm::vec3 origin)
+		: origin(origin)
+		, cost(NULL)
+	{
+		this->rays.reserve(MAX_RAYS);
+		for (int i = 0; i < MAX_RAYS; i++)
+			this->dirX[i] = this->dirY[i] = this->dirZ[i] = this->maxT[i] = 0;
+	}
+
+	// start over from another point, cost is kept
+	void Reset(glm::vec3 origin)
+	{
+		this->origin = origin;
+		this->rays.clear();
+	}
+
+	// the ray is occluded by a hit closer than maxT, false when the bundle is full
+	bool Add(glm::vec3 direction, float maxT)
+	{
+		int i = Size();
+		if (i >= MAX_RAYS)
+			return false;
+		this->rays.push_back(RayClass(this->origin, direction));
+		this->rays.back().cost = this->cost;
+		this->dirX[i] = this->rays.back().direction.x;
+		this->dirY[i] = this->rays.back().direction.y;
+		this->dirZ[i] = this->rays.back().direction.z;
+		this->maxT[i] = maxT;
+		return true;
+	}
+
+	int Size() const { return this->rays.size(); }
+	RayMask AllRays() const { return Size() >= MAX_RAYS ? ~(RayMask)0 : ((RayMask)1 << Size()) - 1; }
+
+	glm::vec3 origin;
+	std::vector<RayClass> rays;
+	// the normalized directions again as structure of arrays, so primitives can test 4 rays at once. lanes
+	// past Size() hold old rays and are only read for masked out lanes
+	float dirX[MAX_RAYS], dirY[MAX_RAYS], dirZ[MAX_RAYS];
+	float maxT[MAX_RAYS];
+	// NULL unless a cost map is rendered, handed to every ray added after it is set
+	RayCost *cost;
 };
 
 class RayTracingCameraClass
@@ -49,8 +155,9 @@ public:
 	void setP(glm::vec3 p)	{ this->p = p; }
 	int getRayNumEachPixel(){ return this->antiAliasingLevel * this->antiAliasingLevel; }
 	
-	// compute the list of rays emit from pixel (i, j)
-	void GenerateRay(int row, int col, std::vector<RayClass*> &rays);
+	// compute the list of rays emit from pixel (i, j). without a sampler the rays go through a regular grid,
+	// with one they are jittered by samples [firstSample, firstSample + getRayNumEachPixel()) of the pixel
+	void GenerateRay(int row, int col, std::vector<RayClass*> &rays, Sampler *sampler = NULL, int firstSample = 0);
 
 private:
 	// camera location and orientation
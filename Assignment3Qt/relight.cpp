@@ -0,0 +1,109 @@
+#include "relight.h"
+
+#include "traceLog.h"
+
+using namespace std;
+
+RelightRenderer::RelightRenderer(int threadNum)
+	: threadNum(glm::max(threadNum, 1))
+	, key(0)
+	, rayNum(0)
+{
+}
+
+void RelightRenderer::Reset()
+{
+	vector<PrimarySample>().swap(this->samples);
+}
+
+bool RelightRenderer::Render(SceneData *sceneData, RayTracer *rayTracer, glm::vec3 cameraPos, glm::vec3 cameraLookat, const QTInputParam &qtIP, vector<glm::vec3> &pixels)
+{
+	// the lights are left out on purpose, see SceneData::lightKey
+	unsigned long long key = HashBytes(NULL, 0);
+	for (vector<SceneObjectInfo>::const_iterator i = sceneData->objectInfo.begin(); i != sceneData->objectInfo.end(); i++)
+	{
+		key = HashBytes(&i->key, sizeof(i->key), key);
+		key = HashBytes(&i->colorKey, sizeof(i->colorKey), key);
+	}
+	float view[6] = { cameraPos.x, cameraPos.y, cameraPos.z, cameraLookat.x, cameraLookat.y, cameraLookat.z };
+	int settings[4] = { qtIP.resolutionW, qtIP.resolutionH, qtIP.antiAliasingLevel, (int)rayTracer->SampleSeed() };
+	key = HashBytes(view, sizeof(view), key);
+	key = HashBytes(settings, sizeof(settings), key);
+
+	RayTracingCameraClass *camera = CreateRenderCamera(cameraPos, cameraLookat, qtIP);
+	const int W = camera->getW(), H = camera->getH();
+	pixels.assign(W * H, glm::vec3(0.0f));
+
+	bool relight = key == this->key && !this->samples.empty();
+	if (!relight)
+	{
+		TraceScope trace("primary hits");
+		this->key = key;
+		this->cameraPos = cameraPos;
+		this->rayNum = camera->getRayNumEachPixel();
+		this->samples.resize((size_t)W * H * this->rayNum);
+
+		ParallelFor(H, [&](int row)
+		{
+			vector<RayClass*> rayList;
+			Sampler sampler(rayTracer->SampleSeed());
+			for (int col = 0; col < W; col++)
+			{
+				// the same rays as RayTracer::RenderPixels, weighted the same
+				camera->GenerateRay(row, col, rayList, &sampler);
+				PrimarySample *sample = &this->samples[((size_t)row * W + col) * this->rayNum];
+				for (unsigned int i = 0; i < rayList.size(); i++, sample++)
+				{
+					sample->direction = rayList[i]->direction;
+					sample->weight = 1.0f / this->rayNum;
+					sample->hitType = rayTracer->RayHitTest(rayList[i], sample->record);
+					safe_delete(rayList[i]);
+				}
+				rayList.clear();
+			}
+		}, this->threadNum);
+	}
+	safe_delete(camera);
+
+	TraceScope trace("relight");
+	ParallelFor(H, [&](int row)
+	{
+		for (int col = 0; col < W; col++)
+		{
+			const PrimarySample *sample = &this->samples[((size_t)row * W + col) * this->rayNum];
+			glm::vec3 color(0.0f);
+			for (int i = 0; i < this->rayNum; i++, sample++)
+				color += sample->weight * Shade(rayTracer, *sample);
+			pixels[row * W + col] = color;
+		}
+	}, this->threadNum);
+
+	return relight;
+}
+
+glm::vec3 RelightRenderer::Shade(RayTracer *rayTracer, const PrimarySample &sample) const
+{
+	RayClass ray(this->cameraPos, sample.direction);
+	RayHitObjectRecord record;
+	if (sample.hitType == 1)
+	{
+		// a smaller cube map may now be in front of the object
+		if (rayTracer->HitLight(&ray, record, sample.record.depth))
+			return record.pointColor;
+		record = sample.record;
+		return rayTracer->calColorOnHitPoint(record, 1);
+	}
+
+	// what a ray sees past the lights depends on them, these are traced again
+	int hitType = rayTracer->RayHitTest(&ray, record);
+	if (hitType == 1)
+		return rayTracer->calColorOnHitPoint(record, 1);
+	if (hitType == 2)
+		return record.pointColor;
+	return glm::vec3(0.0f);
+}
+
+void RelightRenderer::ReportMemory(MemoryReport &report) const
+{
+	report.Add("relight hits", VectorBytes(this->samples), this->samples.size());
+}
@@ -0,0 +1,47 @@
+// look development on a fixed scene: new lights or shading weights without tracing the camera rays again
+#pragma once
+
+#include <vector>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "rayTracer.h"
+
+// keeps the first hit of every camera ray from the last render: hit point, normal, reflection direction,
+// albedo, the ray itself and its weight in the pixel. as long as the objects and the view stay the same the
+// next render only shades those hits, so the cube map, its size and the tracer's shading weights can
+// change at the cost of the lighting and the secondary rays alone
+class RelightRenderer
+{
+public:
+	RelightRenderer(int threadNum = MYTHREADNUM);
+	~RelightRenderer(){};
+
+	// pixels receives the whole image. true when the kept hits were shaded, false when the objects or the
+	// view changed and the camera rays were traced again. sceneData has to be loaded withObjectInfo
+	bool Render(SceneData *sceneData, RayTracer *rayTracer, glm::vec3 cameraPos, glm::vec3 cameraLookat, const QTInputParam &qtIP, std::vector<glm::vec3> &pixels);
+
+	// forget the kept hits
+	void Reset();
+
+	void ReportMemory(MemoryReport &report) const;
+
+private:
+	struct PrimarySample
+	{
+		RayHitObjectRecord record; // of the object hit, hitType 1 only
+		glm::vec3 direction;
+		float weight;
+		int hitType; // of RayHitTest
+	};
+
+	// radiance of a kept sample under the tracer's lights
+	glm::vec3 Shade(RayTracer *rayTracer, const PrimarySample &sample) const;
+
+	int threadNum;
+	// the objects and the view the hits were traced for
+	unsigned long long key;
+	glm::vec3 cameraPos;
+	int rayNum;
+	std::vector<PrimarySample> samples;
+};
@@ -0,0 +1,126 @@
+#include "sampler.h"
+
+namespace
+{
+	const float ONE_MINUS_EPSILON = 0.99999994f;
+
+	unsigned int ReverseBits(unsigned int x)
+	{
+		x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+		x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+		x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+		x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+		return (x >> 16) | (x << 16);
+	}
+
+	unsigned int Hash(unsigned int x)
+	{
+		x ^= x >> 16;
+		x *= 0x7feb352du;
+		x ^= x >> 15;
+		x *= 0x846ca68bu;
+		x ^= x >> 16;
+		return x;
+	}
+
+	unsigned int HashCombine(unsigned int seed, unsigned int v)
+	{
+		return seed ^ (Hash(v) + 0x9e3779b9u + (seed << 6) + (seed >> 2));
+	}
+
+	// laine-karras permutation, every bit only depends on the bits below it
+	unsigned int LKPermutation(unsigned int x, unsigned int seed)
+	{
+		x += seed;
+		x ^= x * 0x6c50b47cu;
+		x ^= x * 0xb82f1e52u;
+		x ^= x * 0xc7afe638u;
+		x ^= x * 0x8d22f6e6u;
+		return x;
+	}
+
+	// owen scrambling of a 32 bit fraction, bits depend on the bits above them
+	unsigned int NestedUniformScramble(unsigned int x, unsigned int seed)
+	{
+		return ReverseBits(LKPermutation(ReverseBits(x), seed));
+	}
+
+	// the first two sobol dimensions: van der corput and the one with primitive polynomial x + 1
+	unsigned int Sobol0(unsigned int i)
+	{
+		return ReverseBits(i);
+	}
+	unsigned int Sobol1(unsigned int i)
+	{
+		unsigned int r = 0;
+		for (unsigned int v = 1u << 31; i; i >>= 1, v ^= v >> 1)
+		{
+			if (i & 1)
+				r ^= v;
+		}
+		return r;
+	}
+
+	float ToFloat(unsigned int x)
+	{
+		float f = x * (1.0f / 4294967296.0f);
+		return f < ONE_MINUS_EPSILON ? f : ONE_MINUS_EPSILON;
+	}
+}
+
+#pragma region PCG32
+PCG32::PCG32(unsigned long long seed, unsigned long long stream)
+{
+	Seed(seed, stream);
+}
+void PCG32::Seed(unsigned long long seed, unsigned long long stream)
+{
+	this->state = 0;
+	this->inc = (stream << 1) | 1;
+	NextUInt();
+	this->state += seed;
+	NextUInt();
+}
+unsigned int PCG32::NextUInt()
+{
+	unsigned long long old = this->state;
+	this->state = old * 6364136223846793005ULL + this->inc;
+	unsigned int xorShifted = static_cast<unsigned int>(((old >> 18) ^ old) >> 27);
+	unsigned int rot = static_cast<unsigned int>(old >> 59);
+	return (xorShifted >> rot) | (xorShifted << ((32 - rot) & 31));
+}
+float PCG32::NextFloat()
+{
+	return ToFloat(NextUInt());
+}
+#pragma endregion
+
+#pragma region Sampler
+Sampler::Sampler(unsigned int seed)
+	: seed(seed)
+	, pixelSeed(0)
+	, sampleIdx(0)
+	, dimension(0)
+{
+}
+void Sampler::StartSample(int x, int y, int sampleIdx)
+{
+	this->pixelSeed = HashCombine(HashCombine(this->seed, x), y);
+	this->sampleIdx = sampleIdx;
+	this->dimension = 0;
+}
+float Sampler::Get1D()
+{
+	return Get2D().x;
+}
+glm::vec2 Sampler::Get2D()
+{
+	unsigned int dimSeed = HashCombine(this->pixelSeed, this->dimension++);
+
+	// shuffle the sample order per pixel and dimension, then scramble each coordinate
+	unsigned int idx = NestedUniformScramble(this->sampleIdx, dimSeed);
+	unsigned int x = NestedUniformScramble(Sobol0(idx), HashCombine(dimSeed, 0));
+	unsigned int y = NestedUniformScramble(Sobol1(idx), HashCombine(dimSeed, 1));
+	return glm::vec2(ToFloat(x), ToFloat(y));
+}
+#pragma endregion
@@ -0,0 +1,43 @@
+// random numbers without global state: a pcg generator for anything sequential and scrambled sobol
+// points indexed by pixel and sample for the render itself
+#pragma once
+
+#include <glm/gtc/type_ptr.hpp>
+
+// pcg32 (XSH RR), Reference: http://www.pcg-random.org/
+class PCG32
+{
+public:
+	PCG32(unsigned long long seed = 0, unsigned long long stream = 0);
+
+	void Seed(unsigned long long seed, unsigned long long stream = 0);
+
+	unsigned int NextUInt();
+	// uniform in [0, 1)
+	float NextFloat();
+
+private:
+	unsigned long long state, inc;
+};
+
+// owen scrambled sobol (0,2) points, Reference: Burley, Practical Hash-based Owen Scrambling, JCGT 2020.
+// every Get2D() of a sample is a new pair of dimensions with its own shuffle and scramble, so the same
+// (seed, pixel, sample) always gives the same numbers no matter which thread asks. a sampler is small and
+// not shared, each thread creates its own
+class Sampler
+{
+public:
+	Sampler(unsigned int seed = 0);
+
+	// start drawing numbers for sample sampleIdx of pixel (x, y)
+	void StartSample(int x, int y, int sampleIdx);
+
+	float Get1D();
+	glm::vec2 Get2D();
+
+private:
+	unsigned int seed;
+	unsigned int pixelSeed;
+	unsigned int sampleIdx;
+	unsigned int dimension;
+};
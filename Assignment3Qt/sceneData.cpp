@@ -0,0 +1,385 @@
+#include "sceneData.h"
+
+#include <QFileInfo>
+
+#include <cctype>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Utils.h"
+#include "meshLoader.h"
+#include "textParse.h"
+#include "traceLog.h"
+
+namespace
+{
+	const int MAX_FIELD = 8;
+	const int ROW_FLOAT_NUM = 7;
+
+	inline void SkipSeparator(const char *&p, const char *end)
+	{
+		while (p < end && (IsBlank(*p) || *p == ','))
+			p++;
+	}
+
+	// up to num numbers of the range, returns how many were read
+	int ParseFloats(const char *p, const char *end, float *values, int num)
+	{
+		int i = 0;
+		for (; i < num; i++)
+		{
+			SkipSeparator(p, end);
+			if (!ParseFloat(p, end, values[i]))
+				break;
+		}
+		return i;
+	}
+
+	glm::vec3 ParseVec3(const char *p, const char *end)
+	{
+		float v[3] = { 0, 0, 0 };
+		ParseFloats(p, end, v, 3);
+		return glm::vec3(v[0], v[1], v[2]);
+	}
+
+	std::string Trimmed(const char *begin, const char *end)
+	{
+		while (begin < end && IsBlank(*begin))
+			begin++;
+		while (end > begin && IsBlank(end[-1]))
+			end--;
+		return std::string(begin, end);
+	}
+
+	// case insensitive, so "Sphere" and "sphere" both work as before
+	bool IsKeyword(const char *begin, const char *end, const char *keyword)
+	{
+		while (begin < end && IsBlank(*begin))
+			begin++;
+		while (end > begin && IsBlank(end[-1]))
+			end--;
+		size_t length = strlen(keyword);
+		if ((size_t)(end - begin) != length)
+			return false;
+		for (size_t i = 0; i < length; i++)
+		{
+			if (tolower((unsigned char)begin[i]) != tolower((unsigned char)keyword[i]))
+				return false;
+		}
+		return true;
+	}
+
+	// hash of a text range after trimming
+	unsigned long long HashText(const char *begin, const char *end, unsigned long long hash)
+	{
+		std::string text = Trimmed(begin, end);
+		return HashBytes(text.data(), text.size(), hash);
+	}
+}
+
+SceneData::SceneData()
+	: lightKey(HashBytes(NULL, 0))
+	, withObjectInfo(false)
+{
+}
+
+SceneData::~SceneData()
+{
+	for (std::vector<GeometryObject*>::iterator i = scene.begin(); i != scene.end(); i++)
+		safe_delete(*i);
+	for (std::map<std::string, Model*>::iterator i = modelLibrary.begin(); i != modelLibrary.end(); i++)
+		safe_delete(i->second);
+	for (std::vector<LightBase*>::iterator i = light.begin(); i != light.end(); i++)
+		safe_delete(*i);
+}
+
+bool SceneData::Load(QString sceneDataPath, bool withObjectInfo)
+{
+	// ALL COLORS ARE stored in RGB CHANNELS
+	TraceScope trace("scene load", "load");
+
+	// the file is mapped and parsed in place, an empty file is an empty scene
+	MappedFile sceneDataFile;
+	if (!sceneDataFile.Open(sceneDataPath.toLocal8Bit().data()))
+	{
+		QFileInfo info(sceneDataPath);
+		if (!info.exists() || info.size() != 0)
+			return false;
+	}
+
+	this->withObjectInfo = withObjectInfo;
+	bool success = true;
+	const char *p = sceneDataFile.data, *end = sceneDataFile.data + sceneDataFile.size;
+	while (p && p < end)
+		p = ParseLine(p, end);
+	if (!p)
+		success = false;
+	sceneDataFile.Close();
+
+	// create light
+	//light.push_back((LightBase*)new PointLight(glm::vec3(1.3, 0, 1), glm::vec3(1, 1, 1) * 0.7f));
+	//light.push_back((LightBase*)new PointLight(glm::vec3(-1.1, 1, 0.5), glm::vec3(0.4, 0.6, 0.5) * 1.0f));
+	if (light.empty())
+		light.push_back((LightBase*)new CubeMap("../cubeMap.hdr", 30.1f));
+
+	JoinObjectInfo();
+
+	return success;
+}
+
+void SceneData::ReportMemory(MemoryReport &report)
+{
+	report.Add("scene lists", sizeof(SceneData) + VectorBytes(this->scene) + VectorBytes(this->light) + VectorBytes(this->objectInfo), 0);
+	for (std::vector<GeometryObject*>::iterator i = scene.begin(); i != scene.end(); i++)
+		(*i)->ReportMemory(report);
+	for (std::map<std::string, Model*>::iterator i = modelLibrary.begin(); i != modelLibrary.end(); i++)
+		i->second->ReportMemory(report);
+	this->spheres.ReportMemory(report);
+	this->planes.ReportMemory(report);
+	for (std::vector<LightBase*>::iterator i = light.begin(); i != light.end(); i++)
+		(*i)->ReportMemory(report);
+}
+
+const char* SceneData::ParseLine(const char *p, const char *end)
+{
+	const char *lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+	const char *next = lineEnd ? lineEnd + 1 : end;
+	if (!lineEnd)
+		lineEnd = end;
+
+	SkipBlank(p, lineEnd);
+	if (p == lineEnd || *p == '#')
+		return next;
+
+	// split at ';', empty fields are dropped like before
+	Field field[MAX_FIELD];
+	int fieldNum = 0;
+	while (p < lineEnd && fieldNum < MAX_FIELD)
+	{
+		const char *fieldEnd = static_cast<const char*>(memchr(p, ';', lineEnd - p));
+		if (!fieldEnd)
+			fieldEnd = lineEnd;
+		const char *q = p;
+		SkipBlank(q, fieldEnd);
+		if (q < fieldEnd)
+		{
+			field[fieldNum].begin = p;
+			field[fieldNum].end = fieldEnd;
+			fieldNum++;
+		}
+		p = fieldEnd + 1;
+	}
+
+	// a line of separators only has no keyword
+	if (fieldNum == 0)
+		return next;
+
+	const char *keyBegin = field[0].begin, *keyEnd = field[0].end;
+	if (IsKeyword(keyBegin, keyEnd, "Sphere") && fieldNum >= 4)
+	{
+		glm::vec3 center = ParseVec3(field[1].begin, field[1].end);
+		float radius = 0;
+		ParseFloats(field[2].begin, field[2].end, &radius, 1);
+		glm::vec3 color = ParseVec3(field[3].begin, field[3].end);
+
+		this->spheres.Add(center, radius, color);
+		AddSphereInfo(center, radius, color);
+	}
+	else if (IsKeyword(keyBegin, keyEnd, "Plane") && fieldNum >= 3)
+	{
+		float ABCD[4] = { 0, 0, 0, 0 };
+		ParseFloats(field[1].begin, field[1].end, ABCD, 4);
+		glm::vec3 color = ParseVec3(field[2].begin, field[2].end);
+
+		this->planes.Add(ABCD[0], ABCD[1], ABCD[2], ABCD[3], color);
+		AddPlaneInfo(ABCD, color);
+	}
+	else if (IsKeyword(keyBegin, keyEnd, "Model") && fieldNum >= 3)
+	{
+		glm::vec3 color = ParseVec3(field[2].begin, field[2].end);
+
+		GeometryObject *model = new Model(Trimmed(field[1].begin, field[1].end), color);
+		this->scene.push_back(model);
+		if (!this->withObjectInfo)
+			return next;
+		SceneObjectInfo info;
+		info.key = HashText(field[1].begin, field[1].end, HashBytes("Model", 5));
+		info.colorKey = HashBytes(&color, sizeof(color));
+		model->GetBoundingBox(info.boundMin, info.boundMax);
+		this->sceneInfo.push_back(info);
+	}
+	else if (IsKeyword(keyBegin, keyEnd, "ModelDef") && fieldNum >= 4)
+	{
+		glm::vec3 color = ParseVec3(field[3].begin, field[3].end);
+
+		// a name is declared once, later definitions with the same name are ignored
+		std::string name = Trimmed(field[1].begin, field[1].end);
+		if (this->modelLibrary.find(name) == this->modelLibrary.end())
+		{
+			this->modelLibrary[name] = new Model(Trimmed(field[2].begin, field[2].end), color);
+			if (!this->withObjectInfo)
+				return next;
+			SceneObjectInfo &info = this->modelDefInfo[name];
+			info.key = HashText(field[2].begin, field[2].end, HashBytes(name.data(), name.size()));
+			info.colorKey = HashBytes(&color, sizeof(color));
+		}
+	}
+	else if (IsKeyword(keyBegin, keyEnd, "Instance") && fieldNum >= 6)
+	{
+		std::map<std::string, Model*>::iterator model = this->modelLibrary.find(Trimmed(field[1].begin, field[1].end));
+		// a model that failed to load has nothing to place
+		if (model == this->modelLibrary.end() || model->second->getMeshNum() == 0)
+			return next;
+
+		glm::vec3 translation = ParseVec3(field[2].begin, field[2].end);
+		glm::vec3 rotationAxis = ParseVec3(field[3].begin, field[3].end);
+		float rotationAngle = 0;
+		ParseFloats(field[4].begin, field[4].end, &rotationAngle, 1);
+		float s[3] = { 1, 1, 1 };
+		glm::vec3 scale = ParseFloats(field[5].begin, field[5].end, s, 3) == 3 ? glm::vec3(s[0], s[1], s[2]) : glm::vec3(s[0]);
+
+		glm::mat4 transformMatrix = glm::translate(glm::mat4(1.0f), translation);
+		// glm::rotate normalizes the axis, a zero axis would fill the matrix with NaN
+		if (rotationAngle != 0 && glm::length(rotationAxis) > 0)
+			transformMatrix = glm::rotate(transformMatrix, glm::radians(rotationAngle), rotationAxis);
+		transformMatrix = glm::scale(transformMatrix, scale);
+
+		GeometryObject *instance = new ModelInstance(model->second, transformMatrix);
+		this->scene.push_back(instance);
+		if (!this->withObjectInfo)
+			return next;
+		SceneObjectInfo info = this->modelDefInfo[model->first];
+		info.key = HashBytes(&transformMatrix, sizeof(transformMatrix), info.key);
+		instance->GetBoundingBox(info.boundMin, info.boundMax);
+		this->sceneInfo.push_back(info);
+	}
+	else if (IsKeyword(keyBegin, keyEnd, "CubeMap") && fieldNum >= 3)
+	{
+		float size = 0;
+		ParseFloats(field[2].begin, field[2].end, &size, 1);
+		this->light.push_back((LightBase*)new CubeMap(Trimmed(field[1].begin, field[1].end), size));
+		this->lightKey = HashBytes(&size, sizeof(size), HashText(field[1].begin, field[1].end, this->lightKey));
+	}
+	else
+	{
+		bool isSphere = IsKeyword(keyBegin, keyEnd, "SphereTable") || IsKeyword(keyBegin, keyEnd, "SphereBlock");
+		bool isTable = IsKeyword(keyBegin, keyEnd, "SphereTable") || IsKeyword(keyBegin, keyEnd, "PlaneTable");
+		if (!isSphere && !isTable && !IsKeyword(keyBegin, keyEnd, "PlaneBlock"))
+			return next; // unknown keyword or missing fields
+
+		int rowNum = 0;
+		const char *q = fieldNum >= 2 ? field[1].begin : lineEnd;
+		if (!ParseInt(q, lineEnd, rowNum) || rowNum < 0)
+			return NULL;
+
+		const char *rows;
+		std::vector<float> tableRows;
+		if (isTable)
+		{
+			next = ParseTable(next, end, rowNum, tableRows);
+			if (!next)
+				return NULL;
+			rows = reinterpret_cast<const char*>(tableRows.empty() ? NULL : &tableRows[0]);
+		}
+		else
+		{
+			// the block starts right after the line break, in the file's bytes
+			size_t blockSize = (size_t)rowNum * ROW_FLOAT_NUM * sizeof(float);
+			if ((size_t)(end - next) < blockSize)
+				return NULL;
+			rows = next;
+			next += blockSize;
+		}
+
+		if (isSphere)
+			this->spheres.AddArray(rowNum, rows);
+		else
+			this->planes.AddArray(rowNum, rows);
+
+		// blocks are not aligned
+		for (int i = 0; i < rowNum && this->withObjectInfo; i++)
+		{
+			float row[ROW_FLOAT_NUM];
+			memcpy(row, rows + (size_t)i * ROW_FLOAT_NUM * sizeof(float), sizeof(row));
+			if (isSphere)
+				AddSphereInfo(glm::vec3(row[0], row[1], row[2]), row[3], glm::vec3(row[4], row[5], row[6]));
+			else
+				AddPlaneInfo(row, glm::vec3(row[4], row[5], row[6]));
+		}
+	}
+
+	return next;
+}
+
+void SceneData::JoinObjectInfo()
+{
+	// copies of one object are told apart by how many came before them
+	objectInfo.clear();
+	objectInfo.insert(objectInfo.end(), sphereInfo.begin(), sphereInfo.end());
+	objectInfo.insert(objectInfo.end(), planeInfo.begin(), planeInfo.end());
+	objectInfo.insert(objectInfo.end(), sceneInfo.begin(), sceneInfo.end());
+	std::unordered_map<unsigned long long, int> copies;
+	copies.reserve(objectInfo.size());
+	for (std::vector<SceneObjectInfo>::iterator i = objectInfo.begin(); i != objectInfo.end(); i++)
+	{
+		int copy = copies[i->key]++;
+		if (copy > 0)
+			i->key = HashBytes(&copy, sizeof(copy), i->key);
+	}
+	std::vector<SceneObjectInfo>().swap(sphereInfo);
+	std::vector<SceneObjectInfo>().swap(planeInfo);
+	std::vector<SceneObjectInfo>().swap(sceneInfo);
+}
+
+void SceneData::AddSphereInfo(glm::vec3 center, float radius, glm::vec3 color)
+{
+	if (!this->withObjectInfo)
+		return;
+	SceneObjectInfo info;
+	float shape[4] = { center.x, center.y, center.z, radius };
+	info.key = HashBytes(shape, sizeof(shape), HashBytes("Sphere", 6));
+	info.colorKey = HashBytes(&color, sizeof(color));
+	info.boundMin = center - glm::vec3(glm::abs(radius));
+	info.boundMax = center + glm::vec3(glm::abs(radius));
+	this->sphereInfo.push_back(info);
+}
+
+void SceneData::AddPlaneInfo(const float *ABCD, glm::vec3 color)
+{
+	if (!this->withObjectInfo)
+		return;
+	SceneObjectInfo info;
+	info.key = HashBytes(ABCD, 4 * sizeof(float), HashBytes("Plane", 5));
+	info.colorKey = HashBytes(&color, sizeof(color));
+	info.boundMin = glm::vec3(-FLT_MAX);
+	info.boundMax = glm::vec3(FLT_MAX);
+	this->planeInfo.push_back(info);
+}
+
+const char* SceneData::ParseTable(const char *p, const char *end, int rowNum, std::vector<float> &rows)
+{
+	rows.resize((size_t)rowNum * ROW_FLOAT_NUM);
+	float *row = rows.empty() ? NULL : &rows[0];
+	for (int i = 0; i < rowNum; i++, row += ROW_FLOAT_NUM)
+	{
+		// blank and comment lines inside a table are skipped too
+		const char *lineEnd;
+		while (true)
+		{
+			if (p >= end)
+				return NULL;
+			lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+			if (!lineEnd)
+				lineEnd = end;
+			SkipBlank(p, lineEnd);
+			if (p < lineEnd && *p != '#')
+				break;
+			p = lineEnd + 1;
+		}
+
+		if (ParseFloats(p, lineEnd, row, ROW_FLOAT_NUM) != ROW_FLOAT_NUM)
+			return NULL;
+		p = lineEnd < end ? lineEnd + 1 : end;
+	}
+	return p;
+}
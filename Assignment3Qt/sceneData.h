@@ -0,0 +1,86 @@
+// everything a render needs from a scene file, shared by the gui, the tile workers and batch modes
+#pragma once
+
+#include <QString>
+
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <string>
+
+#include "geometryObject.h"
+#include "lightSource.h"
+#include "primitiveBatch.h"
+
+// the scene file is read line by line, fields are separated by ';' and numbers inside a field by ',':
+//   Sphere; center; radius; color
+//   Plane; ABCD; color
+//   Model; filePath; color
+//   ModelDef; name; filePath; color
+//   Instance; name; translation; rotation axis; rotation angle; scale
+//   CubeMap; filePath; size
+// bulk primitives come as a table or a binary block of rows of 7 numbers, (center, radius, color) for
+// spheres and (ABCD, color) for planes:
+//   SphereTable; count / PlaneTable; count		followed by count lines of 7 numbers
+//   SphereBlock; count / PlaneBlock; count		followed by count * 7 little endian floats right after the line break
+// lines starting with '#' and unknown keywords are skipped
+// identity of an object across loads of an edited scene file, see IncrementalRenderer. key covers what
+// decides the object's shape and place, colorKey its color, so a recolored object keeps its key
+struct SceneObjectInfo
+{
+	unsigned long long key, colorKey;
+	glm::vec3 boundMin, boundMax;
+};
+
+class SceneData
+{
+public:
+	SceneData();
+	~SceneData();
+
+	// create the lights and load the objects from a scene file, false if the file can't be opened or a table
+	// or block is broken. without a CubeMap line the default ../cubeMap.hdr lights the scene. objectInfo is
+	// only built with withObjectInfo, for the renders that compare scenes across loads
+	bool Load(QString sceneDataPath, bool withObjectInfo = false);
+
+	// objects, shared models, batches and lights
+	void ReportMemory(MemoryReport &report);
+
+	std::vector<GeometryObject*> scene;
+	std::vector<LightBase*> light;
+	// spheres and planes don't go into scene, they are batched by type
+	SphereBatch spheres;
+	PlaneBatch planes;
+	// models declared by "ModelDef" are kept here and shared by every "Instance" of them
+	std::map<std::string, Model*> modelLibrary;
+
+	// every object in the order RayTracer numbers them: spheres, planes, then the scene list. keys are unique,
+	// the n-th copy of an identical object gets its own. files behind a Model or ModelDef are not hashed.
+	// empty unless the scene was loaded withObjectInfo
+	std::vector<SceneObjectInfo> objectInfo;
+	// the lights, from the CubeMap lines
+	unsigned long long lightKey;
+
+private:
+	// a field of a line, it points into the mapped file
+	struct Field
+	{
+		const char *begin, *end;
+	};
+
+	// parse the line at p and return where the next one starts, tables and blocks also consume their rows.
+	// NULL when a table or block is broken
+	const char* ParseLine(const char *p, const char *end);
+
+	// rowNum rows of 7 numbers each into rows
+	const char* ParseTable(const char *p, const char *end, int rowNum, std::vector<float> &rows);
+
+	// identity of the objects while parsing, JoinObjectInfo puts them into objectInfo once the file is read
+	void JoinObjectInfo();
+	void AddSphereInfo(glm::vec3 center, float radius, glm::vec3 color);
+	void AddPlaneInfo(const float *ABCD, glm::vec3 color);
+	std::vector<SceneObjectInfo> sphereInfo, planeInfo, sceneInfo;
+	bool withObjectInfo;
+	// key and color key of each ModelDef, its instances are built on them
+	std::map<std::string, SceneObjectInfo> modelDefInfo;
+};
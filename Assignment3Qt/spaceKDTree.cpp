@@ -2,10 +2,24 @@
 
 #include "geometryObject.h"
 
+namespace
+{
+	// relative cost of visiting a node and of testing a triangle
+	const float NODE_COST = 1.0f;
+	const float TRIANGLE_COST = 1.5f;
+
+	float SurfaceArea(glm::vec3 AA, glm::vec3 BB)
+	{
+		glm::vec3 d = BB - AA;
+		return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+}
+
 SpaceKDTree::SpaceKDTree(std::vector<Triangle*> &faces)
 	: rootNode(NULL)
 {
 	BuildKDTree(faces, 0, faces.size(), 0, rootNode);
+	this->buildCost = SAHCost();
 }
 
 SpaceKDTree::~SpaceKDTree()
@@ -53,6 +67,68 @@ void SpaceKDTree::BuildKDTree(std::vector<Triangle*> &faces, int head, int tail,
 	MergeBoundingBox(node->AA, node->BB, node->lChild->AA, node->lChild->BB, node->rChild->AA, node->rChild->BB);
 }
 
+void SpaceKDTree::Refit(std::vector<Triangle*> &faces, int threadNum)
+{
+	// the levels above stopLevel are cheap, below it there are enough independent subtrees for every thread
+	int stopLevel = 0;
+	while ((1 << stopLevel) < threadNum * 4)
+		stopLevel++;
+
+	std::vector<TreeNode*> subtrees;
+	RefitNode(faces, this->rootNode, 0, stopLevel, &subtrees);
+	ParallelFor((int)subtrees.size(), [&](int i)
+	{
+		RefitNode(faces, subtrees[i], 0, -1, NULL);
+	}, threadNum);
+	RefitNode(faces, this->rootNode, 0, stopLevel, NULL);
+}
+
+void SpaceKDTree::RefitNode(std::vector<Triangle*> &faces, TreeNode *node, int level, int stopLevel, std::vector<TreeNode*> *subtrees)
+{
+	// subtrees at stopLevel are collected by the first pass and already refitted for the last one
+	if (level == stopLevel)
+	{
+		if (subtrees)
+			subtrees->push_back(node);
+		return;
+	}
+
+	if (node->triangleIdx.size() > 0)
+	{
+		if (subtrees)
+			return;
+		faces[node->triangleIdx[0]]->GetBoundingBox(node->AA, node->BB);
+		for (unsigned int i = 1; i < node->triangleIdx.size(); i++)
+		{
+			glm::vec3 AT, BT;
+			faces[node->triangleIdx[i]]->GetBoundingBox(AT, BT);
+			MergeBoundingBox(node->AA, node->BB, node->AA, node->BB, AT, BT);
+		}
+		return;
+	}
+
+	RefitNode(faces, node->lChild, level + 1, stopLevel, subtrees);
+	RefitNode(faces, node->rChild, level + 1, stopLevel, subtrees);
+	if (!subtrees)
+		MergeBoundingBox(node->AA, node->BB, node->lChild->AA, node->lChild->BB, node->rChild->AA, node->rChild->BB);
+}
+
+float SpaceKDTree::SAHCost()
+{
+	float rootArea = SurfaceArea(this->rootNode->AA, this->rootNode->BB);
+	if (rootArea <= 0)
+		return 0;
+	return NodeCost(this->rootNode) / rootArea;
+}
+
+float SpaceKDTree::NodeCost(TreeNode *node)
+{
+	float area = SurfaceArea(node->AA, node->BB);
+	if (node->triangleIdx.size() > 0)
+		return area * (NODE_COST + TRIANGLE_COST * node->triangleIdx.size());
+	return area * NODE_COST + NodeCost(node->lChild) + NodeCost(node->rChild);
+}
+
 void SpaceKDTree::DeleteKDTree(TreeNode *&node)
 {
 	if (node)
@@ -61,4 +137,21 @@ void SpaceKDTree::DeleteKDTree(TreeNode *&node)
 		DeleteKDTree(node->rChild);
 		safe_delete(node);
 	}
-}
\ No newline at end of file
+}
+
+void SpaceKDTree::ReportMemory(MemoryReport &report)
+{
+	size_t bytes = sizeof(SpaceKDTree), nodeNum = 0;
+	ReportNodeMemory(this->rootNode, bytes, nodeNum);
+	report.Add("kd tree nodes", bytes, nodeNum);
+}
+
+void SpaceKDTree::ReportNodeMemory(TreeNode *node, size_t &bytes, size_t &nodeNum)
+{
+	if (!node)
+		return;
+	bytes += sizeof(TreeNode) + VectorBytes(node->triangleIdx);
+	nodeNum++;
+	ReportNodeMemory(node->lChild, bytes, nodeNum);
+	ReportNodeMemory(node->rChild, bytes, nodeNum);
+}
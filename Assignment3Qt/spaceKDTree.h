@@ -4,6 +4,9 @@
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include "Utils.h"
+#include "memoryReport.h"
+
 class Triangle; // include "geometryObject.h"
 
 class SpaceKDTree
@@ -29,9 +32,26 @@ public:
 	SpaceKDTree(std::vector<Triangle*> &faces);
 	~SpaceKDTree();
 
+	// recompute every bounding box from the current triangle positions bottom up, the tree itself is kept,
+	// faces must be the vector the tree was built from
+	void Refit(std::vector<Triangle*> &faces, int threadNum = MYTHREADNUM);
+
+	// surface area heuristic cost of the tree (expected node visits and triangle tests of a random ray
+	// hitting the root box), it grows as a refitted tree gets worse than a fresh build
+	float SAHCost();
+
+	// the nodes and their triangle index lists
+	void ReportMemory(MemoryReport &report);
+
 	TreeNode* rootNode; // don't forget to set it to NULL
+	float buildCost; // SAHCost() right after the build
 
 private:
 	void BuildKDTree(std::vector<Triangle*> &faces, int head, int tail, int level, TreeNode *&node);
 	void DeleteKDTree(TreeNode *&node);
+
+	// refit the subtree of node, nodes at stopLevel are only collected into subtrees to be refitted in parallel
+	void RefitNode(std::vector<Triangle*> &faces, TreeNode *node, int level, int stopLevel, std::vector<TreeNode*> *subtrees);
+	float NodeCost(TreeNode *node);
+	void ReportNodeMemory(TreeNode *node, size_t &bytes, size_t &nodeNum);
 };
\ No newline at end of file
@@ -0,0 +1,91 @@
+// text parsing helpers on raw character ranges, shared by the mesh and scene loaders. mapped files are not
+// null terminated, so everything is bounded by an end pointer
+#pragma once
+
+#include <cstring>
+
+inline bool IsBlank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline void SkipBlank(const char *&p, const char *end)
+{
+	while (p < end && IsBlank(*p))
+		p++;
+}
+
+inline void SkipToken(const char *&p, const char *end)
+{
+	SkipBlank(p, end);
+	while (p < end && !IsBlank(*p) && *p != '\n')
+		p++;
+}
+
+inline const char* NextLine(const char *p, const char *end)
+{
+	const char *q = static_cast<const char*>(memchr(p, '\n', end - p));
+	return q ? q + 1 : end;
+}
+
+inline bool ParseInt(const char *&p, const char *end, int &value)
+{
+	SkipBlank(p, end);
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = (*p++ == '-');
+	if (p >= end || *p < '0' || *p > '9')
+		return false;
+	int v = 0;
+	while (p < end && *p >= '0' && *p <= '9')
+		v = v * 10 + (*p++ - '0');
+	value = negative ? -v : v;
+	return true;
+}
+
+// locale independent and much faster than strtod, precise enough for vertex data
+inline bool ParseFloat(const char *&p, const char *end, float &value)
+{
+	static const double pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+		1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18 };
+
+	SkipBlank(p, end);
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = (*p++ == '-');
+
+	long long mantissa = 0;
+	int exponent = 0, digits = 0;
+	bool anyDigit = false;
+	for (; p < end && *p >= '0' && *p <= '9'; p++)
+	{
+		anyDigit = true;
+		if (digits < 18) { mantissa = mantissa * 10 + (*p - '0'); digits++; }
+		else exponent++;
+	}
+	if (p < end && *p == '.')
+	{
+		for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+		{
+			anyDigit = true;
+			if (digits < 18) { mantissa = mantissa * 10 + (*p - '0'); digits++; exponent--; }
+		}
+	}
+	if (!anyDigit)
+		return false;
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		p++;
+		int e;
+		if (!ParseInt(p, end, e))
+			return false;
+		exponent += e;
+	}
+
+	double v = static_cast<double>(mantissa);
+	while (exponent > 18) { v *= 1e18; exponent -= 18; }
+	while (exponent < -18) { v /= 1e18; exponent += 18; }
+	v = exponent >= 0 ? v * pow10[exponent] : v / pow10[-exponent];
+	value = static_cast<float>(negative ? -v : v);
+	return true;
+}
@@ -0,0 +1,234 @@
+#include "tileCoordinator.h"
+
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QProcess>
+#include <QStringList>
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+#include "sceneData.h"
+#include "Utils.h"
+#include "traceLog.h"
+
+namespace
+{
+	const int TILE_HEADER_SIZE = 4 * sizeof(int);
+
+	QString Vec3ToString(glm::vec3 v)
+	{
+		return QString().sprintf("%.9g,%.9g,%.9g", v.x, v.y, v.z);
+	}
+}
+
+#pragma region Worker
+int RunTileWorker(int argc, char *argv[])
+{
+	if (argc < 9)
+		return 1;
+
+	QString sceneDataPath = QString::fromLocal8Bit(argv[2]);
+	glm::vec3 cameraPos = ParseVec3(argv[3]);
+	glm::vec3 cameraLookat = ParseVec3(argv[4]);
+	QTInputParam qtIP;
+	qtIP.resolutionW = atoi(argv[5]);
+	qtIP.resolutionH = atoi(argv[6]);
+	qtIP.antiAliasingLevel = atoi(argv[7]);
+	qtIP.imageScaleRatio = 1;
+	int threadNum = glm::max(atoi(argv[8]), 1);
+	qtIP.irradianceTolerance = argc > 9 ? (float)atof(argv[9]) : 0;
+	qtIP.lightCutError = argc > 10 ? (float)atof(argv[10]) : 0;
+	qtIP.denoise = false; // the coordinator only gets radiance back
+	qtIP.costMetric = argc > 11 ? (CostMetric)atoi(argv[11]) : COST_NONE;
+	qtIP.diffuseStrength = argc > 12 ? (float)atof(argv[12]) : DEFAULT_DIFFUSE_STRENGTH;
+	qtIP.specularStrength = argc > 13 ? (float)atof(argv[13]) : DEFAULT_SPECULAR_STRENGTH;
+
+#ifdef _WIN32
+	_setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+	SceneData *sceneData = new SceneData();
+	if (!sceneData->Load(sceneDataPath))
+	{
+		safe_delete(sceneData);
+		return 1;
+	}
+	// stdout carries the tiles, the memory report goes to stderr
+	MemoryReport report;
+	sceneData->ReportMemory(report);
+	fprintf(stderr, "%s", report.ToString().c_str());
+
+	RayTracer *rayTracer = new RayTracer(sceneData);
+	rayTracer->SetIrradianceCache(qtIP.irradianceTolerance);
+	rayTracer->SetShadingWeights(qtIP.diffuseStrength, qtIP.specularStrength);
+	rayTracer->SetLightCut(qtIP.lightCutError);
+	rayTracer->SetCostMetric(qtIP.costMetric);
+	RayTracingCameraClass *camera = CreateRenderCamera(cameraPos, cameraLookat, qtIP);
+
+	std::vector<glm::vec3> tile;
+	char line[256];
+	while (fgets(line, sizeof(line), stdin))
+	{
+		int header[4];
+		if (sscanf(line, "%d %d %d %d", &header[0], &header[1], &header[2], &header[3]) != 4)
+			break; // "quit"
+
+		int x = header[0], y = header[1], w = header[2], h = header[3];
+		tile.resize(w * h);
+		ParallelFor(h, [&](int row)
+		{
+			rayTracer->RenderPixels(camera, y + row, x, x + w, &tile[row * w]);
+		}, threadNum);
+
+		fwrite(header, sizeof(int), 4, stdout);
+		fwrite(&tile[0], sizeof(float), 3 * tile.size(), stdout);
+		fflush(stdout);
+	}
+
+	safe_delete(camera);
+	safe_delete(rayTracer);
+	safe_delete(sceneData);
+	return 0;
+}
+#pragma endregion
+
+#pragma region TileCoordinator
+TileCoordinator::TileCoordinator(int workerNum, int tileSize)
+	: workerNum(workerNum)
+	, tileSize(tileSize)
+{
+}
+
+void TileCoordinator::AssignTile(Worker &worker, std::deque<int> &queue)
+{
+	worker.tileIdx = -1;
+	if (queue.empty())
+		return;
+
+	worker.tileIdx = queue.front();
+	queue.pop_front();
+	const Tile &t = tiles[worker.tileIdx];
+	QByteArray request = QString().sprintf("%d %d %d %d\n", t.x, t.y, t.w, t.h).toLatin1();
+	worker.tileBeginUs = TraceLog::Now();
+	worker.process->write(request);
+}
+
+bool TileCoordinator::Render(QString sceneDataPath, glm::vec3 cameraPos, glm::vec3 cameraLookat, const QTInputParam &qtIP,
+	std::vector<glm::vec3> &pixelList, std::function<void(int, int, int, int)> tileDone)
+{
+	const int W = qtIP.resolutionW, H = qtIP.resolutionH;
+	pixelList.assign(W * H, glm::vec3(0));
+
+	// tiles in scanline order, so the preview fills the image from the top
+	tiles.clear();
+	std::deque<int> queue;
+	for (int y = 0; y < H; y += tileSize)
+	{
+		for (int x = 0; x < W; x += tileSize)
+		{
+			Tile t = { x, y, glm::min(tileSize, W - x), glm::min(tileSize, H - y) };
+			queue.push_back(tiles.size());
+			tiles.push_back(t);
+		}
+	}
+
+	// the workers get an absolute path, they share our working directory for everything else
+	QStringList args;
+	args << "--worker" << QFileInfo(sceneDataPath).absoluteFilePath() << Vec3ToString(cameraPos) << Vec3ToString(cameraLookat)
+		<< QString::number(W) << QString::number(H) << QString::number(qtIP.antiAliasingLevel)
+		<< QString::number(glm::max(MYTHREADNUM / workerNum, 1)) << QString::number(qtIP.irradianceTolerance)
+		<< QString::number(qtIP.lightCutError) << QString::number((int)qtIP.costMetric)
+		<< QString::number(qtIP.diffuseStrength) << QString::number(qtIP.specularStrength);
+
+	std::vector<Worker> workers(workerNum);
+	for (int i = 0; i < workerNum; i++)
+	{
+		workers[i].process = new QProcess();
+		workers[i].process->start(QCoreApplication::applicationFilePath(), args);
+		workers[i].alive = workers[i].process->waitForStarted();
+		workers[i].tileIdx = -1;
+		// the workers don't record, their tiles show on one lane each as seen from here
+		if (TraceLog::IsRecording())
+			TraceLog::SetLaneName(i + 1, QString("worker process %1").arg(i + 1).toStdString());
+		if (workers[i].alive)
+			AssignTile(workers[i], queue);
+	}
+
+	unsigned int finished = 0;
+	bool anyAlive = true;
+	while (finished < tiles.size() && anyAlive)
+	{
+		anyAlive = false;
+		for (int i = 0; i < workerNum; i++)
+		{
+			Worker &worker = workers[i];
+			if (!worker.alive)
+				continue;
+
+			worker.process->waitForReadyRead(5);
+			worker.buffer.append(worker.process->readAllStandardOutput());
+
+			// consume every complete tile in the buffer
+			while (worker.buffer.size() >= TILE_HEADER_SIZE)
+			{
+				int header[4];
+				memcpy(header, worker.buffer.constData(), TILE_HEADER_SIZE);
+				int tileBytes = header[2] * header[3] * 3 * sizeof(float);
+				if (worker.buffer.size() < TILE_HEADER_SIZE + tileBytes)
+					break;
+
+				const float *data = reinterpret_cast<const float*>(worker.buffer.constData() + TILE_HEADER_SIZE);
+				for (int row = 0; row < header[3]; row++)
+					memcpy(&pixelList[(header[1] + row) * W + header[0]], data + row * header[2] * 3, header[2] * 3 * sizeof(float));
+				worker.buffer.remove(0, TILE_HEADER_SIZE + tileBytes);
+
+				finished++;
+				TraceLog::AddSpan("tile", "render", worker.tileBeginUs, TraceLog::Now(), i + 1);
+				if (tileDone)
+					tileDone(header[0], header[1], header[2], header[3]);
+				AssignTile(worker, queue);
+			}
+
+			// a crashed worker only loses the tile it was rendering, the others pick it up
+			if (worker.process->state() == QProcess::NotRunning && worker.process->bytesAvailable() == 0)
+			{
+				worker.alive = false;
+				if (worker.tileIdx >= 0)
+				{
+					queue.push_front(worker.tileIdx);
+					worker.tileIdx = -1;
+				}
+				for (int j = 0; j < workerNum; j++)
+				{
+					if (workers[j].alive && workers[j].tileIdx < 0)
+						AssignTile(workers[j], queue);
+				}
+				continue;
+			}
+			anyAlive = true;
+		}
+		QCoreApplication::processEvents();
+	}
+
+	for (int i = 0; i < workerNum; i++)
+	{
+		if (workers[i].process->state() != QProcess::NotRunning)
+		{
+			workers[i].process->write("quit\n");
+			workers[i].process->closeWriteChannel();
+			if (!workers[i].process->waitForFinished(3000))
+				workers[i].process->kill();
+		}
+		safe_delete(workers[i].process);
+	}
+
+	return finished == tiles.size();
+}
+#pragma endregion
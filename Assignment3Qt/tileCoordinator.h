@@ -0,0 +1,52 @@
+// multi process rendering: a coordinator hands image tiles to worker processes over their stdin / stdout pipes
+#pragma once
+
+#include <QString>
+
+#include <vector>
+#include <deque>
+#include <functional>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "rayTracer.h"
+
+class QProcess;
+
+// a worker is this executable started as
+//   Assignment3Qt --worker <sceneDataPath> <x,y,z camera pos> <x,y,z lookat> <resolutionW> <resolutionH> <antiAliasing> <threadNum> [irradianceTolerance] [lightCutError] [costMetric]
+// it loads the scene once (every worker keeps its own irradiance cache), then answers every "x y w h" line on stdin with the tile
+// (4 int32 x, y, w, h followed by w * h * 3 float32 radiance) on stdout until "quit" or end of input
+int RunTileWorker(int argc, char *argv[]);
+
+class TileCoordinator
+{
+public:
+	TileCoordinator(int workerNum, int tileSize = 32);
+	~TileCoordinator(){};
+
+	// render the whole float image into pixelList, tileDone(x, y, w, h) is called on the calling thread for
+	// every finished tile, false if every worker died before the image was complete
+	bool Render(QString sceneDataPath, glm::vec3 cameraPos, glm::vec3 cameraLookat, const QTInputParam &qtIP,
+		std::vector<glm::vec3> &pixelList, std::function<void(int, int, int, int)> tileDone);
+
+private:
+	struct Tile
+	{
+		int x, y, w, h;
+	};
+
+	struct Worker
+	{
+		QProcess *process;
+		QByteArray buffer;	// stdout bytes not consumed yet
+		int tileIdx;		// tile being rendered, -1 when idle
+		long long tileBeginUs;	// TraceLog time the tile was sent
+		bool alive;
+	};
+
+	void AssignTile(Worker &worker, std::deque<int> &queue);
+
+	int workerNum, tileSize;
+	std::vector<Tile> tiles;
+};
@@ -0,0 +1,270 @@
+#include "tiledOutput.h"
+
+#include <QElapsedTimer>
+
+#include <cstdio>
+#include <mutex>
+
+#include "traceLog.h"
+#include "Utils.h"
+
+using namespace std;
+
+namespace
+{
+	// width of the exposure pre-pass, the percentile it measures hardly moves above this
+	const int PREPASS_WIDTH = 256;
+
+	// tiff tags and field types used
+	enum
+	{
+		TAG_IMAGE_WIDTH = 256, TAG_IMAGE_LENGTH = 257, TAG_BITS_PER_SAMPLE = 258, TAG_COMPRESSION = 259,
+		TAG_PHOTOMETRIC = 262, TAG_SAMPLES_PER_PIXEL = 277, TAG_PLANAR_CONFIG = 284,
+		TAG_TILE_WIDTH = 322, TAG_TILE_LENGTH = 323, TAG_TILE_OFFSETS = 324, TAG_TILE_BYTE_COUNTS = 325
+	};
+	enum { TYPE_SHORT = 3, TYPE_LONG = 4, TYPE_LONG8 = 16 };
+
+	// everything is little endian, values are appended byte by byte so the host order doesn't matter
+	void Put(vector<char> &out, quint64 value, int bytes)
+	{
+		for (int i = 0; i < bytes; i++)
+			out.push_back((char)((value >> (8 * i)) & 0xff));
+	}
+
+	struct Entry
+	{
+		int tag, type;
+		quint64 count;
+		quint64 value;	// the value itself, or the offset of the values when they don't fit in the entry
+	};
+}
+
+#pragma region TiledImageWriter
+TiledImageWriter::TiledImageWriter()
+	: bigTiff(false)
+	, w(0)
+	, h(0)
+	, tileSize(0)
+	, tileCountX(0)
+	, tileCountY(0)
+	, fileEnd(0)
+{
+}
+
+TiledImageWriter::~TiledImageWriter()
+{
+	this->file.close();
+}
+
+bool TiledImageWriter::Open(const QString &path, int w, int h, int tileSize)
+{
+	this->w = w;
+	this->h = h;
+	this->tileSize = (glm::max(tileSize, 16) + 15) / 16 * 16;
+	this->tileCountX = (w + this->tileSize - 1) / this->tileSize;
+	this->tileCountY = (h + this->tileSize - 1) / this->tileSize;
+	this->tileOffsets.assign(this->tileCountX * this->tileCountY, 0);
+
+	// the tiles plus a generous directory, past 4GB the offsets need 64 bits
+	quint64 tileBytes = (quint64)this->tileSize * this->tileSize * 3;
+	quint64 estimate = tileBytes * this->tileOffsets.size() + this->tileOffsets.size() * 16 + 4096;
+	this->bigTiff = estimate >= 0xffffffffULL;
+
+	this->file.setFileName(path);
+	if (!this->file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		return false;
+
+	// the directory offset is patched by Close
+	vector<char> header;
+	Put(header, 'I' | ('I' << 8), 2);
+	if (this->bigTiff)
+	{
+		Put(header, 43, 2);
+		Put(header, 8, 2);
+		Put(header, 0, 2);
+		Put(header, 0, 8);
+	}
+	else
+	{
+		Put(header, 42, 2);
+		Put(header, 0, 4);
+	}
+	this->fileEnd = header.size();
+	return this->file.write(&header[0], header.size()) == (qint64)header.size();
+}
+
+bool TiledImageWriter::WriteTile(int tileX, int tileY, const unsigned char *rgb)
+{
+	qint64 tileBytes = (qint64)this->tileSize * this->tileSize * 3;
+	this->tileOffsets[tileY * this->tileCountX + tileX] = this->fileEnd;
+	if (!this->file.seek(this->fileEnd) || this->file.write((const char *)rgb, tileBytes) != tileBytes)
+		return false;
+	this->fileEnd += tileBytes;
+	return true;
+}
+
+bool TiledImageWriter::Close()
+{
+	if (!this->file.isOpen())
+		return false;
+
+	// value arrays first, then the directory pointing at them. tile sizes are multiples of 16, so
+	// every offset stays word aligned as tiff wants
+	const int offsetBytes = this->bigTiff ? 8 : 4;
+	const int inlineBytes = this->bigTiff ? 8 : 4;
+	const quint64 tileNum = this->tileOffsets.size();
+	const quint64 tileBytes = (quint64)this->tileSize * this->tileSize * 3;
+	vector<char> data;
+
+	quint64 bitsPerSample = 8 | (8 << 16) | ((quint64)8 << 32);
+	if (!this->bigTiff)
+	{
+		bitsPerSample = this->fileEnd + data.size();
+		Put(data, 8, 2);
+		Put(data, 8, 2);
+		Put(data, 8, 2);
+		Put(data, 0, 2);
+	}
+
+	// a single tile's offset and size fit in the entry itself
+	quint64 tileOffsetsValue = this->tileOffsets[0], tileByteCountsValue = tileBytes;
+	if (tileNum * offsetBytes > (quint64)inlineBytes)
+	{
+		tileOffsetsValue = this->fileEnd + data.size();
+		for (quint64 i = 0; i < tileNum; i++)
+			Put(data, this->tileOffsets[i], offsetBytes);
+		tileByteCountsValue = this->fileEnd + data.size();
+		for (quint64 i = 0; i < tileNum; i++)
+			Put(data, tileBytes, offsetBytes);
+	}
+
+	const int offsetType = this->bigTiff ? TYPE_LONG8 : TYPE_LONG;
+	Entry entries[] = {
+		{ TAG_IMAGE_WIDTH, TYPE_LONG, 1, (quint64)this->w },
+		{ TAG_IMAGE_LENGTH, TYPE_LONG, 1, (quint64)this->h },
+		{ TAG_BITS_PER_SAMPLE, TYPE_SHORT, 3, bitsPerSample },
+		{ TAG_COMPRESSION, TYPE_SHORT, 1, 1 },
+		{ TAG_PHOTOMETRIC, TYPE_SHORT, 1, 2 },
+		{ TAG_SAMPLES_PER_PIXEL, TYPE_SHORT, 1, 3 },
+		{ TAG_PLANAR_CONFIG, TYPE_SHORT, 1, 1 },
+		{ TAG_TILE_WIDTH, TYPE_LONG, 1, (quint64)this->tileSize },
+		{ TAG_TILE_LENGTH, TYPE_LONG, 1, (quint64)this->tileSize },
+		{ TAG_TILE_OFFSETS, offsetType, tileNum, tileOffsetsValue },
+		{ TAG_TILE_BYTE_COUNTS, offsetType, tileNum, tileByteCountsValue },
+	};
+	const int entryNum = sizeof(entries) / sizeof(entries[0]);
+
+	quint64 directory = this->fileEnd + data.size();
+	Put(data, entryNum, this->bigTiff ? 8 : 2);
+	for (int i = 0; i < entryNum; i++)
+	{
+		Put(data, entries[i].tag, 2);
+		Put(data, entries[i].type, 2);
+		Put(data, entries[i].count, this->bigTiff ? 8 : 4);
+		// values in the entry are left aligned, a single short sits in its first two bytes
+		Put(data, entries[i].value, inlineBytes);
+	}
+	Put(data, 0, offsetBytes);
+
+	vector<char> directoryOffset;
+	Put(directoryOffset, directory, offsetBytes);
+	bool success = this->file.seek(this->fileEnd) && this->file.write(&data[0], data.size()) == (qint64)data.size() &&
+		this->file.seek(this->bigTiff ? 8 : 4) && this->file.write(&directoryOffset[0], offsetBytes) == offsetBytes;
+	this->file.close();
+	return success;
+}
+#pragma endregion
+
+#pragma region TiledRenderer
+TiledRenderer::TiledRenderer(RayTracer *rayTracer, const QTInputParam &qtIP, int tileSize, int threadNum)
+	: rayTracer(rayTracer)
+	, qtIP(qtIP)
+	, tileSize(tileSize)
+	, threadNum(glm::max(threadNum, 1))
+{
+}
+
+float TiledRenderer::EstimateExposure(glm::vec3 cameraPos, glm::vec3 cameraLookat)
+{
+	TraceScope trace("exposure pre-pass");
+
+	// the image plane doesn't depend on the resolution, a smaller camera sees the same view
+	QTInputParam prepassIP = this->qtIP;
+	prepassIP.resolutionW = glm::min(this->qtIP.resolutionW, PREPASS_WIDTH);
+	prepassIP.resolutionH = glm::max(this->qtIP.resolutionH * prepassIP.resolutionW / this->qtIP.resolutionW, 1);
+	prepassIP.antiAliasingLevel = 1;
+	RayTracingCameraClass *camera = CreateRenderCamera(cameraPos, cameraLookat, prepassIP);
+
+	const int W = camera->getW(), H = camera->getH();
+	vector<glm::vec3> pixelList(W * H);
+	ParallelFor(H, [&](int row)
+	{
+		this->rayTracer->RenderPixels(camera, row, 0, W, &pixelList[row * W]);
+	}, this->threadNum);
+	safe_delete(camera);
+	return CalExposureScale(&pixelList[0], W * H);
+}
+
+bool TiledRenderer::Render(glm::vec3 cameraPos, glm::vec3 cameraLookat, QString outputPath)
+{
+	const int W = this->qtIP.resolutionW, H = this->qtIP.resolutionH;
+	TiledImageWriter writer;
+	if (!writer.Open(outputPath, W, H, this->tileSize))
+		return false;
+
+	float scale = this->EstimateExposure(cameraPos, cameraLookat);
+	RayTracingCameraClass *camera = CreateRenderCamera(cameraPos, cameraLookat, this->qtIP);
+
+	// tiles are finished in whatever order the threads get to them, the file doesn't care
+	const int size = writer.TileSize(), tileNum = writer.TileCountX() * writer.TileCountY();
+	mutex writerMutex;
+	bool success = true;
+	int tilesWritten = 0;
+	QElapsedTimer timer;
+	timer.start();
+	ParallelFor(tileNum, [&](int tileIdx)
+	{
+		int tileX = tileIdx % writer.TileCountX(), tileY = tileIdx / writer.TileCountX();
+		int x0 = tileX * size, y0 = tileY * size;
+		int tileW = glm::min(size, W - x0), tileH = glm::min(size, H - y0);
+
+		vector<glm::vec3> pixels(size * size);
+		for (int y = 0; y < tileH; y++)
+			this->rayTracer->RenderPixels(camera, y0 + y, x0, x0 + tileW, &pixels[y * size]);
+
+		// padding outside the image stays black
+		vector<unsigned char> rgb(size * size * 3, 0);
+		for (int y = 0; y < tileH; y++)
+		{
+			for (int x = 0; x < tileW; x++)
+			{
+				glm::vec3 color = pixels[y * size + x] * scale;
+				unsigned char *out = &rgb[(y * size + x) * 3];
+				out[0] = (unsigned char)glm::min((int)color[0], 255);
+				out[1] = (unsigned char)glm::min((int)color[1], 255);
+				out[2] = (unsigned char)glm::min((int)color[2], 255);
+			}
+		}
+
+		lock_guard<mutex> lock(writerMutex);
+		if (!writer.WriteTile(tileX, tileY, &rgb[0]))
+			success = false;
+		if (++tilesWritten % glm::max(tileNum / 20, 1) == 0)
+		{
+			printf("%d / %d tiles\n", tilesWritten, tileNum);
+			fflush(stdout);
+		}
+	}, this->threadNum);
+
+	safe_delete(camera);
+	success = writer.Close() && success;
+	printf("%d tiles in %.2fs\n", tileNum, timer.elapsed() / 1000.0f);
+	return success;
+}
+
+void TiledRenderer::ReportMemory(MemoryReport &report) const
+{
+	int size = (glm::max(this->tileSize, 16) + 15) / 16 * 16;
+	report.Add("tile buffers", (size_t)this->threadNum * size * size * (sizeof(glm::vec3) + 3), this->threadNum);
+}
+#pragma endregion
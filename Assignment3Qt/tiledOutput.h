@@ -0,0 +1,64 @@
+// output for images too large to hold in memory: tiles are traced, tonemapped and written to disk one at a time
+#pragma once
+
+#include <QString>
+#include <QFile>
+
+#include <vector>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "rayTracer.h"
+
+// uncompressed 8 bit rgb tiff with square tiles, written in any tile order. tiles go straight to the end of
+// the file, only their offsets are kept until Close writes the directory. files that could pass 4GB are
+// written as BigTIFF
+class TiledImageWriter
+{
+public:
+	TiledImageWriter();
+	~TiledImageWriter();
+
+	// tileSize is rounded up to a multiple of 16 as tiff asks for
+	bool Open(const QString &path, int w, int h, int tileSize);
+	bool Close();
+
+	int TileSize() const { return this->tileSize; }
+	int TileCountX() const { return this->tileCountX; }
+	int TileCountY() const { return this->tileCountY; }
+
+	// rgb holds TileSize() * TileSize() pixels, the part outside the image is written but never shown.
+	// not thread safe, every tile is written once
+	bool WriteTile(int tileX, int tileY, const unsigned char *rgb);
+
+private:
+	QFile file;
+	bool bigTiff;
+	int w, h, tileSize, tileCountX, tileCountY;
+	quint64 fileEnd;
+	std::vector<quint64> tileOffsets;
+};
+
+// renders the image tile by tile into a TiledImageWriter. at most one tile per thread is in memory, so the
+// largest image is limited by the disk. exposure comes from a small pre-pass of the same view since the full
+// image is never in memory at once, there is no denoising
+class TiledRenderer
+{
+public:
+	TiledRenderer(RayTracer *rayTracer, const QTInputParam &qtIP, int tileSize = 256, int threadNum = MYTHREADNUM);
+	~TiledRenderer(){};
+
+	// CalExposureScale of the view rendered at most PREPASS_WIDTH pixels wide with one ray per pixel
+	float EstimateExposure(glm::vec3 cameraPos, glm::vec3 cameraLookat);
+
+	// false if the file can't be written
+	bool Render(glm::vec3 cameraPos, glm::vec3 cameraLookat, QString outputPath);
+
+	// the tile buffers in flight
+	void ReportMemory(MemoryReport &report) const;
+
+private:
+	RayTracer *rayTracer;
+	QTInputParam qtIP;
+	int tileSize, threadNum;
+};
@@ -0,0 +1,130 @@
+#include "traceLog.h"
+
+#include <QFile>
+#include <QElapsedTimer>
+
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+	struct Span
+	{
+		const char *name, *category;
+		long long beginUs, endUs;
+		int lane;
+	};
+
+	std::atomic<bool> recording(false);
+	QElapsedTimer traceClock;
+	std::mutex spanMutex; // guards spans and laneNames, spans end on every render thread
+	std::vector<Span> spans;
+	std::map<int, std::string> laneNames;
+
+	// names come from our own literals and file names, only quotes and backslashes need escaping
+	std::string Escape(const std::string &s)
+	{
+		std::string out;
+		for (size_t i = 0; i < s.size(); i++)
+		{
+			if (s[i] == '"' || s[i] == '\\')
+				out += '\\';
+			out += s[i];
+		}
+		return out;
+	}
+}
+
+void TraceLog::Start()
+{
+	std::lock_guard<std::mutex> lock(spanMutex);
+	spans.clear();
+	laneNames.clear();
+	traceClock.start();
+	recording = true;
+}
+
+void TraceLog::Stop()
+{
+	recording = false;
+}
+
+bool TraceLog::IsRecording()
+{
+	return recording;
+}
+
+long long TraceLog::Now()
+{
+	return recording ? traceClock.nsecsElapsed() / 1000 : 0;
+}
+
+void TraceLog::AddSpan(const char *name, const char *category, long long beginUs, long long endUs, int lane)
+{
+	if (!recording)
+		return;
+
+	std::lock_guard<std::mutex> lock(spanMutex);
+	Span span = { name, category, beginUs, endUs, lane };
+	spans.push_back(span);
+	if (laneNames.find(lane) == laneNames.end())
+	{
+		char laneName[32];
+		sprintf(laneName, "thread %d", lane);
+		laneNames[lane] = lane == 0 ? "main" : laneName;
+	}
+}
+
+void TraceLog::SetLaneName(int lane, const std::string &name)
+{
+	std::lock_guard<std::mutex> lock(spanMutex);
+	laneNames[lane] = name;
+}
+
+bool TraceLog::Save(const QString &path)
+{
+	QFile file(path);
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+
+	std::lock_guard<std::mutex> lock(spanMutex);
+	std::vector<std::string> events;
+	char line[512];
+	for (std::map<int, std::string>::iterator i = laneNames.begin(); i != laneNames.end(); i++)
+	{
+		sprintf(line, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+			i->first, Escape(i->second).c_str());
+		events.push_back(line);
+	}
+	for (size_t i = 0; i < spans.size(); i++)
+	{
+		const Span &span = spans[i];
+		sprintf(line, "{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %d, \"ts\": %lld, \"dur\": %lld}",
+			Escape(span.name).c_str(), Escape(span.category).c_str(), span.lane, span.beginUs, span.endUs - span.beginUs);
+		events.push_back(line);
+	}
+
+	std::string json = "{\"traceEvents\": [\n";
+	for (size_t i = 0; i < events.size(); i++)
+		json += events[i] + (i + 1 < events.size() ? ",\n" : "\n");
+	json += "]}\n";
+
+	return file.write(json.c_str(), json.size()) == (qint64)json.size();
+}
+
+TraceScope::TraceScope(const char *name, const char *category, int lane)
+	: name(name)
+	, category(category)
+	, lane(lane)
+	, beginUs(TraceLog::IsRecording() ? TraceLog::Now() : -1)
+{
+}
+
+TraceScope::~TraceScope()
+{
+	if (this->beginUs >= 0)
+		TraceLog::AddSpan(this->name, this->category, this->beginUs, TraceLog::Now(), this->lane);
+}
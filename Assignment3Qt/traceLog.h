@@ -0,0 +1,44 @@
+// timeline of a render in the chrome trace event format, open the saved file in chrome://tracing or
+// ui.perfetto.dev to see every phase and every thread's spans side by side
+#pragma once
+
+#include <QString>
+
+#include <string>
+
+// one recording per process at a time. while nothing records a TraceScope only checks a flag.
+// spans go to lanes instead of system thread ids, the render threads are started again for every row so
+// each lane is a thread slot: 0 is the main thread, 1 to n the slots of a parallel phase
+class TraceLog
+{
+public:
+	// drops the previous events and starts the clock
+	static void Start();
+	static void Stop();
+	static bool IsRecording();
+
+	// microseconds since Start(), 0 while nothing records
+	static long long Now();
+
+	// name and category have to outlive the recording
+	static void AddSpan(const char *name, const char *category, long long beginUs, long long endUs, int lane = 0);
+
+	// shown instead of "main" / "thread <lane>"
+	static void SetLaneName(int lane, const std::string &name);
+
+	// {"traceEvents": [...]} with complete events and a name per lane
+	static bool Save(const QString &path);
+};
+
+// records the span from its construction to its destruction
+class TraceScope
+{
+public:
+	TraceScope(const char *name, const char *category = "render", int lane = 0);
+	~TraceScope();
+
+private:
+	const char *name, *category;
+	int lane;
+	long long beginUs;
+};
@@ -0,0 +1,96 @@
+#include "wideBVH.h"
+
+#include <limits>
+
+WideBVH::WideBVH(SpaceKDTree *tree)
+{
+	Collapse(tree);
+}
+
+void WideBVH::ReportMemory(MemoryReport &report)
+{
+	report.Add("wide bvh nodes", sizeof(WideBVH) + VectorBytes(this->nodes) + VectorBytes(this->leaves), this->nodes.size());
+}
+
+void WideBVH::Collapse(SpaceKDTree *tree)
+{
+	this->nodes.clear();
+	this->leaves.clear();
+	if (tree->rootNode)
+		AddNode(tree->rootNode);
+}
+
+int WideBVH::AddNode(SpaceKDTree::TreeNode *kdNode)
+{
+	// start from the two kd children and keep opening the inner child with the largest box
+	SpaceKDTree::TreeNode *children[4];
+	int childNum = 0;
+	if (kdNode->triangleIdx.size() > 0)
+		children[childNum++] = kdNode;
+	else
+	{
+		children[childNum++] = kdNode->lChild;
+		children[childNum++] = kdNode->rChild;
+	}
+	while (childNum < 4)
+	{
+		int best = -1;
+		float bestArea = -1;
+		for (int i = 0; i < childNum; i++)
+		{
+			if (children[i]->triangleIdx.size() > 0)
+				continue;
+			glm::vec3 d = children[i]->BB - children[i]->AA;
+			float area = d.x * d.y + d.y * d.z + d.z * d.x;
+			if (area > bestArea)
+			{
+				bestArea = area;
+				best = i;
+			}
+		}
+		if (best < 0)
+			break;
+
+		SpaceKDTree::TreeNode *opened = children[best];
+		children[best] = opened->lChild;
+		children[childNum++] = opened->rChild;
+	}
+
+	int nodeIdx = this->nodes.size();
+	this->nodes.push_back(WideNode());
+	for (int lane = 0; lane < 4; lane++)
+	{
+		WideNode &node = this->nodes[nodeIdx];
+		if (lane >= childNum)
+		{
+			node.minX[lane] = node.minY[lane] = node.minZ[lane] = std::numeric_limits<float>::infinity();
+			node.maxX[lane] = node.maxY[lane] = node.maxZ[lane] = -std::numeric_limits<float>::infinity();
+			node.child[lane] = 0;
+			continue;
+		}
+
+		SpaceKDTree::TreeNode *child = children[lane];
+		node.minX[lane] = child->AA.x;
+		node.minY[lane] = child->AA.y;
+		node.minZ[lane] = child->AA.z;
+		node.maxX[lane] = child->BB.x;
+		node.maxY[lane] = child->BB.y;
+		node.maxZ[lane] = child->BB.z;
+
+		if (child->triangleIdx.size() > 0)
+		{
+			// a kd leaf holds a contiguous range of the sorted faces
+			Leaf leaf = { child->triangleIdx[0], (int)child->triangleIdx.size() };
+			this->leaves.push_back(leaf);
+			node.child[lane] = ~(int)(this->leaves.size() - 1);
+		}
+		else
+		{
+			// nodes may move while the child is added
+			int childIdx = AddNode(child);
+			this->nodes[nodeIdx].child[lane] = childIdx;
+		}
+	}
+
+	return nodeIdx;
+}
@@ -0,0 +1,208 @@
+// 4 wide bvh collapsed from a SpaceKDTree, every node keeps the boxes of its children as structure of
+// arrays so one SSE slab test covers all of them
+#pragma once
+
+#include <vector>
+
+#include <xmmintrin.h>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "rayTracingCamera.h"
+#include "spaceKDTree.h"
+#include "Utils.h"
+
+class WideBVH
+{
+public:
+	struct WideNode
+	{
+		// child bounding boxes, unused lanes have min > max so they are never hit
+		float minX[4], minY[4], minZ[4];
+		float maxX[4], maxY[4], maxZ[4];
+		// >= 0 is a node index, < 0 is ~leaf index
+		int child[4];
+	};
+
+	// triangles [first, first + num) of the faces vector the kd tree was built from
+	struct Leaf
+	{
+		int first, num;
+	};
+
+	WideBVH(SpaceKDTree *tree);
+	~WideBVH(){};
+
+	// build the nodes again from the tree, after it was refitted or rebuilt
+	void Collapse(SpaceKDTree *tree);
+
+	void ReportMemory(MemoryReport &report);
+
+	// calls leafFunc(leaf) for every leaf the ray enters nearer than nearest, nearest first. leafFunc lowers
+	// nearest when it finds a hit, which culls everything behind it
+	template <typename LeafFunc>
+	void Traverse(RayClass *ray, float &nearest, LeafFunc leafFunc) const;
+
+	// one traversal for all rays of the bundle in active, every node is entered with the mask of the rays that
+	// reach one of its boxes before their maxT. leafFunc(leaf, mask) returns the rays of mask it occludes, they
+	// are dropped from the rest of the traversal. the occluded rays of active are returned
+	template <typename LeafFunc>
+	RayMask Occlude(const ShadowBundle &bundle, RayMask active, LeafFunc leafFunc) const;
+
+	std::vector<WideNode> nodes;
+	std::vector<Leaf> leaves;
+
+private:
+	int AddNode(SpaceKDTree::TreeNode *kdNode);
+};
+
+template <typename LeafFunc>
+void WideBVH::Traverse(RayClass *ray, float &nearest, LeafFunc leafFunc) const
+{
+	if (this->nodes.empty())
+		return;
+
+	const __m128 ox = _mm_set1_ps(ray->sPoint.x), oy = _mm_set1_ps(ray->sPoint.y), oz = _mm_set1_ps(ray->sPoint.z);
+	const __m128 ix = _mm_set1_ps(ray->invDirection.x), iy = _mm_set1_ps(ray->invDirection.y), iz = _mm_set1_ps(ray->invDirection.z);
+	const __m128 eps = _mm_set1_ps((float)MYEPSILON);
+
+	// a collapsed node opens at least one kd level, 3 entries are left per level at most
+	struct StackEntry
+	{
+		int node;
+		float t;
+	};
+	StackEntry stack[128];
+	int stackSize = 0;
+	stack[stackSize].node = 0;
+	stack[stackSize++].t = -MYINFINITE;
+
+	while (stackSize > 0)
+	{
+		StackEntry entry = stack[--stackSize];
+		if (entry.t > nearest)
+			continue;
+		if (entry.node < 0)
+		{
+			leafFunc(this->leaves[~entry.node]);
+			continue;
+		}
+
+		const WideNode &node = this->nodes[entry.node];
+		if (ray->cost)
+			ray->cost->nodeNum++;
+		__m128 tMinX = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(ray->sign[0] ? node.maxX : node.minX), ox), ix);
+		__m128 tMaxX = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(ray->sign[0] ? node.minX : node.maxX), ox), ix);
+		__m128 tMinY = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(ray->sign[1] ? node.maxY : node.minY), oy), iy);
+		__m128 tMaxY = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(ray->sign[1] ? node.minY : node.maxY), oy), iy);
+		__m128 tMinZ = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(ray->sign[2] ? node.maxZ : node.minZ), oz), iz);
+		__m128 tMaxZ = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(ray->sign[2] ? node.minZ : node.maxZ), oz), iz);
+
+		__m128 tEnter = _mm_max_ps(_mm_max_ps(tMinX, tMinY), tMinZ);
+		__m128 tExit = _mm_min_ps(_mm_min_ps(tMaxX, tMaxY), tMaxZ);
+		__m128 hit = _mm_and_ps(_mm_cmplt_ps(tEnter, _mm_add_ps(tExit, eps)), _mm_cmpgt_ps(tExit, eps));
+		hit = _mm_and_ps(hit, _mm_cmplt_ps(tEnter, _mm_set1_ps(nearest)));
+		int mask = _mm_movemask_ps(hit);
+		if (!mask)
+			continue;
+
+		float tLane[4];
+		_mm_storeu_ps(tLane, tEnter);
+
+		// sort the hit children far to near, so the nearest one is popped first
+		int order[4], hitNum = 0;
+		for (int lane = 0; lane < 4; lane++)
+		{
+			if (!(mask & (1 << lane)))
+				continue;
+			int i = hitNum++;
+			for (; i > 0 && tLane[order[i - 1]] < tLane[lane]; i--)
+				order[i] = order[i - 1];
+			order[i] = lane;
+		}
+		for (int i = 0; i < hitNum; i++)
+		{
+			stack[stackSize].node = node.child[order[i]];
+			stack[stackSize++].t = tLane[order[i]];
+		}
+	}
+}
+
+template <typename LeafFunc>
+RayMask WideBVH::Occlude(const ShadowBundle &bundle, RayMask active, LeafFunc leafFunc) const
+{
+	RayMask occluded = 0;
+	if (this->nodes.empty() || !active)
+		return occluded;
+
+	const __m128 ox = _mm_set1_ps(bundle.origin.x), oy = _mm_set1_ps(bundle.origin.y), oz = _mm_set1_ps(bundle.origin.z);
+	const __m128 eps = _mm_set1_ps((float)MYEPSILON);
+
+	struct StackEntry
+	{
+		int node;
+		RayMask mask;
+	};
+	StackEntry stack[128];
+	int stackSize = 0;
+	stack[stackSize].node = 0;
+	stack[stackSize++].mask = active;
+
+	while (stackSize > 0)
+	{
+		StackEntry entry = stack[--stackSize];
+		RayMask mask = entry.mask & ~occluded;
+		if (!mask)
+			continue;
+		if (entry.node < 0)
+		{
+			occluded |= leafFunc(this->leaves[~entry.node], mask);
+			if (occluded == active)
+				break;
+			continue;
+		}
+
+		const WideNode &node = this->nodes[entry.node];
+		if (bundle.cost)
+			bundle.cost->nodeNum++;
+		// the box planes relative to the shared origin, the same for every ray
+		const __m128 loX = _mm_sub_ps(_mm_loadu_ps(node.minX), ox), hiX = _mm_sub_ps(_mm_loadu_ps(node.maxX), ox);
+		const __m128 loY = _mm_sub_ps(_mm_loadu_ps(node.minY), oy), hiY = _mm_sub_ps(_mm_loadu_ps(node.maxY), oy);
+		const __m128 loZ = _mm_sub_ps(_mm_loadu_ps(node.minZ), oz), hiZ = _mm_sub_ps(_mm_loadu_ps(node.maxZ), oz);
+
+		// each active ray tests the 4 children at once, the same slab test as Traverse
+		RayMask childMask[4] = { 0, 0, 0, 0 };
+		int r = 0;
+		for (RayMask rest = mask; rest; r++, rest >>= 1)
+		{
+			if (!(rest & 1))
+				continue;
+			const RayClass &ray = bundle.rays[r];
+			const __m128 ix = _mm_set1_ps(ray.invDirection.x), iy = _mm_set1_ps(ray.invDirection.y), iz = _mm_set1_ps(ray.invDirection.z);
+			__m128 tMinX = _mm_mul_ps(ray.sign[0] ? hiX : loX, ix);
+			__m128 tMaxX = _mm_mul_ps(ray.sign[0] ? loX : hiX, ix);
+			__m128 tMinY = _mm_mul_ps(ray.sign[1] ? hiY : loY, iy);
+			__m128 tMaxY = _mm_mul_ps(ray.sign[1] ? loY : hiY, iy);
+			__m128 tMinZ = _mm_mul_ps(ray.sign[2] ? hiZ : loZ, iz);
+			__m128 tMaxZ = _mm_mul_ps(ray.sign[2] ? loZ : hiZ, iz);
+
+			__m128 tEnter = _mm_max_ps(_mm_max_ps(tMinX, tMinY), tMinZ);
+			__m128 tExit = _mm_min_ps(_mm_min_ps(tMaxX, tMaxY), tMaxZ);
+			__m128 hit = _mm_and_ps(_mm_cmplt_ps(tEnter, _mm_add_ps(tExit, eps)), _mm_cmpgt_ps(tExit, eps));
+			hit = _mm_and_ps(hit, _mm_cmplt_ps(tEnter, _mm_set1_ps(bundle.maxT[r])));
+			int lanes = _mm_movemask_ps(hit);
+			for (int lane = 0; lane < 4; lane++)
+				childMask[lane] |= (RayMask)((lanes >> lane) & 1) << r;
+		}
+
+		for (int lane = 0; lane < 4; lane++)
+		{
+			if (!childMask[lane])
+				continue;
+			stack[stackSize].node = node.child[lane];
+			stack[stackSize++].mask = childMask[lane];
+		}
+	}
+
+	return occluded & active;
+}